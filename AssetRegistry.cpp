@@ -0,0 +1,257 @@
+#include "AssetRegistry.hpp"
+#include "Screen.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+
+AssetRegistry &AssetRegistry::getInstance() {
+    static AssetRegistry registry;
+
+    return registry;
+}
+
+// lexical only, so "a/../b.png" and "b.png" dedup without touching the disk
+static std::string normalizePath(const std::string& fn) {
+    return std::filesystem::path(fn).lexically_normal().generic_string();
+}
+
+static VkDeviceSize memorySize(const Texture& texture) {
+    return texture.getMemorySize();
+}
+
+static VkDeviceSize memorySize(const std::vector<Mesh>& meshes) {
+    VkDeviceSize bytes = 0;
+    for (const auto& mesh : meshes) {
+        bytes += mesh.getMemorySize();
+    }
+    return bytes;
+}
+
+template<typename T>
+AssetHandle<T> AssetRegistry::acquire(Pool<T> &pool, const std::string &key, std::function<std::shared_ptr<Streamed<T>>()> load) {
+    if (const auto it = pool.byKey.find(key); it != pool.byKey.end()) {
+        auto& slot = pool.slots[it->second];
+        ++slot.refs;
+        return {it->second, slot.generation};
+    }
+
+    uint32_t index;
+    if (!pool.freeSlots.empty()) {
+        index = pool.freeSlots.back();
+        pool.freeSlots.pop_back();
+    } else {
+        index = static_cast<uint32_t>(pool.slots.size());
+        pool.slots.emplace_back();
+    }
+
+    auto& slot = pool.slots[index];
+    slot.key = key;
+    slot.load = std::move(load);
+    slot.asset = slot.load();
+    slot.refs = 1;
+    pool.byKey.emplace(key, index);
+    ++pool.live;
+    return {index, slot.generation};
+}
+
+template<typename T>
+const AssetRegistry::Slot<T> &AssetRegistry::resolve(const Pool<T> &pool, AssetHandle<T> handle) const {
+    if (handle.index >= pool.slots.size() || pool.slots[handle.index].generation != handle.generation ||
+        !pool.slots[handle.index].asset) {
+        throw std::runtime_error("stale asset handle");
+    }
+    return pool.slots[handle.index];
+}
+
+template<typename T>
+void AssetRegistry::retain(Pool<T> &pool, AssetHandle<T> handle) {
+    resolve(pool, handle);
+    ++pool.slots[handle.index].refs;
+}
+
+template<typename T>
+void AssetRegistry::release(Pool<T> &pool, AssetHandle<T> handle) {
+    resolve(pool, handle);
+    auto& slot = pool.slots[handle.index];
+    if (--slot.refs > 0) {
+        return;
+    }
+
+    if (slot.tracked) {
+        Screen::getInstance().getResidencyManager().untrack(pool.idBase | handle.index);
+    }
+    pool.byKey.erase(slot.key);
+    pool.retired.push_back(std::move(slot.asset));
+    slot.key.clear();
+    slot.load = {};
+    slot.tracked = false;
+    slot.evicted = false;
+    ++slot.generation;
+    pool.freeSlots.push_back(handle.index);
+    --pool.live;
+}
+
+template<typename T>
+const T &AssetRegistry::use(Pool<T> &pool, AssetHandle<T> handle) {
+    resolve(pool, handle);
+    auto& slot = pool.slots[handle.index];
+    if (slot.evicted) {
+        // the evicted Streamed already shows the placeholder, a fresh one takes its place
+        slot.asset = slot.load();
+        slot.evicted = false;
+        ++reloads;
+    } else if (slot.tracked) {
+        Screen::getInstance().getResidencyManager().touch(pool.idBase | handle.index, Screen::getInstance().getFrameNumber());
+    }
+    return slot.asset->get();
+}
+
+template<typename T>
+void AssetRegistry::trackResident(Pool<T> &pool, uint64_t frame) {
+    auto& residency = Screen::getInstance().getResidencyManager();
+    for (uint32_t i = 0; i < pool.slots.size(); ++i) {
+        auto& slot = pool.slots[i];
+        if (slot.asset && !slot.tracked && slot.asset->isResident()) {
+            residency.track(pool.idBase | i, memorySize(slot.asset->get()), frame);
+            slot.tracked = true;
+        }
+    }
+}
+
+template<typename T>
+void AssetRegistry::evict(Pool<T> &pool, uint32_t index) {
+    auto& slot = pool.slots[index];
+    AssetStreamer::getInstance().unload(slot.asset);
+    Screen::getInstance().getResidencyManager().untrack(pool.idBase | index);
+    slot.tracked = false;
+    slot.evicted = true;
+}
+
+template<typename T>
+void AssetRegistry::releaseAll(Pool<T> &pool) {
+    for (uint32_t i = 0; i < pool.slots.size(); ++i) {
+        if (pool.slots[i].asset) {
+            pool.slots[i].refs = 1;
+            release(pool, AssetHandle<T>{i, pool.slots[i].generation});
+        }
+    }
+}
+
+template<typename T>
+void AssetRegistry::collect(Pool<T> &pool) {
+    std::erase_if(pool.retired, [&](const std::shared_ptr<Streamed<T>>& asset) {
+        // a load still in flight owns the asset until the streamer hands it over
+        if (asset->ready().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        AssetStreamer::getInstance().unload(asset);
+        return true;
+    });
+}
+
+TextureHandle AssetRegistry::acquireTexture(const std::string &fn) {
+    std::lock_guard lock(mutex);
+    const auto path = normalizePath(fn);
+    return acquire<Texture>(textures, path, [path]() {
+        return AssetStreamer::getInstance().loadTexture(path);
+    });
+}
+
+ModelHandle AssetRegistry::acquireModel(const std::string &fn, const ModelLoadOptions &options, CpuRetention retention) {
+    std::lock_guard lock(mutex);
+    const auto path = normalizePath(fn);
+    const auto key = path + "#" + std::to_string(options.key()) + (options.flipWinding ? "f" : "") +
+                     (retention == CpuRetention::Keep ? "k" : "");
+    return acquire<std::vector<Mesh>>(models, key, [path, options, retention]() {
+        return AssetStreamer::getInstance().loadModel(path, options, retention);
+    });
+}
+
+void AssetRegistry::retain(TextureHandle handle) {
+    std::lock_guard lock(mutex);
+    retain(textures, handle);
+}
+
+void AssetRegistry::retain(ModelHandle handle) {
+    std::lock_guard lock(mutex);
+    retain(models, handle);
+}
+
+void AssetRegistry::release(TextureHandle handle) {
+    std::lock_guard lock(mutex);
+    release(textures, handle);
+}
+
+void AssetRegistry::release(ModelHandle handle) {
+    std::lock_guard lock(mutex);
+    release(models, handle);
+}
+
+const Texture &AssetRegistry::get(TextureHandle handle) {
+    std::lock_guard lock(mutex);
+    return use(textures, handle);
+}
+
+const std::vector<Mesh> &AssetRegistry::get(ModelHandle handle) {
+    std::lock_guard lock(mutex);
+    return use(models, handle);
+}
+
+bool AssetRegistry::isResident(TextureHandle handle) const {
+    std::lock_guard lock(mutex);
+    return resolve(textures, handle).asset->isResident();
+}
+
+bool AssetRegistry::isResident(ModelHandle handle) const {
+    std::lock_guard lock(mutex);
+    return resolve(models, handle).asset->isResident();
+}
+
+void AssetRegistry::update() {
+    AssetStreamer::getInstance().update();
+
+    std::lock_guard lock(mutex);
+    collect(textures);
+    collect(models);
+
+    auto& screen = Screen::getInstance();
+    const uint64_t frame = screen.getFrameNumber();
+    trackResident(textures, frame);
+    trackResident(models, frame);
+
+    const auto victims = screen.getResidencyManager().selectEvictions(frame);
+    for (const auto id : victims) {
+        const auto index = static_cast<uint32_t>(id);
+        if (id >= models.idBase) {
+            evict(models, index);
+        } else {
+            evict(textures, index);
+        }
+    }
+}
+
+void AssetRegistry::destroy() {
+    std::lock_guard lock(mutex);
+    releaseAll(textures);
+    releaseAll(models);
+
+    // AssetStreamer::destroy drains whatever is still loading, only the finished ones are freed here
+    collect(textures);
+    collect(models);
+}
+
+size_t AssetRegistry::getTextureCount() const {
+    std::lock_guard lock(mutex);
+    return textures.live;
+}
+
+size_t AssetRegistry::getModelCount() const {
+    std::lock_guard lock(mutex);
+    return models.live;
+}
+
+size_t AssetRegistry::getReloadCount() const {
+    std::lock_guard lock(mutex);
+    return reloads;
+}
@@ -0,0 +1,126 @@
+#ifndef STAR_ASSETREGISTRY_HPP
+#define STAR_ASSETREGISTRY_HPP
+
+#include "AssetStreamer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// slot index plus the slot's generation when the handle was issued; once the asset is released
+// the generation moves on and the old handle no longer resolves
+template<typename T>
+struct AssetHandle {
+    uint32_t index{~0u};
+    uint32_t generation{0};
+
+    [[nodiscard]] bool valid() const {
+        return index != ~0u;
+    }
+
+    bool operator==(const AssetHandle&) const = default;
+};
+
+using TextureHandle = AssetHandle<Texture>;
+using ModelHandle = AssetHandle<std::vector<Mesh>>;
+
+// owns every streamed asset by path: acquiring a path that is already loaded (or loading) hands out
+// the same asset and bumps its reference count, the last release frees it. resident assets are
+// tracked by the screen's ResidencyManager; when it evicts one the slot falls back to the placeholder
+// and streams the asset in again from disk the next time it is fetched
+class AssetRegistry {
+public:
+    static AssetRegistry& getInstance();
+
+    ~AssetRegistry() = default;
+
+    AssetRegistry(AssetRegistry const&) = delete;
+    void operator=(AssetRegistry const&) = delete;
+
+    TextureHandle acquireTexture(const std::string& fn);
+    // the options and retention are part of the key, differently processed imports never share
+    ModelHandle acquireModel(const std::string& fn, const ModelLoadOptions& options = {},
+                             CpuRetention retention = CpuRetention::Release);
+
+    void retain(TextureHandle handle);
+    void retain(ModelHandle handle);
+    void release(TextureHandle handle);
+    void release(ModelHandle handle);
+
+    // placeholder while streaming, throws on a stale handle; counts as a use for the residency lru
+    // and brings an evicted asset back, so fetch every frame the asset is drawn and don't hold on to
+    // the returned reference past the frame
+    [[nodiscard]] const Texture& get(TextureHandle handle);
+    [[nodiscard]] const std::vector<Mesh>& get(ModelHandle handle);
+    [[nodiscard]] bool isResident(TextureHandle handle) const;
+    [[nodiscard]] bool isResident(ModelHandle handle) const;
+
+    // render thread, once per frame: runs the streamer, frees released assets whose loads finished
+    // and evicts the coldest assets while the device local heaps are over budget
+    void update();
+    // before AssetStreamer::destroy, drops every asset regardless of its references
+    void destroy();
+
+    [[nodiscard]] size_t getTextureCount() const;
+    [[nodiscard]] size_t getModelCount() const;
+    [[nodiscard]] size_t getReloadCount() const;
+
+private:
+    AssetRegistry() = default;
+
+    template<typename T>
+    struct Slot {
+        std::string key;
+        std::shared_ptr<Streamed<T>> asset;
+        // starts a fresh load, kept around to bring the asset back after an eviction
+        std::function<std::shared_ptr<Streamed<T>>()> load;
+        uint32_t generation{0};
+        uint32_t refs{0};
+        bool tracked{false};
+        bool evicted{false};
+    };
+
+    template<typename T>
+    struct Pool {
+        // residency ids are idBase | slot index
+        uint64_t idBase{0};
+        std::vector<Slot<T>> slots;
+        std::vector<uint32_t> freeSlots;
+        std::unordered_map<std::string, uint32_t> byKey;
+        // released but possibly still loading, freed by update()
+        std::vector<std::shared_ptr<Streamed<T>>> retired;
+        size_t live{0};
+    };
+
+    template<typename T>
+    AssetHandle<T> acquire(Pool<T>& pool, const std::string& key, std::function<std::shared_ptr<Streamed<T>>()> load);
+    template<typename T>
+    void retain(Pool<T>& pool, AssetHandle<T> handle);
+    template<typename T>
+    void release(Pool<T>& pool, AssetHandle<T> handle);
+    template<typename T>
+    const Slot<T>& resolve(const Pool<T>& pool, AssetHandle<T> handle) const;
+    template<typename T>
+    const T& use(Pool<T>& pool, AssetHandle<T> handle);
+    template<typename T>
+    void trackResident(Pool<T>& pool, uint64_t frame);
+    template<typename T>
+    void evict(Pool<T>& pool, uint32_t index);
+    template<typename T>
+    void releaseAll(Pool<T>& pool);
+    template<typename T>
+    void collect(Pool<T>& pool);
+
+    Pool<Texture> textures{.idBase = 0};
+    Pool<std::vector<Mesh>> models{.idBase = 1ull << 32};
+    size_t reloads{0};
+    mutable std::mutex mutex;
+};
+
+
+#endif //STAR_ASSETREGISTRY_HPP
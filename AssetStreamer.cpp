@@ -0,0 +1,179 @@
+#include "AssetStreamer.hpp"
+#include "JobSystem.hpp"
+
+#include <iostream>
+
+// without workers a submitted job would never run, the caller takes the hitch instead
+static void runJob(std::function<void()> job) {
+    if (JobSystem::getInstance().getNumWorkers() == 0) {
+        job();
+    } else {
+        JobSystem::getInstance().submit(std::move(job));
+    }
+}
+
+AssetStreamer &AssetStreamer::getInstance() {
+    static AssetStreamer streamer;
+
+    return streamer;
+}
+
+void AssetStreamer::init() {
+    // flat grey until the real texture arrives
+    ImageData grey{};
+    grey.width = 1;
+    grey.height = 1;
+    grey.pixels = {std::byte{128}, std::byte{128}, std::byte{128}, std::byte{255}};
+    placeholderTexture.create(grey);
+}
+
+void AssetStreamer::destroy() {
+    while (pending.load() > 0) {
+        {
+            std::unique_lock lock(mutex);
+            decodedCv.wait(lock, [&]() { return !decoded.empty(); });
+        }
+        update();
+    }
+
+    std::lock_guard lock(mutex);
+    for (auto& texture : textures) {
+        if (texture->isResident()) {
+            texture->asset->destroy();
+        }
+    }
+    for (auto& model : models) {
+        if (model->isResident()) {
+            for (auto& mesh : *model->asset) {
+                mesh.destroy();
+            }
+        }
+    }
+    textures.clear();
+    models.clear();
+
+    if (placeholderTexture.getImageView() != VK_NULL_HANDLE) {
+        placeholderTexture.destroy();
+    }
+}
+
+std::shared_ptr<Streamed<Texture>> AssetStreamer::loadTexture(const std::string &fn) {
+    auto asset = std::make_shared<Streamed<Texture>>(&placeholderTexture);
+    {
+        std::lock_guard lock(mutex);
+        textures.push_back(asset);
+    }
+
+    ++pending;
+    runJob([this, asset, fn]() {
+        try {
+            auto image = std::make_shared<ImageData>(Texture::decode(fn));
+            finish([asset, image]() {
+                try {
+                    Texture texture;
+                    texture.create(*image);
+                    asset->publish(std::move(texture));
+                } catch (...) {
+                    asset->fail(std::current_exception());
+                    throw;
+                }
+            });
+        } catch (...) {
+            finish([asset, error = std::current_exception()]() {
+                asset->fail(error);
+                std::rethrow_exception(error);
+            });
+        }
+    });
+
+    return asset;
+}
+
+std::shared_ptr<Streamed<std::vector<Mesh>>> AssetStreamer::loadModel(const std::string &fn, const ModelLoadOptions &options,
+                                                                      CpuRetention retention) {
+    auto asset = std::make_shared<Streamed<std::vector<Mesh>>>(&placeholderModel);
+    {
+        std::lock_guard lock(mutex);
+        models.push_back(asset);
+    }
+
+    ++pending;
+    runJob([this, asset, fn, options, retention]() {
+        try {
+            auto meshes = std::make_shared<std::vector<Mesh>>(ModelLoader::getInstance().load(fn, options));
+            finish([asset, meshes, retention]() {
+                try {
+                    for (auto& mesh : *meshes) {
+                        mesh.createBuffers();
+                        mesh.upload();
+                        if (retention == CpuRetention::Release) {
+                            mesh.releaseCpuData();
+                        }
+                    }
+                    asset->publish(std::move(*meshes));
+                } catch (...) {
+                    asset->fail(std::current_exception());
+                    throw;
+                }
+            });
+        } catch (...) {
+            finish([asset, error = std::current_exception()]() {
+                asset->fail(error);
+                std::rethrow_exception(error);
+            });
+        }
+    });
+
+    return asset;
+}
+
+void AssetStreamer::unload(const std::shared_ptr<Streamed<Texture>> &asset) {
+    std::lock_guard lock(mutex);
+    std::erase(textures, asset);
+    if (asset->isResident()) {
+        asset->asset->destroy();
+        asset->retire(&placeholderTexture);
+    }
+}
+
+void AssetStreamer::unload(const std::shared_ptr<Streamed<std::vector<Mesh>>> &asset) {
+    std::lock_guard lock(mutex);
+    std::erase(models, asset);
+    if (asset->isResident()) {
+        for (auto& mesh : *asset->asset) {
+            mesh.destroy();
+        }
+        asset->retire(&placeholderModel);
+    }
+}
+
+void AssetStreamer::finish(std::function<void()> upload) {
+    {
+        std::lock_guard lock(mutex);
+        decoded.push_back(std::move(upload));
+    }
+    decodedCv.notify_all();
+}
+
+void AssetStreamer::update() {
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard lock(mutex);
+        ready.swap(decoded);
+    }
+
+    // uploads only record into the upload engine; the next frame flushes them ahead of its draws,
+    // so publishing right away is safe
+    for (auto& upload : ready) {
+        try {
+            upload();
+        } catch (const std::exception& e) {
+            std::cout << "warning: streaming failed: " << e.what() << std::endl;
+        }
+        --pending;
+    }
+}
+
+size_t AssetStreamer::getPending() const {
+    return pending.load();
+}
@@ -0,0 +1,123 @@
+#ifndef STAR_ASSETSTREAMER_HPP
+#define STAR_ASSETSTREAMER_HPP
+
+#include "Mesh.hpp"
+#include "ModelLoader.hpp"
+#include "Texture.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// an asset that is usable right away: get() returns a placeholder until the real asset is resident,
+// then switches over atomically. ready() completes at the switch, or rethrows if the load failed
+template<typename T>
+class Streamed {
+public:
+    explicit Streamed(const T* placeholder) : active(placeholder), readyFuture(promise.get_future().share()) {}
+
+    Streamed(Streamed const&) = delete;
+    void operator=(Streamed const&) = delete;
+
+    [[nodiscard]] const T& get() const {
+        return *active.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] bool isResident() const {
+        return resident.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] std::shared_future<void> ready() const {
+        return readyFuture;
+    }
+
+private:
+    friend class AssetStreamer;
+
+    void publish(T&& value) {
+        asset = std::make_unique<T>(std::move(value));
+        active.store(asset.get(), std::memory_order_release);
+        resident.store(true, std::memory_order_release);
+        promise.set_value();
+    }
+
+    void fail(std::exception_ptr error) {
+        promise.set_exception(std::move(error));
+    }
+
+    // back to the placeholder once the gpu side has been freed
+    void retire(const T* placeholder) {
+        active.store(placeholder, std::memory_order_release);
+        resident.store(false, std::memory_order_release);
+        asset.reset();
+    }
+
+    std::unique_ptr<T> asset;
+    std::atomic<const T*> active;
+    std::atomic<bool> resident{false};
+    std::promise<void> promise;
+    std::shared_future<void> readyFuture;
+};
+
+// whether streamed meshes keep their vertex and index arrays after the upload; pixels are never kept
+enum class CpuRetention {
+    Release,
+    Keep,
+};
+
+// decodes and imports assets on the job system; finished decodes are handed to the render thread,
+// which creates the gpu resources through the upload engine and swaps them in without waiting
+class AssetStreamer {
+public:
+    static AssetStreamer& getInstance();
+
+    ~AssetStreamer() = default;
+
+    AssetStreamer(AssetStreamer const&) = delete;
+    void operator=(AssetStreamer const&) = delete;
+
+    // after Screen::create, builds the placeholders
+    void init();
+    // before Screen::destroy, waits for outstanding loads and frees everything streamed in
+    void destroy();
+
+    std::shared_ptr<Streamed<Texture>> loadTexture(const std::string& fn);
+    // placeholder is an empty mesh list
+    std::shared_ptr<Streamed<std::vector<Mesh>>> loadModel(const std::string& fn, const ModelLoadOptions& options = {},
+                                                           CpuRetention retention = CpuRetention::Release);
+
+    // frees a streamed asset, its load must have finished (ready() is no longer pending)
+    void unload(const std::shared_ptr<Streamed<Texture>>& asset);
+    void unload(const std::shared_ptr<Streamed<std::vector<Mesh>>>& asset);
+
+    // render thread, once per frame before drawing: uploads and publishes finished decodes
+    void update();
+
+    [[nodiscard]] size_t getPending() const;
+
+private:
+    AssetStreamer() = default;
+
+    void finish(std::function<void()> upload);
+
+    Texture placeholderTexture;
+    std::vector<Mesh> placeholderModel;
+    std::vector<std::shared_ptr<Streamed<Texture>>> textures;
+    std::vector<std::shared_ptr<Streamed<std::vector<Mesh>>>> models;
+
+    std::deque<std::function<void()>> decoded;
+    std::atomic<size_t> pending{0};
+    mutable std::mutex mutex;
+    std::condition_variable decodedCv;
+};
+
+
+#endif //STAR_ASSETSTREAMER_HPP
@@ -0,0 +1,41 @@
+#include "AtomicFile.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+bool writeFileAtomic(const std::string &path, const std::string &what, const std::function<void(std::ostream&)>& write) {
+    std::error_code ec;
+    const auto parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    std::ostringstream tmpName;
+    tmpName << path << '.' << getpid() << '-' << std::hash<std::thread::id>{}(std::this_thread::get_id()) << ".tmp";
+    const auto tmpPath = tmpName.str();
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (out) {
+            write(out);
+        }
+        if (!out) {
+            std::cout << "warning: cannot write " << what << " " << path << std::endl;
+            out.close();
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cout << "warning: cannot write " << what << " " << path << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
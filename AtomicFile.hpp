@@ -0,0 +1,15 @@
+#ifndef STAR_ATOMICFILE_HPP
+#define STAR_ATOMICFILE_HPP
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+// writes path through a temp file and a rename so a crash never leaves a truncated file behind.
+// the temp file is unique per process and thread, concurrent writers of one path each leave a
+// whole file and the last rename wins. missing parent directories are created; failures print a
+// warning naming what and return false
+bool writeFileAtomic(const std::string& path, const std::string& what, const std::function<void(std::ostream&)>& write);
+
+
+#endif //STAR_ATOMICFILE_HPP
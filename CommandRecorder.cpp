@@ -0,0 +1,87 @@
+#include "CommandRecorder.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+void CommandRecorder::init(VkDevice dev, uint32_t queueFamily, uint32_t frameCount, uint32_t slots) {
+    device = dev;
+    slotCount = slots;
+
+    // transient: the buffers are rewritten every frame and only ever reset through their pool
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    frames.resize(frameCount);
+    for (auto& frame : frames) {
+        frame.resize(slotCount);
+        for (auto& slot : frame) {
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &slot.pool) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create recording command pool");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = slot.pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &slot.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("cannot alloc secondary command buffer");
+            }
+        }
+    }
+}
+
+void CommandRecorder::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (auto& frame : frames) {
+        for (auto& slot : frame) {
+            vkDestroyCommandPool(device, slot.pool, nullptr);
+        }
+    }
+    frames.clear();
+    device = VK_NULL_HANDLE;
+}
+
+void CommandRecorder::reset(uint32_t frame) {
+    assert(frame < frames.size());
+    for (auto& slot : frames[frame]) {
+        vkResetCommandPool(device, slot.pool, 0);
+    }
+}
+
+VkCommandBuffer CommandRecorder::begin(uint32_t frame, uint32_t slot, VkRenderPass pass, VkFramebuffer framebuffer) {
+    assert(frame < frames.size());
+    assert(slot < slotCount);
+
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = pass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    VkCommandBuffer cb = frames[frame][slot].buffer;
+    if (vkBeginCommandBuffer(cb, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin secondary command buffer");
+    }
+    return cb;
+}
+
+void CommandRecorder::end(VkCommandBuffer cb) {
+    if (vkEndCommandBuffer(cb) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record secondary command buffer");
+    }
+}
+
+uint32_t CommandRecorder::getSlotCount() const {
+    return slotCount;
+}
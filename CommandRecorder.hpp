@@ -0,0 +1,47 @@
+#ifndef STAR_COMMANDRECORDER_HPP
+#define STAR_COMMANDRECORDER_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// secondary command buffers for recording a render pass from several threads at once. every
+// frame has one command pool per slot; a slot is only ever recorded by one thread at a time, so
+// the pools need no locking no matter which worker picks the slot up
+class CommandRecorder {
+public:
+    CommandRecorder() = default;
+
+    ~CommandRecorder() {
+        destroy();
+    }
+
+    CommandRecorder(CommandRecorder const&) = delete;
+    void operator=(CommandRecorder const&) = delete;
+
+    void init(VkDevice dev, uint32_t queueFamily, uint32_t frames, uint32_t slots);
+    void destroy();
+
+    // once the frame's fence has passed, recycles every slot's buffer in one go
+    void reset(uint32_t frame);
+    // the slot's buffer, begun to continue subpass 0 of pass inside framebuffer; nothing is
+    // inherited from the primary, dynamic state and bindings start out empty
+    VkCommandBuffer begin(uint32_t frame, uint32_t slot, VkRenderPass pass, VkFramebuffer framebuffer);
+    void end(VkCommandBuffer cb);
+
+    [[nodiscard]] uint32_t getSlotCount() const;
+
+private:
+    struct Slot {
+        VkCommandPool pool{VK_NULL_HANDLE};
+        VkCommandBuffer buffer{VK_NULL_HANDLE};
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    uint32_t slotCount{0};
+    std::vector<std::vector<Slot>> frames;
+};
+
+
+#endif //STAR_COMMANDRECORDER_HPP
@@ -0,0 +1,235 @@
+#include "DepthPyramid.hpp"
+#include "Screen.hpp"
+#include "Shader.hpp"
+#include "ShaderReflection.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+#include "shaders/build/depth_reduce.comp.spv.inl"
+
+// push constant block of depth_reduce.comp
+struct ReduceConstants {
+    uint32_t srcWidth;
+    uint32_t srcHeight;
+    uint32_t dstWidth;
+    uint32_t dstHeight;
+};
+
+static VkExtent2D levelExtent(VkExtent2D extent, uint32_t level) {
+    return {std::max(1u, extent.width >> level), std::max(1u, extent.height >> level)};
+}
+
+void DepthPyramid::init(VkDevice dev) {
+    device = dev;
+
+    const std::span<const uint32_t> code = depth_reduce_comp;
+    const ShaderReflection reflection(code);
+    auto& layoutCache = Screen::getInstance().getLayoutCache();
+    const auto bindings = reflection.getSet(0);
+    setLayout = layoutCache.getSetLayout(bindings);
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_LEVELS};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_LEVELS};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_LEVELS;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid descriptor pool");
+    }
+
+    const auto pushConstantRanges = reflection.getPushConstantRanges();
+    pipelineLayout = layoutCache.getPipelineLayout(std::span(&setLayout, 1), pushConstantRanges);
+
+    VkShaderModule module = Shader::createShaderModule(device, code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    const VkResult result = Screen::getInstance().getPipelineCache().createComputePipeline(pipelineInfo, &pipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid pipeline");
+    }
+
+    // point sampling only, the reduction already made every texel conservative
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create depth pyramid sampler");
+    }
+}
+
+void DepthPyramid::destroy() {
+    if (!device) {
+        return;
+    }
+
+    releaseViews();
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::releaseViews() {
+    for (const auto levelView : levelViews) {
+        vkDestroyImageView(device, levelView, nullptr);
+    }
+    levelViews.clear();
+    vkResetDescriptorPool(device, pool, 0);
+    sets.clear();
+    image = VK_NULL_HANDLE;
+    view = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::resize(VkImageView depthView, VkExtent2D size) {
+    assert(device);
+    releaseViews();
+
+    extent = size;
+    source = depthView;
+
+    // level 0 matches the depth attachment so the first step is a plain copy
+    levels = 1;
+    while (levels < MAX_LEVELS && (extent.width >> levels) + (extent.height >> levels) > 0) {
+        ++levels;
+    }
+}
+
+FrameImageDesc DepthPyramid::getImageDesc() const {
+    assert(levels > 0);
+    return {VK_FORMAT_R32_SFLOAT, extent, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, levels};
+}
+
+void DepthPyramid::setImage(VkImage pyramidImage, VkImageView pyramidView) {
+    assert(device && levels > 0);
+    releaseViews();
+    image = pyramidImage;
+    view = pyramidView;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+
+    levelViews.resize(levels);
+    for (uint32_t l = 0; l < levels; ++l) {
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, l, 1, 0, 1};
+        if (vkCreateImageView(device, &viewInfo, nullptr, &levelViews[l]) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create depth pyramid level view");
+        }
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(levels, setLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = levels;
+    allocInfo.pSetLayouts = layouts.data();
+    sets.resize(levels);
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("cannot allocate depth pyramid descriptor sets");
+    }
+
+    for (uint32_t l = 0; l < levels; ++l) {
+        VkDescriptorImageInfo srcInfo{};
+        srcInfo.sampler = sampler;
+        srcInfo.imageView = l == 0 ? source : levelViews[l - 1];
+        srcInfo.imageLayout = l == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo dstInfo{};
+        dstInfo.imageView = levelViews[l];
+        dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = sets[l];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &srcInfo;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = sets[l];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &dstInfo;
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+bool DepthPyramid::matches(VkImageView depthView, VkExtent2D size) const {
+    return source == depthView && extent.width == size.width && extent.height == size.height;
+}
+
+void DepthPyramid::build(VkCommandBuffer cb) {
+    assert(image);
+
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    for (uint32_t l = 0; l < levels; ++l) {
+        const VkExtent2D src = l == 0 ? extent : levelExtent(extent, l - 1);
+        const VkExtent2D dst = levelExtent(extent, l);
+        const ReduceConstants constants{src.width, src.height, dst.width, dst.height};
+
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &sets[l], 0, nullptr);
+        vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(cb, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+        // the next step reads this level; after the last one the frame graph orders the readers
+        if (l + 1 == levels) {
+            break;
+        }
+        VkImageMemoryBarrier levelBarrier{};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        levelBarrier.image = image;
+        levelBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, l, 1, 0, 1};
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &levelBarrier);
+    }
+}
+
+VkImageView DepthPyramid::getView() const {
+    return view;
+}
+
+VkImage DepthPyramid::getImage() const {
+    return image;
+}
+
+VkSampler DepthPyramid::getSampler() const {
+    return sampler;
+}
+
+VkExtent2D DepthPyramid::getExtent() const {
+    return extent;
+}
+
+uint32_t DepthPyramid::getLevelCount() const {
+    return levels;
+}
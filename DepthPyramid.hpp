@@ -0,0 +1,73 @@
+#ifndef STAR_DEPTHPYRAMID_HPP
+#define STAR_DEPTHPYRAMID_HPP
+
+#include "FrameGraph.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// hierarchical z: a full mip chain over the depth attachment where every texel holds the farthest
+// depth of the area it covers, built by a compute reduction once the depth pass is done. only the
+// late culling phase of the same frame reads it, so the image is a frame graph transient
+class DepthPyramid {
+public:
+    static constexpr uint32_t MAX_LEVELS = 16;
+
+    DepthPyramid() = default;
+
+    ~DepthPyramid() {
+        destroy();
+    }
+
+    DepthPyramid(DepthPyramid const&) = delete;
+    void operator=(DepthPyramid const&) = delete;
+
+    void init(VkDevice dev);
+    void destroy();
+
+    // sizes the chain for a depth attachment and drops the views of the previous image, the
+    // pyramid must not be in use. the graph's transient is created from getImageDesc afterwards
+    void resize(VkImageView depthView, VkExtent2D extent);
+    [[nodiscard]] bool matches(VkImageView depthView, VkExtent2D extent) const;
+    [[nodiscard]] FrameImageDesc getImageDesc() const;
+    // the transient placed by the frame graph, after every compile
+    void setImage(VkImage image, VkImageView view);
+
+    // outside a render pass with depth in DEPTH_STENCIL_READ_ONLY_OPTIMAL and the pyramid in
+    // GENERAL, which the frame graph takes care of: reduces every level from the one above
+    void build(VkCommandBuffer cb);
+
+    // every level, for textureLod with getSampler()
+    [[nodiscard]] VkImageView getView() const;
+    [[nodiscard]] VkImage getImage() const;
+    [[nodiscard]] VkSampler getSampler() const;
+    [[nodiscard]] VkExtent2D getExtent() const;
+    [[nodiscard]] uint32_t getLevelCount() const;
+
+private:
+    void releaseViews();
+
+    VkDevice device{VK_NULL_HANDLE};
+    // both layouts belong to Screen's layout cache
+    VkDescriptorSetLayout setLayout{VK_NULL_HANDLE};
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+    VkPipeline pipeline{VK_NULL_HANDLE};
+    VkSampler sampler{VK_NULL_HANDLE};
+
+    // both belong to the frame graph
+    VkImage image{VK_NULL_HANDLE};
+    VkImageView view{VK_NULL_HANDLE};
+    // one single level view and one set per reduction step
+    std::vector<VkImageView> levelViews;
+    std::vector<VkDescriptorSet> sets;
+    uint32_t levels{0};
+    VkExtent2D extent{0, 0};
+
+    VkImageView source{VK_NULL_HANDLE};
+};
+
+
+#endif //STAR_DEPTHPYRAMID_HPP
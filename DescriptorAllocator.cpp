@@ -0,0 +1,114 @@
+#include "DescriptorAllocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+void DescriptorAllocator::init(VkDevice dev, uint32_t firstPoolSets, std::span<const PoolRatio> poolRatios) {
+    device = dev;
+    ratios.assign(poolRatios.begin(), poolRatios.end());
+    setsPerPool = std::clamp(firstPoolSets, 1u, MAX_SETS_PER_POOL);
+    current = grabPool();
+}
+
+void DescriptorAllocator::destroy() {
+    if (!device) {
+        return;
+    }
+
+    vkDestroyDescriptorPool(device, current, nullptr);
+    for (const auto pool : full) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    for (const auto pool : ready) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    current = VK_NULL_HANDLE;
+    full.clear();
+    ready.clear();
+    freeSets.clear();
+    allocated = 0;
+    device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+    if (auto it = freeSets.find(layout); it != freeSets.end() && !it->second.empty()) {
+        const VkDescriptorSet set = it->second.back();
+        it->second.pop_back();
+        ++allocated;
+        return set;
+    }
+
+    VkDescriptorSetAllocateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    info.descriptorSetCount = 1;
+    info.pSetLayouts = &layout;
+
+    VkDescriptorSet set{VK_NULL_HANDLE};
+    info.descriptorPool = current;
+    VkResult result = vkAllocateDescriptorSets(device, &info, &set);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // the pool stays alive for the sets it already holds, the next one takes over
+        full.push_back(current);
+        current = grabPool();
+        info.descriptorPool = current;
+        result = vkAllocateDescriptorSets(device, &info, &set);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("cannot allocate descriptor set");
+    }
+
+    ++allocated;
+    return set;
+}
+
+void DescriptorAllocator::free(VkDescriptorSetLayout layout, VkDescriptorSet set) {
+    freeSets[layout].push_back(set);
+    --allocated;
+}
+
+void DescriptorAllocator::reset() {
+    vkResetDescriptorPool(device, current, 0);
+    for (const auto pool : full) {
+        vkResetDescriptorPool(device, pool, 0);
+        ready.push_back(pool);
+    }
+    full.clear();
+    freeSets.clear();
+    allocated = 0;
+}
+
+size_t DescriptorAllocator::getPoolCount() const {
+    return 1 + full.size() + ready.size();
+}
+
+uint32_t DescriptorAllocator::getAllocated() const {
+    return allocated;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool() {
+    if (!ready.empty()) {
+        const VkDescriptorPool pool = ready.back();
+        ready.pop_back();
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> sizes;
+    sizes.reserve(ratios.size());
+    for (const auto& [type, ratio] : ratios) {
+        sizes.push_back({type, std::max(1u, static_cast<uint32_t>(ratio * static_cast<float>(setsPerPool)))});
+    }
+
+    VkDescriptorPoolCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    info.maxSets = setsPerPool;
+    info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+    info.pPoolSizes = sizes.data();
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(device, &info, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create descriptor pool");
+    }
+
+    setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+    return pool;
+}
@@ -0,0 +1,62 @@
+#ifndef STAR_DESCRIPTORALLOCATOR_HPP
+#define STAR_DESCRIPTORALLOCATOR_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// descriptor sets out of a chain of pools: when the current pool runs dry another one twice its
+// size is put in front, up to MAX_SETS_PER_POOL. sets handed back with free are kept per layout and
+// handed out again, reset recycles every pool at once
+class DescriptorAllocator {
+public:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    // descriptors of a type every pool holds per set it can allocate
+    struct PoolRatio {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    DescriptorAllocator() = default;
+
+    ~DescriptorAllocator() {
+        destroy();
+    }
+
+    DescriptorAllocator(DescriptorAllocator const&) = delete;
+    void operator=(DescriptorAllocator const&) = delete;
+
+    void init(VkDevice dev, uint32_t firstPoolSets, std::span<const PoolRatio> poolRatios);
+    void destroy();
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+    // only once the gpu is done with the set, it may be rewritten by whoever allocates it next
+    void free(VkDescriptorSetLayout layout, VkDescriptorSet set);
+    // every set allocated so far becomes invalid, the pools are kept for the next round
+    void reset();
+
+    [[nodiscard]] size_t getPoolCount() const;
+    // sets currently handed out
+    [[nodiscard]] uint32_t getAllocated() const;
+
+private:
+    VkDescriptorPool grabPool();
+
+    VkDevice device{VK_NULL_HANDLE};
+    std::vector<PoolRatio> ratios;
+    uint32_t setsPerPool{0};
+    VkDescriptorPool current{VK_NULL_HANDLE};
+    // ran out at least once since the last reset
+    std::vector<VkDescriptorPool> full;
+    // reset and waiting to become current again
+    std::vector<VkDescriptorPool> ready;
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> freeSets;
+    uint32_t allocated{0};
+};
+
+
+#endif //STAR_DESCRIPTORALLOCATOR_HPP
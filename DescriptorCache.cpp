@@ -0,0 +1,178 @@
+#include "DescriptorCache.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t PERSISTENT_SETS = 64;
+    constexpr uint32_t TRANSIENT_SETS = 32;
+
+    // per set, roughly what the material, culling and pyramid layouts ask for
+    constexpr std::array<DescriptorAllocator::PoolRatio, 5> POOL_RATIOS = {{
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+    }};
+
+    template<typename T>
+    T readAt(const std::byte* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    template<typename Handle>
+    uint64_t handleWord(Handle handle) {
+        return reinterpret_cast<uint64_t>(handle);
+    }
+}
+
+void DescriptorCache::init(VkDevice dev, uint32_t framesInFlight) {
+    device = dev;
+    persistent.init(device, PERSISTENT_SETS, POOL_RATIOS);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        transient.emplace_back().init(device, TRANSIENT_SETS, POOL_RATIOS);
+    }
+}
+
+void DescriptorCache::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (const auto& [handle, tmpl] : templates) {
+        vkDestroyDescriptorUpdateTemplate(device, handle, nullptr);
+    }
+    templates.clear();
+    lookup.clear();
+    cached.clear();
+    retired.clear();
+    transient.clear();
+    persistent.destroy();
+    device = VK_NULL_HANDLE;
+}
+
+VkDescriptorUpdateTemplate DescriptorCache::createTemplate(VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries) {
+    VkDescriptorUpdateTemplateCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    info.pDescriptorUpdateEntries = entries.data();
+    info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    info.descriptorSetLayout = layout;
+
+    VkDescriptorUpdateTemplate handle;
+    if (vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &handle) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create descriptor update template");
+    }
+
+    templates.emplace(handle, Template{layout, std::vector(entries.begin(), entries.end())});
+    return handle;
+}
+
+VkDescriptorSet DescriptorCache::acquire(VkDescriptorUpdateTemplate updateTemplate, const void* data) {
+    const auto it = templates.find(updateTemplate);
+    if (it == templates.end()) {
+        throw std::runtime_error("unknown descriptor update template");
+    }
+    const Template& tmpl = it->second;
+
+    auto key = makeKey(updateTemplate, tmpl, static_cast<const std::byte*>(data));
+    if (const auto found = lookup.find(key); found != lookup.end()) {
+        ++cached.at(found->second).refs;
+        ++hits;
+        return found->second;
+    }
+
+    const VkDescriptorSet set = persistent.allocate(tmpl.layout);
+    vkUpdateDescriptorSetWithTemplate(device, set, updateTemplate, data);
+    lookup.emplace(key, set);
+    cached.emplace(set, Cached{std::move(key), tmpl.layout, 1});
+    return set;
+}
+
+void DescriptorCache::release(VkDescriptorSet set) {
+    const auto it = cached.find(set);
+    assert(it != cached.end());
+    if (--it->second.refs > 0) {
+        return;
+    }
+
+    // whatever the set points at may be destroyed right after this, it must not be found again
+    lookup.erase(it->second.key);
+    retired.push_back({set, it->second.layout, frameCount});
+    cached.erase(it);
+}
+
+VkDescriptorSet DescriptorCache::allocate(VkDescriptorSetLayout layout) {
+    return persistent.allocate(layout);
+}
+
+void DescriptorCache::free(VkDescriptorSetLayout layout, VkDescriptorSet set) {
+    retired.push_back({set, layout, frameCount});
+}
+
+VkDescriptorSet DescriptorCache::allocateTransient(uint32_t frame, VkDescriptorSetLayout layout) {
+    assert(frame < transient.size());
+    return transient[frame].allocate(layout);
+}
+
+void DescriptorCache::beginFrame(uint32_t frame) {
+    assert(frame < transient.size());
+    transient[frame].reset();
+
+    ++frameCount;
+    while (!retired.empty() && retired.front().frame + transient.size() <= frameCount) {
+        persistent.free(retired.front().layout, retired.front().set);
+        retired.pop_front();
+    }
+}
+
+size_t DescriptorCache::getCachedCount() const {
+    return cached.size();
+}
+
+uint32_t DescriptorCache::getHits() const {
+    return hits;
+}
+
+size_t DescriptorCache::getPoolCount() const {
+    size_t count = persistent.getPoolCount();
+    for (const auto& allocator : transient) {
+        count += allocator.getPoolCount();
+    }
+    return count;
+}
+
+std::vector<uint64_t> DescriptorCache::makeKey(VkDescriptorUpdateTemplate updateTemplate, const Template& tmpl, const std::byte* data) {
+    // read field by field, padding in the caller's struct never reaches the key
+    std::vector<uint64_t> key{handleWord(updateTemplate)};
+    for (const auto& entry : tmpl.entries) {
+        for (uint32_t i = 0; i < entry.descriptorCount; ++i) {
+            const std::byte* at = data + entry.offset + i * entry.stride;
+            switch (entry.descriptorType) {
+                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+                case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+                case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: {
+                    const auto info = readAt<VkDescriptorBufferInfo>(at);
+                    key.insert(key.end(), {handleWord(info.buffer), info.offset, info.range});
+                    break;
+                }
+                case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+                case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                    key.push_back(handleWord(readAt<VkBufferView>(at)));
+                    break;
+                default: {
+                    const auto info = readAt<VkDescriptorImageInfo>(at);
+                    key.insert(key.end(), {handleWord(info.sampler), handleWord(info.imageView), static_cast<uint64_t>(info.imageLayout)});
+                    break;
+                }
+            }
+        }
+    }
+    return key;
+}
@@ -0,0 +1,92 @@
+#ifndef STAR_DESCRIPTORCACHE_HPP
+#define STAR_DESCRIPTORCACHE_HPP
+
+#include "DescriptorAllocator.hpp"
+#include "Hash.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// long lived descriptor sets written through update templates and shared: acquiring a set with the
+// same template and the same buffers, views and samplers as one already in use returns that set.
+// released sets stop being shared at once and are recycled once every frame in flight has passed,
+// so a handle reused by a new buffer or view never finds a stale set. also owns a pool chain per
+// frame in flight for sets that only live for one frame
+class DescriptorCache {
+public:
+    DescriptorCache() = default;
+
+    ~DescriptorCache() {
+        destroy();
+    }
+
+    DescriptorCache(DescriptorCache const&) = delete;
+    void operator=(DescriptorCache const&) = delete;
+
+    void init(VkDevice dev, uint32_t framesInFlight);
+    void destroy();
+
+    // entries read VkDescriptorBufferInfo and VkDescriptorImageInfo out of the caller's struct at
+    // their offsets; the cache owns the template
+    VkDescriptorUpdateTemplate createTemplate(VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries);
+    // data is laid out the way the template's entries say
+    VkDescriptorSet acquire(VkDescriptorUpdateTemplate updateTemplate, const void* data);
+    void release(VkDescriptorSet set);
+
+    // a set without caching or sharing, from the persistent pools; hand it back with free
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+    void free(VkDescriptorSetLayout layout, VkDescriptorSet set);
+    // a set from the frame's pools, valid until the frame slot comes around again
+    VkDescriptorSet allocateTransient(uint32_t frame, VkDescriptorSetLayout layout);
+
+    // once the frame's fence has passed: its pools are reset wholesale and sets released a full
+    // ring of frames ago go back to the persistent pools
+    void beginFrame(uint32_t frame);
+
+    // sets currently shared through the cache
+    [[nodiscard]] size_t getCachedCount() const;
+    // acquires answered with a set already in use
+    [[nodiscard]] uint32_t getHits() const;
+    [[nodiscard]] size_t getPoolCount() const;
+
+private:
+    struct Template {
+        VkDescriptorSetLayout layout;
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    };
+
+    struct Cached {
+        std::vector<uint64_t> key;
+        VkDescriptorSetLayout layout;
+        uint32_t refs;
+    };
+
+    struct Retired {
+        VkDescriptorSet set;
+        VkDescriptorSetLayout layout;
+        uint64_t frame;
+    };
+
+    // the template followed by every handle, offset, range and layout it would write
+    static std::vector<uint64_t> makeKey(VkDescriptorUpdateTemplate updateTemplate, const Template& tmpl, const std::byte* data);
+
+    VkDevice device{VK_NULL_HANDLE};
+    DescriptorAllocator persistent;
+    std::deque<DescriptorAllocator> transient;
+    std::unordered_map<VkDescriptorUpdateTemplate, Template> templates;
+    std::unordered_map<std::vector<uint64_t>, VkDescriptorSet, WordsHash> lookup;
+    std::unordered_map<VkDescriptorSet, Cached> cached;
+    std::deque<Retired> retired;
+    // beginFrame calls so far, retired sets wait for framesInFlight of them
+    uint64_t frameCount{0};
+    uint32_t hits{0};
+};
+
+
+#endif //STAR_DESCRIPTORCACHE_HPP
@@ -6,12 +6,11 @@
 #include "Screen.hpp"
 #include "UniformBufferData.hpp"
 
-#include <iostream>
+#include <cassert>
+#include <stdexcept>
 #include <vector>
 
 void DescriptorSet::create(uint32_t num, const std::vector<const Texture*>& textures) {
-    descriptorSets = Screen::getInstance().allocDescriptorSets(num);
-
     uniformBuffers.resize(num);
     uniformBufferAllocations.resize(num);
     const VkDeviceSize bufferSize = sizeof(UniformBufferData);
@@ -32,68 +31,40 @@ void DescriptorSet::create(uint32_t num, const std::vector<const Texture*>& text
         }
     }
 
+    descriptorSets.assign(num, VK_NULL_HANDLE);
+    boundViews.assign(num, VK_NULL_HANDLE);
     for (uint32_t i = 0; i < num; ++i) {
-        assert(i < uniformBuffers.size());
-        assert(i < uniformBufferAllocations.size());
-        assert(i < descriptorSets.size());
-
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferData);
-
-        std::vector<VkWriteDescriptorSet> writes;
-        writes.resize(2 + textures.size());
-
-        assert(writes.size() >= 1);
-        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writes[0].dstSet = descriptorSets[i];
-        writes[0].dstBinding = 0;
-        writes[0].dstArrayElement = 0;
-        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writes[0].descriptorCount = 1;
-        writes[0].pBufferInfo = &bufferInfo;
-
-        assert(writes.size() >= 2);
-        VkDescriptorImageInfo samplerInfo{};
-        samplerInfo.sampler = Screen::getInstance().getSampler();
-        samplerInfo.imageView = VK_NULL_HANDLE;
-        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writes[1].dstSet = descriptorSets[i];
-        writes[1].dstBinding = 1;
-        writes[1].dstArrayElement = 0;
-        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-        writes[1].descriptorCount = 1;
-        writes[1].pImageInfo = &samplerInfo;
+        setTextures(i, textures);
+    }
+}
 
-        std::vector<VkDescriptorImageInfo> infoStore;
-        infoStore.reserve(textures.size());
+void DescriptorSet::setTextures(uint32_t frame, const std::vector<const Texture *> &textures) {
+    assert(frame < descriptorSets.size());
+    if (textures.empty()) {
+        throw std::runtime_error("material without a texture");
+    }
 
-        for (size_t j = 0; j < textures.size(); ++j) {
-            assert(textures[j]);
-            if (textures[j]->getImageView() == VK_NULL_HANDLE) {
-                throw std::runtime_error("null image view");
-            }
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = textures[j]->getImageView();
-            assert(imageInfo.imageView);
-            imageInfo.sampler = nullptr;
-            infoStore.push_back(imageInfo);
+    const VkImageView view = textures.back()->getImageView();
+    if (view == VK_NULL_HANDLE) {
+        throw std::runtime_error("null image view");
+    }
+    if (view == boundViews[frame]) {
+        return;
+    }
 
-            const size_t w = j + 2;
-            assert(w < writes.size());
-            writes[w].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writes[w].dstSet = descriptorSets[i];
-            writes[w].dstBinding = 2;
-            writes[w].dstArrayElement = 0;
-            writes[w].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-            writes[w].descriptorCount = 1;
-            writes[w].pImageInfo = &infoStore[infoStore.size()-1];
-        }
+    MaterialDescriptors data{};
+    data.ubo = {uniformBuffers[frame], 0, sizeof(UniformBufferData)};
+    data.sampler = {Screen::getInstance().getSampler(), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+    data.texture = {VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL};
 
-        vkUpdateDescriptorSets(Screen::getInstance().getDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    // the old set may still be read by the frame in flight, the cache holds it back until it is done
+    auto& cache = Screen::getInstance().getDescriptorCache();
+    const VkDescriptorSet set = cache.acquire(Screen::getInstance().getMaterialTemplate(), &data);
+    if (descriptorSets[frame]) {
+        cache.release(descriptorSets[frame]);
     }
+    descriptorSets[frame] = set;
+    boundViews[frame] = view;
 }
 
 void DescriptorSet::setUniformData(uint32_t frame, UniformBufferData data) {
@@ -108,5 +79,12 @@ void DescriptorSet::destroy() {
     uniformBufferAllocations.clear();
     uniformBuffers.clear();
 
+    auto& cache = Screen::getInstance().getDescriptorCache();
+    for (const auto set : descriptorSets) {
+        if (set) {
+            cache.release(set);
+        }
+    }
     descriptorSets.clear();
+    boundViews.clear();
 }
@@ -11,6 +11,14 @@
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
+// what Screen's material update template reads to write a set 0
+struct MaterialDescriptors {
+    VkDescriptorBufferInfo ubo;
+    VkDescriptorImageInfo sampler;
+    VkDescriptorImageInfo texture;
+};
+
+// material sets, one per frame, acquired from Screen's descriptor cache and released by destroy
 class DescriptorSet {
 public:
 
@@ -21,6 +29,9 @@ public:
     }
 
     void setUniformData(uint32_t frame, UniformBufferData data);
+    // swaps the frame's set for one with the new view if it changed (e.g. a streamed texture became
+    // resident); the material set holds a single texture, the last one given
+    void setTextures(uint32_t frame, const std::vector<const Texture*>& textures);
 
     void destroy();
 
@@ -28,6 +39,7 @@ private:
     std::vector<VkBuffer> uniformBuffers;
     std::vector<VmaAllocation> uniformBufferAllocations;
     std::vector<VkDescriptorSet> descriptorSets;
+    std::vector<VkImageView> boundViews;
 };
 
 
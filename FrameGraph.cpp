@@ -0,0 +1,472 @@
+#include "FrameGraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                              VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                                              VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+void FrameGraph::init(VkDevice dev, VmaAllocator alloc) {
+    device = dev;
+    allocator = alloc;
+}
+
+void FrameGraph::destroy() {
+    if (!device) {
+        return;
+    }
+
+    reset();
+    device = VK_NULL_HANDLE;
+}
+
+void FrameGraph::reset() {
+    releaseTransients();
+    resources.clear();
+    passes.clear();
+    states.clear();
+}
+
+FrameGraph::AccessInfo FrameGraph::describe(FrameAccess access) {
+    switch (access) {
+        case FrameAccess::None:
+            return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, false};
+        case FrameAccess::ColorAttachment:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+        case FrameAccess::DepthAttachment:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+        case FrameAccess::DepthSampled:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false};
+        case FrameAccess::ShaderSampled:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+        case FrameAccess::ComputeRead:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false};
+        case FrameAccess::ComputeWrite:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, true};
+        case FrameAccess::IndirectRead:
+            return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false};
+        case FrameAccess::TransferRead:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+        case FrameAccess::TransferWrite:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+        case FrameAccess::Present:
+            // waits and signals go through the acquire and present semaphores
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false};
+    }
+    throw std::runtime_error("unknown frame graph access");
+}
+
+FrameGraph::ResourceId FrameGraph::importImage(const std::string &name, const FrameImageImport &import) {
+    Resource resource{};
+    resource.name = name;
+    resource.type = ResourceType::Imported;
+    resource.import = import;
+    resource.image = import.image;
+    resources.push_back(resource);
+    return static_cast<ResourceId>(resources.size() - 1);
+}
+
+FrameGraph::ResourceId FrameGraph::importBuffer(const std::string &name, FrameAccess initial, FrameAccess final) {
+    Resource resource{};
+    resource.name = name;
+    resource.type = ResourceType::Buffer;
+    resource.import.initial = initial;
+    resource.import.final = final;
+    resources.push_back(resource);
+    return static_cast<ResourceId>(resources.size() - 1);
+}
+
+FrameGraph::ResourceId FrameGraph::createImage(const std::string &name, const FrameImageDesc &desc) {
+    Resource resource{};
+    resource.name = name;
+    resource.type = ResourceType::Transient;
+    resource.desc = desc;
+    resources.push_back(resource);
+    return static_cast<ResourceId>(resources.size() - 1);
+}
+
+void FrameGraph::setImage(ResourceId resource, VkImage image) {
+    assert(resource < resources.size());
+    assert(resources[resource].type == ResourceType::Imported);
+    resources[resource].image = image;
+}
+
+FrameGraph::PassId FrameGraph::addPass(const std::string &name, std::function<void(VkCommandBuffer)> record) {
+    Pass pass{};
+    pass.name = name;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    return static_cast<PassId>(passes.size() - 1);
+}
+
+void FrameGraph::read(PassId pass, ResourceId resource, FrameAccess access) {
+    declare(pass, resource, access, false);
+}
+
+void FrameGraph::write(PassId pass, ResourceId resource, FrameAccess access) {
+    declare(pass, resource, access, true);
+}
+
+void FrameGraph::declare(PassId pass, ResourceId resource, FrameAccess access, bool write) {
+    assert(pass < passes.size());
+    assert(resource < resources.size());
+
+    // attachments and storage writes count as writes for ordering even when declared as reads
+    AccessInfo info = describe(access);
+    info.write = info.write || write;
+
+    auto& uses = passes[pass].uses;
+    auto it = std::find_if(uses.begin(), uses.end(), [resource](const Use& use) { return use.resource == resource; });
+    if (it == uses.end()) {
+        uses.push_back({resource, info, !write, write});
+        return;
+    }
+
+    if (isImage(resource) && it->info.layout != info.layout) {
+        throw std::runtime_error("frame graph pass " + passes[pass].name + " uses " + resources[resource].name + " in two layouts");
+    }
+    it->info.stages |= info.stages;
+    it->info.access |= info.access;
+    it->info.write = it->info.write || info.write;
+    it->reads = it->reads || !write;
+    it->writes = it->writes || write;
+}
+
+void FrameGraph::setEnabled(PassId pass, bool enabled) {
+    assert(pass < passes.size());
+    passes[pass].enabled = enabled;
+}
+
+bool FrameGraph::isImage(ResourceId resource) const {
+    return resources[resource].type != ResourceType::Buffer;
+}
+
+void FrameGraph::compile() {
+    cull();
+    placeTransients();
+}
+
+void FrameGraph::cull() {
+    // walking backwards from what outlives the graph, a pass stays if a later live pass or the
+    // outside reads something it writes
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t r = 0; r < resources.size(); ++r) {
+        needed[r] = resources[r].type != ResourceType::Transient && resources[r].import.final != FrameAccess::None;
+    }
+
+    for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass) {
+        pass->live = std::any_of(pass->uses.begin(), pass->uses.end(), [&needed](const Use& use) {
+            return use.writes && needed[use.resource];
+        });
+        if (!pass->live) {
+            continue;
+        }
+        for (const auto& use : pass->uses) {
+            if (use.reads) {
+                needed[use.resource] = true;
+            }
+        }
+    }
+}
+
+void FrameGraph::placeTransients() {
+    releaseTransients();
+
+    for (auto& resource : resources) {
+        resource.firstPass = UINT32_MAX;
+        resource.lastPass = 0;
+        resource.aliasStages = 0;
+        resource.aliasAccess = 0;
+    }
+    for (uint32_t p = 0; p < passes.size(); ++p) {
+        if (!passes[p].live) {
+            continue;
+        }
+        for (const auto& use : passes[p].uses) {
+            auto& resource = resources[use.resource];
+            resource.firstPass = std::min(resource.firstPass, p);
+            resource.lastPass = std::max(resource.lastPass, p);
+        }
+    }
+
+    std::vector<ResourceId> transients;
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    for (ResourceId r = 0; r < resources.size(); ++r) {
+        auto& resource = resources[r];
+        if (resource.type != ResourceType::Transient || resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.desc.format;
+        imageInfo.extent = {resource.desc.extent.width, resource.desc.extent.height, 1};
+        imageInfo.mipLevels = resource.desc.levels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.desc.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create transient image " + resource.name);
+        }
+        vkGetImageMemoryRequirements(device, resource.image, &requirements[r]);
+        transients.push_back(r);
+    }
+
+    // largest first, each into the first block whose tenants are all dead or not yet born while
+    // it is alive; a block grows to its largest tenant
+    std::sort(transients.begin(), transients.end(), [&requirements](ResourceId a, ResourceId b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    transientRequested = 0;
+    for (const ResourceId r : transients) {
+        const auto& req = requirements[r];
+        transientRequested += req.size;
+
+        auto block = std::find_if(blocks.begin(), blocks.end(), [&](const MemoryBlock& candidate) {
+            if ((candidate.requirements.memoryTypeBits & req.memoryTypeBits) == 0) {
+                return false;
+            }
+            return std::none_of(candidate.tenants.begin(), candidate.tenants.end(), [&](ResourceId tenant) {
+                return resources[tenant].firstPass <= resources[r].lastPass && resources[r].firstPass <= resources[tenant].lastPass;
+            });
+        });
+        if (block == blocks.end()) {
+            blocks.push_back({req, VK_NULL_HANDLE, {}});
+            block = blocks.end() - 1;
+        }
+        block->requirements.size = std::max(block->requirements.size, req.size);
+        block->requirements.alignment = std::max(block->requirements.alignment, req.alignment);
+        block->requirements.memoryTypeBits &= req.memoryTypeBits;
+        block->tenants.push_back(r);
+    }
+
+    for (auto& block : blocks) {
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (vmaAllocateMemory(allocator, &block.requirements, &allocInfo, &block.alloc, nullptr) != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate transient memory");
+        }
+
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        for (const ResourceId tenant : block.tenants) {
+            for (const auto& pass : passes) {
+                for (const auto& use : pass.uses) {
+                    if (pass.live && use.resource == tenant) {
+                        stages |= use.info.stages;
+                        access |= use.info.access & WRITE_ACCESS;
+                    }
+                }
+            }
+        }
+
+        for (const ResourceId tenant : block.tenants) {
+            auto& resource = resources[tenant];
+            resource.aliasStages = stages;
+            resource.aliasAccess = access;
+            if (vmaBindImageMemory(allocator, block.alloc, resource.image) != VK_SUCCESS) {
+                throw std::runtime_error("cannot bind transient image " + resource.name);
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.desc.format;
+            viewInfo.subresourceRange = {resource.desc.aspect, 0, resource.desc.levels, 0, 1};
+            if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+                throw std::runtime_error("cannot create transient image view " + resource.name);
+            }
+        }
+    }
+}
+
+void FrameGraph::releaseTransients() {
+    for (auto& resource : resources) {
+        if (resource.type != ResourceType::Transient) {
+            continue;
+        }
+        if (resource.view) {
+            vkDestroyImageView(device, resource.view, nullptr);
+        }
+        if (resource.image) {
+            vkDestroyImage(device, resource.image, nullptr);
+        }
+        resource.view = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+    }
+    for (auto& block : blocks) {
+        vmaFreeMemory(allocator, block.alloc);
+    }
+    blocks.clear();
+}
+
+void FrameGraph::execute(VkCommandBuffer cb) {
+    barrierCount = 0;
+    states.assign(resources.size(), {});
+    for (size_t r = 0; r < resources.size(); ++r) {
+        const auto& resource = resources[r];
+        auto& state = states[r];
+        if (resource.type == ResourceType::Transient) {
+            // contents never survive, only the memory's other users have to be waited on
+            state.writeStages = resource.aliasStages;
+            state.writeAccess = resource.aliasAccess;
+            continue;
+        }
+
+        const AccessInfo initial = describe(resource.import.initial);
+        if (initial.write) {
+            state.writeStages = initial.stages;
+            state.writeAccess = initial.access & WRITE_ACCESS;
+        } else {
+            state.readStages = initial.stages;
+            state.readAccess = initial.access;
+        }
+        state.layout = resource.import.discard ? VK_IMAGE_LAYOUT_UNDEFINED : initial.layout;
+    }
+
+    Batch batch;
+    for (const auto& pass : passes) {
+        if (!pass.live || !pass.enabled) {
+            continue;
+        }
+        for (const auto& use : pass.uses) {
+            transition(batch, use.resource, use.info);
+        }
+        flush(cb, batch);
+        pass.record(cb);
+    }
+
+    // only layouts are handed over here, the next frame's initial access orders the rest
+    for (ResourceId r = 0; r < resources.size(); ++r) {
+        const auto& resource = resources[r];
+        if (resource.type != ResourceType::Imported || resource.import.final == FrameAccess::None) {
+            continue;
+        }
+        const AccessInfo final = describe(resource.import.final);
+        if (states[r].layout != final.layout) {
+            transition(batch, r, final);
+        }
+    }
+    flush(cb, batch);
+}
+
+void FrameGraph::transition(Batch &batch, ResourceId resource, const AccessInfo &info) {
+    auto& state = states[resource];
+    const bool image = isImage(resource);
+    const bool layoutChange = image && state.layout != info.layout;
+
+    if (!info.write && !layoutChange) {
+        // readers only wait for the last write, and only once per stage and access
+        const bool unseen = (info.stages & ~state.readStages) || (info.access & ~state.readAccess);
+        if ((state.writeStages || state.writeAccess) && unseen) {
+            batch.srcStages |= state.writeStages ? state.writeStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            batch.dstStages |= info.stages;
+            batch.srcAccess |= state.writeAccess;
+            batch.dstAccess |= info.access;
+        }
+        state.readStages |= info.stages;
+        state.readAccess |= info.access;
+        return;
+    }
+
+    // writes and layout transitions wait for the last write and for every read since
+    const VkPipelineStageFlags srcStages = state.writeStages | state.readStages;
+    batch.srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    batch.dstStages |= info.stages;
+    if (image) {
+        const auto& desc = resources[resource];
+        if (!desc.image) {
+            throw std::runtime_error("frame graph image " + desc.name + " has no image");
+        }
+        const bool transient = desc.type == ResourceType::Transient;
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.dstAccessMask = info.access;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = info.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = desc.image;
+        barrier.subresourceRange = {transient ? desc.desc.aspect : desc.import.aspect, 0,
+                                    transient ? desc.desc.levels : desc.import.levels, 0, 1};
+        batch.images.push_back(barrier);
+    } else {
+        batch.srcAccess |= state.writeAccess;
+        batch.dstAccess |= info.access;
+    }
+
+    // a transition for a reader still has to be waited on by later readers at other stages
+    state.writeStages = info.stages;
+    state.writeAccess = info.write ? info.access & WRITE_ACCESS : 0;
+    state.readStages = info.write ? 0 : info.stages;
+    state.readAccess = info.write ? 0 : info.access;
+    state.layout = image ? info.layout : state.layout;
+}
+
+void FrameGraph::flush(VkCommandBuffer cb, Batch &batch) {
+    if (batch.srcStages == 0) {
+        return;
+    }
+
+    VkMemoryBarrier memory{};
+    memory.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory.srcAccessMask = batch.srcAccess;
+    memory.dstAccessMask = batch.dstAccess;
+    const uint32_t memoryCount = batch.srcAccess || batch.dstAccess ? 1 : 0;
+    vkCmdPipelineBarrier(cb, batch.srcStages, batch.dstStages, 0, memoryCount, &memory, 0, nullptr,
+                         static_cast<uint32_t>(batch.images.size()), batch.images.data());
+    ++barrierCount;
+
+    batch.srcStages = 0;
+    batch.dstStages = 0;
+    batch.srcAccess = 0;
+    batch.dstAccess = 0;
+    batch.images.clear();
+}
+
+VkImage FrameGraph::getImage(ResourceId resource) const {
+    assert(resource < resources.size());
+    return resources[resource].image;
+}
+
+VkImageView FrameGraph::getImageView(ResourceId resource) const {
+    assert(resource < resources.size());
+    return resources[resource].view;
+}
+
+bool FrameGraph::isCulled(PassId pass) const {
+    assert(pass < passes.size());
+    return !passes[pass].live;
+}
+
+uint32_t FrameGraph::getBarrierCount() const {
+    return barrierCount;
+}
+
+VkDeviceSize FrameGraph::getTransientMemory() const {
+    VkDeviceSize total = 0;
+    for (const auto& block : blocks) {
+        total += block.requirements.size;
+    }
+    return total;
+}
+
+VkDeviceSize FrameGraph::getTransientRequested() const {
+    return transientRequested;
+}
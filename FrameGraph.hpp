@@ -0,0 +1,194 @@
+#ifndef STAR_FRAMEGRAPH_HPP
+#define STAR_FRAMEGRAPH_HPP
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// how a pass touches a resource; picks the stages, access mask and image layout of the barriers
+enum class FrameAccess : uint8_t {
+    // contents undefined, nothing to wait for
+    None,
+    ColorAttachment,
+    DepthAttachment,
+    // sampled depth in compute or fragment shaders
+    DepthSampled,
+    // sampled in compute or fragment shaders
+    ShaderSampled,
+    // storage or sampled in compute, in GENERAL
+    ComputeRead,
+    ComputeWrite,
+    IndirectRead,
+    TransferRead,
+    TransferWrite,
+    Present,
+};
+
+// an image owned outside the graph
+struct FrameImageImport {
+    VkImage image{VK_NULL_HANDLE};
+    VkImageAspectFlags aspect{VK_IMAGE_ASPECT_COLOR_BIT};
+    uint32_t levels{1};
+    // how it was last used before the graph runs and how it must be left afterwards, None if it is
+    // not needed once the graph is done
+    FrameAccess initial{FrameAccess::None};
+    FrameAccess final{FrameAccess::None};
+    // the first pass overwrites it, the first barrier transitions from UNDEFINED
+    bool discard{false};
+};
+
+// an image only alive between its first and last pass, its memory is shared with transient
+// images whose lifetimes do not overlap
+struct FrameImageDesc {
+    VkFormat format{VK_FORMAT_UNDEFINED};
+    VkExtent2D extent{0, 0};
+    VkImageUsageFlags usage{0};
+    VkImageAspectFlags aspect{VK_IMAGE_ASPECT_COLOR_BIT};
+    uint32_t levels{1};
+};
+
+// passes declare what they read and write, in submission order. compile culls passes whose
+// results nobody reads and places transient images; execute records every live pass with the
+// barriers and layout transitions between them batched into one vkCmdPipelineBarrier per pass.
+// synchronization inside a pass (between mip levels, around transfers) is still the pass's job
+class FrameGraph {
+public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+
+    FrameGraph() = default;
+
+    ~FrameGraph() {
+        destroy();
+    }
+
+    FrameGraph(FrameGraph const&) = delete;
+    void operator=(FrameGraph const&) = delete;
+
+    void init(VkDevice dev, VmaAllocator alloc);
+    void destroy();
+    // drops passes, resources and transient memory, the graph must not be in use
+    void reset();
+
+    ResourceId importImage(const std::string& name, const FrameImageImport& import);
+    // buffers are synchronized as a whole with global memory barriers, they need no handle
+    ResourceId importBuffer(const std::string& name, FrameAccess initial, FrameAccess final);
+    ResourceId createImage(const std::string& name, const FrameImageDesc& desc);
+    // imported images may change every frame, the swapchain image for one
+    void setImage(ResourceId resource, VkImage image);
+
+    PassId addPass(const std::string& name, std::function<void(VkCommandBuffer)> record);
+    // a pass may declare several accesses to one resource, they are merged
+    void read(PassId pass, ResourceId resource, FrameAccess access);
+    void write(PassId pass, ResourceId resource, FrameAccess access);
+    // disabled passes are skipped along with their barriers, for work that only happens on some frames
+    void setEnabled(PassId pass, bool enabled);
+
+    // once all passes are declared, and again after the graph changed with the device idle
+    void compile();
+    void execute(VkCommandBuffer cb);
+
+    [[nodiscard]] VkImage getImage(ResourceId resource) const;
+    // transient images only
+    [[nodiscard]] VkImageView getImageView(ResourceId resource) const;
+    [[nodiscard]] bool isCulled(PassId pass) const;
+    // pipeline barrier calls recorded by the last execute
+    [[nodiscard]] uint32_t getBarrierCount() const;
+    // device memory backing the transient images, and what it would take without aliasing
+    [[nodiscard]] VkDeviceSize getTransientMemory() const;
+    [[nodiscard]] VkDeviceSize getTransientRequested() const;
+
+private:
+    enum class ResourceType : uint8_t {
+        Imported,
+        Buffer,
+        Transient,
+    };
+
+    struct AccessInfo {
+        VkPipelineStageFlags stages{0};
+        VkAccessFlags access{0};
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+        bool write{false};
+    };
+
+    // what has to finish before the next use, and who has seen the last write already
+    struct ResourceState {
+        VkPipelineStageFlags writeStages{0};
+        VkAccessFlags writeAccess{0};
+        VkPipelineStageFlags readStages{0};
+        VkAccessFlags readAccess{0};
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+    };
+
+    struct Resource {
+        std::string name;
+        ResourceType type{ResourceType::Imported};
+        FrameImageImport import;
+        FrameImageDesc desc;
+        VkImage image{VK_NULL_HANDLE};
+        VkImageView view{VK_NULL_HANDLE};
+        // what every tenant of a transient's memory does with it, waited on before its first use
+        // since the previous frame's tenants may still be at it
+        VkPipelineStageFlags aliasStages{0};
+        VkAccessFlags aliasAccess{0};
+        uint32_t firstPass{UINT32_MAX};
+        uint32_t lastPass{0};
+    };
+
+    struct Use {
+        ResourceId resource;
+        AccessInfo info;
+        bool reads{false};
+        bool writes{false};
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<Use> uses;
+        bool enabled{true};
+        bool live{true};
+    };
+
+    struct MemoryBlock {
+        VkMemoryRequirements requirements{};
+        VmaAllocation alloc{VK_NULL_HANDLE};
+        std::vector<ResourceId> tenants;
+    };
+
+    // one vkCmdPipelineBarrier worth of barriers
+    struct Batch {
+        VkPipelineStageFlags srcStages{0};
+        VkPipelineStageFlags dstStages{0};
+        VkAccessFlags srcAccess{0};
+        VkAccessFlags dstAccess{0};
+        std::vector<VkImageMemoryBarrier> images;
+    };
+
+    static AccessInfo describe(FrameAccess access);
+    void declare(PassId pass, ResourceId resource, FrameAccess access, bool write);
+    void transition(Batch& batch, ResourceId resource, const AccessInfo& info);
+    void flush(VkCommandBuffer cb, Batch& batch);
+    [[nodiscard]] bool isImage(ResourceId resource) const;
+    void cull();
+    void placeTransients();
+    void releaseTransients();
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<MemoryBlock> blocks;
+    std::vector<ResourceState> states;
+    uint32_t barrierCount{0};
+    VkDeviceSize transientRequested{0};
+};
+
+
+#endif //STAR_FRAMEGRAPH_HPP
@@ -0,0 +1,82 @@
+#include "Frustum.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STAR_FRUSTUM_SSE 1
+#endif
+
+Frustum::Frustum(const glm::mat4 &viewProj) {
+    const glm::mat4 m = glm::transpose(viewProj);
+
+    planes[0] = m[3] + m[0]; // left
+    planes[1] = m[3] - m[0]; // right
+    planes[2] = m[3] + m[1]; // bottom
+    planes[3] = m[3] - m[1]; // top
+    planes[4] = m[3] + m[2]; // near
+    planes[5] = m[3] - m[2]; // far
+
+    for (auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const {
+    for (const auto& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const {
+    for (const auto& plane : planes) {
+        // the corner furthest along the plane normal decides
+        const glm::vec3 positive(plane.x >= 0.0f ? max.x : min.x,
+                                 plane.y >= 0.0f ? max.y : min.y,
+                                 plane.z >= 0.0f ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Frustum::testSpheres(const float *x, const float *y, const float *z, const float *radius, size_t count, uint8_t *visible) const {
+    size_t i = 0;
+
+#ifdef STAR_FRUSTUM_SSE
+    std::array<__m128, 6> nx{}, ny{}, nz{}, nw{};
+    for (size_t p = 0; p < planes.size(); ++p) {
+        nx[p] = _mm_set1_ps(planes[p].x);
+        ny[p] = _mm_set1_ps(planes[p].y);
+        nz[p] = _mm_set1_ps(planes[p].z);
+        nw[p] = _mm_set1_ps(planes[p].w);
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 cx = _mm_loadu_ps(x + i);
+        const __m128 cy = _mm_loadu_ps(y + i);
+        const __m128 cz = _mm_loadu_ps(z + i);
+        const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t p = 0; p < planes.size(); ++p) {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                                        _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        for (size_t k = 0; k < 4; ++k) {
+            visible[i + k] = static_cast<uint8_t>((mask >> k) & 1);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        visible[i] = intersectsSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+    }
+}
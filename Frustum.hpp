@@ -0,0 +1,31 @@
+#ifndef STAR_FRUSTUM_HPP
+#define STAR_FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class Frustum {
+public:
+    Frustum() = default;
+    // planes face inwards and are normalized; expects glm's default -1..1 clip depth
+    explicit Frustum(const glm::mat4& viewProj);
+
+    [[nodiscard]] bool intersectsSphere(const glm::vec3& center, float radius) const;
+    [[nodiscard]] bool intersectsBox(const glm::vec3& min, const glm::vec3& max) const;
+    // structure of arrays sphere test, four spheres per step with sse; visible[i] becomes 1 for every
+    // sphere that touches the frustum and 0 otherwise
+    void testSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const;
+
+    [[nodiscard]] const std::array<glm::vec4, 6>& getPlanes() const {
+        return planes;
+    }
+
+private:
+    std::array<glm::vec4, 6> planes{};
+};
+
+
+#endif //STAR_FRUSTUM_HPP
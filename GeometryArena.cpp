@@ -0,0 +1,211 @@
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
+static VkDeviceSize roundUp(VkDeviceSize v, VkDeviceSize multiple) {
+    return (v + multiple - 1) / multiple * multiple;
+}
+
+void BufferArena::init(VmaAllocator alloc, VkBufferUsageFlags usage, VkDeviceSize elementSize, VkDeviceSize blockSize) {
+    assert(elementSize > 0);
+    allocator = alloc;
+    bufferUsage = usage;
+    element = elementSize;
+    defaultBlockSize = roundUp(blockSize, elementSize);
+}
+
+void BufferArena::destroy() {
+    for (const auto& block : blocks) {
+        if (block.buffer) {
+            vmaDestroyBuffer(allocator, block.buffer, block.alloc);
+        }
+    }
+    blocks.clear();
+}
+
+void BufferArena::addBlock(VkDeviceSize capacity) {
+    Block block{};
+    block.capacity = capacity;
+
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = capacity;
+    info.usage = bufferUsage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo vmaInfo{};
+    vmaInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    if (vmaCreateBuffer(allocator, &info, &vmaInfo, &block.buffer, &block.alloc, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create geometry arena block");
+    }
+
+    block.freeList[0] = capacity;
+
+    // ranges remember their block index, so trimmed blocks leave a hole that is refilled here
+    const auto hole = std::find_if(blocks.begin(), blocks.end(), [](const Block& b) { return b.buffer == VK_NULL_HANDLE; });
+    if (hole != blocks.end()) {
+        *hole = std::move(block);
+    } else {
+        blocks.push_back(std::move(block));
+    }
+}
+
+ArenaRange BufferArena::allocate(VkDeviceSize size) {
+    assert(allocator);
+    size = roundUp(std::max<VkDeviceSize>(size, 1), element);
+
+    for (size_t pass = 0; pass < 2; ++pass) {
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            auto& freeList = blocks[b].freeList;
+            for (auto it = freeList.begin(); it != freeList.end(); ++it) {
+                if (it->second < size) {
+                    continue;
+                }
+
+                ArenaRange range{};
+                range.buffer = blocks[b].buffer;
+                range.offset = it->first;
+                range.size = size;
+                range.block = static_cast<uint32_t>(b);
+
+                const VkDeviceSize remaining = it->second - size;
+                const VkDeviceSize next = it->first + size;
+                freeList.erase(it);
+                if (remaining > 0) {
+                    freeList[next] = remaining;
+                }
+                return range;
+            }
+        }
+
+        // nothing fits, oversized requests get a block of their own size
+        addBlock(std::max(defaultBlockSize, size));
+    }
+
+    throw std::runtime_error("cannot allocate from geometry arena");
+}
+
+void BufferArena::free(const ArenaRange &range) {
+    assert(range.block < blocks.size());
+    assert(blocks[range.block].buffer == range.buffer);
+
+    auto& freeList = blocks[range.block].freeList;
+    auto [it, inserted] = freeList.emplace(range.offset, range.size);
+    assert(inserted);
+
+    // merge with the following free range
+    const auto next = std::next(it);
+    if (next != freeList.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        freeList.erase(next);
+    }
+
+    // and with the preceding one
+    if (it != freeList.begin()) {
+        const auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            freeList.erase(it);
+        }
+    }
+}
+
+VkDeviceSize BufferArena::trim() {
+    VkDeviceSize released = 0;
+    for (auto& block : blocks) {
+        if (block.buffer && block.freeList.size() == 1 && block.freeList.begin()->second == block.capacity) {
+            vmaDestroyBuffer(allocator, block.buffer, block.alloc);
+            released += block.capacity;
+            block = Block{};
+        }
+    }
+    return released;
+}
+
+size_t BufferArena::getBlockCount() const {
+    return std::count_if(blocks.begin(), blocks.end(), [](const Block& b) { return b.buffer != VK_NULL_HANDLE; });
+}
+
+void GeometryArena::init(VmaAllocator alloc, VkDeviceSize blockSize) {
+    const VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    const VkBufferUsageFlags indexUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    vertexArena(VertexFormat::Standard).init(alloc, vertexUsage, Vertex::getStride(VertexFormat::Standard), blockSize);
+    vertexArena(VertexFormat::Compact).init(alloc, vertexUsage, Vertex::getStride(VertexFormat::Compact), blockSize);
+    indexArena(VK_INDEX_TYPE_UINT8_EXT).init(alloc, indexUsage, 1, blockSize);
+    indexArena(VK_INDEX_TYPE_UINT16).init(alloc, indexUsage, 2, blockSize);
+    indexArena(VK_INDEX_TYPE_UINT32).init(alloc, indexUsage, 4, blockSize);
+}
+
+void GeometryArena::destroy() {
+    std::lock_guard lock(mutex);
+    for (auto& arena : vertexArenas) {
+        arena.destroy();
+    }
+    for (auto& arena : indexArenas) {
+        arena.destroy();
+    }
+}
+
+ArenaRange GeometryArena::allocateVertices(VertexFormat format, VkDeviceSize size) {
+    std::lock_guard lock(mutex);
+    return vertexArena(format).allocate(size);
+}
+
+ArenaRange GeometryArena::allocateIndices(VkIndexType type, VkDeviceSize size) {
+    std::lock_guard lock(mutex);
+    return indexArena(type).allocate(size);
+}
+
+void GeometryArena::freeVertices(VertexFormat format, const ArenaRange &range) {
+    std::lock_guard lock(mutex);
+    vertexArena(format).free(range);
+}
+
+void GeometryArena::freeIndices(VkIndexType type, const ArenaRange &range) {
+    std::lock_guard lock(mutex);
+    indexArena(type).free(range);
+}
+
+VkDeviceSize GeometryArena::trim() {
+    std::lock_guard lock(mutex);
+    VkDeviceSize released = 0;
+    for (auto& arena : vertexArenas) {
+        released += arena.trim();
+    }
+    for (auto& arena : indexArenas) {
+        released += arena.trim();
+    }
+    return released;
+}
+
+size_t GeometryArena::getBlockCount() const {
+    std::lock_guard lock(mutex);
+    size_t count = 0;
+    for (const auto& arena : vertexArenas) {
+        count += arena.getBlockCount();
+    }
+    for (const auto& arena : indexArenas) {
+        count += arena.getBlockCount();
+    }
+    return count;
+}
+
+BufferArena &GeometryArena::vertexArena(VertexFormat format) {
+    return vertexArenas[format == VertexFormat::Compact ? 1 : 0];
+}
+
+BufferArena &GeometryArena::indexArena(VkIndexType type) {
+    switch (type) {
+        case VK_INDEX_TYPE_UINT8_EXT:
+            return indexArenas[0];
+        case VK_INDEX_TYPE_UINT16:
+            return indexArenas[1];
+        default:
+            return indexArenas[2];
+    }
+}
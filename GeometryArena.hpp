@@ -0,0 +1,93 @@
+#ifndef STAR_GEOMETRYARENA_HPP
+#define STAR_GEOMETRYARENA_HPP
+
+#include "Vertex.hpp"
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// a sub-allocation of one of an arena's blocks, offset and size in bytes
+struct ArenaRange {
+    VkBuffer buffer{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
+    uint32_t block{0};
+};
+
+// first fit allocator over a growing list of large device-local buffers; every range starts at a
+// multiple of the element size so it can be addressed by element offset instead of byte offset
+class BufferArena {
+public:
+    BufferArena() = default;
+
+    ~BufferArena() {
+        destroy();
+    }
+
+    BufferArena(BufferArena const&) = delete;
+    void operator=(BufferArena const&) = delete;
+
+    void init(VmaAllocator alloc, VkBufferUsageFlags usage, VkDeviceSize elementSize, VkDeviceSize blockSize);
+    void destroy();
+
+    ArenaRange allocate(VkDeviceSize size);
+    // returns the range to its block's free list, merging it with free neighbours
+    void free(const ArenaRange& range);
+    // gives blocks without a single live range back to the allocator, returns the bytes released
+    VkDeviceSize trim();
+
+    [[nodiscard]] size_t getBlockCount() const;
+
+private:
+    struct Block {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VmaAllocation alloc{VK_NULL_HANDLE};
+        VkDeviceSize capacity{0};
+        std::map<VkDeviceSize, VkDeviceSize> freeList; // offset -> size
+    };
+
+    void addBlock(VkDeviceSize capacity);
+
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    VkBufferUsageFlags bufferUsage{0};
+    VkDeviceSize element{1};
+    VkDeviceSize defaultBlockSize{0};
+    std::vector<Block> blocks;
+};
+
+// shared home of all static geometry: one arena per vertex format and one per index type, so
+// meshes of the same kind share buffers and consecutive draws skip rebinding
+class GeometryArena {
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+
+    void init(VmaAllocator alloc, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    void destroy();
+
+    ArenaRange allocateVertices(VertexFormat format, VkDeviceSize size);
+    ArenaRange allocateIndices(VkIndexType type, VkDeviceSize size);
+    void freeVertices(VertexFormat format, const ArenaRange& range);
+    void freeIndices(VkIndexType type, const ArenaRange& range);
+    // releases empty blocks so evicted geometry actually lowers heap usage; the caller makes sure
+    // the gpu is done with them, Screen::drawFrame calls it once deferred frees have run
+    VkDeviceSize trim();
+
+    [[nodiscard]] size_t getBlockCount() const;
+
+private:
+    BufferArena& vertexArena(VertexFormat format);
+    BufferArena& indexArena(VkIndexType type);
+
+    std::array<BufferArena, 2> vertexArenas;
+    std::array<BufferArena, 3> indexArenas;
+    mutable std::mutex mutex;
+};
+
+
+#endif //STAR_GEOMETRYARENA_HPP
@@ -0,0 +1,421 @@
+#include "GpuCuller.hpp"
+#include "Screen.hpp"
+#include "Shader.hpp"
+#include "ShaderReflection.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+
+#include "shaders/build/cull.comp.spv.inl"
+
+// push constant block of cull.comp
+struct CullConstants {
+    uint32_t late;
+};
+
+static std::pair<VkBuffer, VmaAllocation> createCullBuffer(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                                                           bool hostVisible, void** mapped) {
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = size;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo vmaInfo{};
+    vmaInfo.usage = hostVisible ? VMA_MEMORY_USAGE_AUTO : VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    if (hostVisible) {
+        vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        vmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    VkBuffer buffer{VK_NULL_HANDLE};
+    VmaAllocation alloc{VK_NULL_HANDLE};
+    VmaAllocationInfo allocInfo{};
+    if (vmaCreateBuffer(allocator, &info, &vmaInfo, &buffer, &alloc, &allocInfo) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create culling buffer");
+    }
+    if (mapped) {
+        *mapped = allocInfo.pMappedData;
+    }
+    return {buffer, alloc};
+}
+
+void GpuCuller::init(VkDevice dev, VmaAllocator alloc, uint32_t frameCount, bool drawIndirectCount) {
+    device = dev;
+    allocator = alloc;
+    indirectCount = drawIndirectCount;
+
+    // binding 0 instances, 1 draw commands, 2 per group counts, 3 last frame's visibility, 4 depth
+    // pyramid, 5 cull data; the vertex shaders only see the instances
+    const std::span<const uint32_t> code = cull_comp;
+    const ShaderReflection reflection(code);
+    auto bindings = reflection.getSet(0);
+    assert(!bindings.empty() && bindings[0].binding == 0);
+    bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+    auto& layoutCache = Screen::getInstance().getLayoutCache();
+    setLayout = layoutCache.getSetLayout(bindings);
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 4};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount};
+    poolSizes[2] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create culling descriptor pool");
+    }
+
+    const auto pushConstantRanges = reflection.getPushConstantRanges();
+    pipelineLayout = layoutCache.getPipelineLayout(std::span(&setLayout, 1), pushConstantRanges);
+
+    VkShaderModule module = Shader::createShaderModule(device, code);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    const VkResult result = Screen::getInstance().getPipelineCache().createComputePipeline(pipelineInfo, &pipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("cannot create culling pipeline");
+    }
+
+    std::tie(visibility, visibilityAlloc) = createCullBuffer(allocator, sizeof(uint32_t) * MAX_INSTANCES,
+                                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, nullptr);
+    visibilityCleared = false;
+
+    // early and late phase each get a full range of commands and counts
+    frames.resize(frameCount);
+    for (auto& frame : frames) {
+        std::tie(frame.instances, frame.instancesAlloc) = createCullBuffer(allocator, sizeof(GpuInstance) * MAX_INSTANCES,
+                                                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, &frame.mappedInstances);
+        std::tie(frame.commands, frame.commandsAlloc) = createCullBuffer(allocator, sizeof(VkDrawIndexedIndirectCommand) * MAX_INSTANCES * 2,
+                                                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                                         false, nullptr);
+        std::tie(frame.counts, frame.countsAlloc) = createCullBuffer(allocator, sizeof(uint32_t) * MAX_GROUPS * 2,
+                                                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                                     false, nullptr);
+        std::tie(frame.readback, frame.readbackAlloc) = createCullBuffer(allocator, sizeof(uint32_t) * MAX_GROUPS * 2,
+                                                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT, true, &frame.mappedReadback);
+        std::tie(frame.cullData, frame.cullDataAlloc) = createCullBuffer(allocator, sizeof(CullData),
+                                                                         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, true, &frame.mappedCullData);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &frame.set) != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate culling descriptor set");
+        }
+
+        // the pyramid at binding 4 is written by setPyramid
+        std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+        bufferInfos[0] = {frame.instances, 0, VK_WHOLE_SIZE};
+        bufferInfos[1] = {frame.commands, 0, VK_WHOLE_SIZE};
+        bufferInfos[2] = {frame.counts, 0, VK_WHOLE_SIZE};
+        bufferInfos[3] = {visibility, 0, VK_WHOLE_SIZE};
+        bufferInfos[4] = {frame.cullData, 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 5> writes{};
+        for (uint32_t b = 0; b < writes.size(); ++b) {
+            writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[b].dstSet = frame.set;
+            writes[b].dstBinding = b < 4 ? b : 5;
+            writes[b].descriptorCount = 1;
+            writes[b].descriptorType = b < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writes[b].pBufferInfo = &bufferInfos[b];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void GpuCuller::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (auto& frame : frames) {
+        vmaDestroyBuffer(allocator, frame.instances, frame.instancesAlloc);
+        vmaDestroyBuffer(allocator, frame.commands, frame.commandsAlloc);
+        vmaDestroyBuffer(allocator, frame.counts, frame.countsAlloc);
+        vmaDestroyBuffer(allocator, frame.readback, frame.readbackAlloc);
+        vmaDestroyBuffer(allocator, frame.cullData, frame.cullDataAlloc);
+    }
+    frames.clear();
+    vmaDestroyBuffer(allocator, visibility, visibilityAlloc);
+    visibility = VK_NULL_HANDLE;
+
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout GpuCuller::getSetLayout() const {
+    return setLayout;
+}
+
+void GpuCuller::setPyramid(const DepthPyramid &pyramid) {
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = pyramid.getSampler();
+    imageInfo.imageView = pyramid.getView();
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    for (auto& frame : frames) {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.set;
+        write.dstBinding = 4;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+
+    pyramidSize = glm::vec2(pyramid.getExtent().width, pyramid.getExtent().height);
+}
+
+void GpuCuller::setOcclusion(bool enabled) {
+    occlusion = enabled;
+}
+
+bool GpuCuller::getOcclusion() const {
+    return occlusion && pyramidSize.x > 0.0f;
+}
+
+void GpuCuller::begin(const glm::mat4 &vp) {
+    viewProj = vp;
+    frustum = Frustum(vp);
+    instances.clear();
+    groups.clear();
+}
+
+bool GpuCuller::hasInstances(uint32_t frameIndex) const {
+    assert(frameIndex < frames.size());
+    return frames[frameIndex].pending;
+}
+
+size_t GpuCuller::getInstanceCount() const {
+    return instances.size();
+}
+
+void GpuCuller::add(const Mesh &mesh, const glm::mat4 &model, uint32_t lod, uint32_t texture) {
+    if (instances.size() == MAX_INSTANCES) {
+        throw std::runtime_error("too many gpu culled instances");
+    }
+
+    auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& g) {
+        return g.vertexBuffer == mesh.getVertexBuffer() && g.indexBuffer == mesh.getIndexBuffer() &&
+               g.indexType == mesh.getIndexType() && g.format == mesh.getVertexFormat();
+    });
+    if (group == groups.end()) {
+        if (groups.size() == MAX_GROUPS) {
+            throw std::runtime_error("too many gpu culled buffer groups");
+        }
+        groups.push_back({mesh.getVertexBuffer(), mesh.getIndexBuffer(), mesh.getIndexType(), mesh.getVertexFormat()});
+        group = groups.end() - 1;
+    }
+
+    const MeshLod level = mesh.getLod(lod);
+    const VertexDequantization dq = mesh.getDequantization();
+
+    GpuInstance instance{};
+    instance.model = model;
+    instance.sphere = mesh.getBoundingSphere();
+    instance.dqOffset = dq.offset;
+    instance.dqScale = dq.scale;
+    instance.indexCount = level.indexCount;
+    instance.firstIndex = mesh.getFirstIndex() + level.firstIndex;
+    instance.vertexOffset = mesh.getVertexOffset();
+    instance.group = static_cast<uint32_t>(group - groups.begin());
+    instance.texture = texture;
+    instances.push_back(instance);
+    ++group->size;
+}
+
+void GpuCuller::dispatch(VkCommandBuffer cb, uint32_t frameIndex) {
+    assert(frameIndex < frames.size());
+    auto& frame = frames[frameIndex];
+
+    // each group gets a range of the command buffer as large as its instance count
+    uint32_t base = 0;
+    for (auto& group : groups) {
+        group.base = base;
+        base += group.size;
+    }
+
+    // the cpu reference runs the same sphere test as cull.comp
+    frame.cpuVisible = 0;
+    for (auto& instance : instances) {
+        instance.commandBase = groups[instance.group].base;
+
+        const glm::mat4& m = instance.model;
+        const glm::vec3 center = glm::vec3(m * glm::vec4(glm::vec3(instance.sphere), 1.0f));
+        const float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+        frame.cpuVisible += frustum.intersectsSphere(center, instance.sphere.w * scale) ? 1 : 0;
+    }
+    frame.groups = groups;
+    frame.instanceCount = static_cast<uint32_t>(instances.size());
+    frame.pending = !instances.empty();
+    frame.occlusion = getOcclusion();
+    if (instances.empty()) {
+        return;
+    }
+
+    std::memcpy(frame.mappedInstances, instances.data(), instances.size() * sizeof(GpuInstance));
+
+    CullData data{};
+    data.viewProj = viewProj;
+    std::copy(frustum.getPlanes().begin(), frustum.getPlanes().end(), data.planes.begin());
+    data.pyramidSize = pyramidSize;
+    data.instanceCount = static_cast<uint32_t>(instances.size());
+    data.occlusion = frame.occlusion ? 1 : 0;
+    data.lateCommands = MAX_INSTANCES;
+    data.lateCounts = MAX_GROUPS;
+    std::memcpy(frame.mappedCullData, &data, sizeof(data));
+
+    // nothing was drawn before the first frame, the late phase fills it in
+    if (!visibilityCleared) {
+        vkCmdFillBuffer(cb, visibility, 0, VK_WHOLE_SIZE, 0);
+        visibilityCleared = true;
+    }
+
+    // culled slots must read as zero instance draws when there is no count buffer
+    constexpr VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+    vkCmdFillBuffer(cb, frame.counts, 0, sizeof(uint32_t) * MAX_GROUPS * 2, 0);
+    vkCmdFillBuffer(cb, frame.commands, 0, stride * instances.size(), 0);
+    vkCmdFillBuffer(cb, frame.commands, stride * MAX_INSTANCES, stride * instances.size(), 0);
+
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    const CullConstants constants{0};
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.set, 0, nullptr);
+    vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cb, (data.instanceCount + 63) / 64, 1, 1);
+}
+
+void GpuCuller::dispatchLate(VkCommandBuffer cb, uint32_t frameIndex) {
+    assert(frameIndex < frames.size());
+    auto& frame = frames[frameIndex];
+    if (!frame.pending) {
+        return;
+    }
+
+    const CullConstants constants{1};
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.set, 0, nullptr);
+    vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cb, (frame.instanceCount + 63) / 64, 1, 1);
+}
+
+void GpuCuller::copyCounts(VkCommandBuffer cb, uint32_t frameIndex) {
+    assert(frameIndex < frames.size());
+    const auto& frame = frames[frameIndex];
+    if (!frame.pending) {
+        return;
+    }
+
+    // both phases' counts, the late ones stay zero when the late phase did not run
+    std::array<VkBufferCopy, 2> copies{};
+    copies[0].size = sizeof(uint32_t) * frame.groups.size();
+    copies[1].srcOffset = sizeof(uint32_t) * MAX_GROUPS;
+    copies[1].dstOffset = sizeof(uint32_t) * MAX_GROUPS;
+    copies[1].size = copies[0].size;
+    vkCmdCopyBuffer(cb, frame.counts, frame.readback, static_cast<uint32_t>(copies.size()), copies.data());
+
+    VkMemoryBarrier readbackBarrier{};
+    readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         1, &readbackBarrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCuller::draw(VkCommandBuffer cb, uint32_t frameIndex, VkPipelineLayout layout, VkPipeline standard, VkPipeline compact,
+                     CullPhase phase) {
+    assert(frameIndex < frames.size());
+    const auto& frame = frames[frameIndex];
+    if (!frame.pending) {
+        return;
+    }
+
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &frame.set, 0, nullptr);
+
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize commandBase = phase == CullPhase::Late ? VkDeviceSize{stride} * MAX_INSTANCES : 0;
+    const VkDeviceSize countBase = phase == CullPhase::Late ? sizeof(uint32_t) * MAX_GROUPS : 0;
+    for (uint32_t g = 0; g < frame.groups.size(); ++g) {
+        const auto& group = frame.groups[g];
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, group.format == VertexFormat::Compact ? compact : standard);
+
+        const VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cb, 0, 1, &group.vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(cb, group.indexBuffer, 0, group.indexType);
+
+        const VkDeviceSize commandOffset = commandBase + VkDeviceSize{group.base} * stride;
+        if (indirectCount) {
+            vkCmdDrawIndexedIndirectCount(cb, frame.commands, commandOffset, frame.counts, countBase + g * sizeof(uint32_t), group.size, stride);
+        } else {
+            // one draw per slot so the fallback doesn't also need multiDrawIndirect
+            for (uint32_t i = 0; i < group.size; ++i) {
+                vkCmdDrawIndexedIndirect(cb, frame.commands, commandOffset + VkDeviceSize{i} * stride, 1, stride);
+            }
+        }
+    }
+}
+
+void GpuCuller::readBack(uint32_t frameIndex) {
+    assert(frameIndex < frames.size());
+    auto& frame = frames[frameIndex];
+    if (!frame.pending) {
+        return;
+    }
+
+    const auto* counts = static_cast<const uint32_t*>(frame.mappedReadback);
+    uint32_t early = 0;
+    uint32_t late = 0;
+    for (size_t g = 0; g < frame.groups.size(); ++g) {
+        early += counts[g];
+        late += counts[MAX_GROUPS + g];
+    }
+
+    // frustum-only culling must keep exactly what the cpu reference keeps, occlusion only ever
+    // removes instances on top of it
+    gpuVisible = early + late;
+    lateVisible = late;
+    cpuVisible = frame.cpuVisible;
+    if (frame.occlusion ? gpuVisible > cpuVisible : gpuVisible != cpuVisible) {
+        std::cout << "warning: gpu culling drew " << gpuVisible << " instances, cpu frustum reference kept " << cpuVisible << std::endl;
+    }
+    frame.pending = false;
+}
+
+uint32_t GpuCuller::getGpuVisibleCount() const {
+    return gpuVisible;
+}
+
+uint32_t GpuCuller::getLateCount() const {
+    return lateVisible;
+}
+
+uint32_t GpuCuller::getCpuVisibleCount() const {
+    return cpuVisible;
+}
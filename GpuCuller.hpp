@@ -0,0 +1,172 @@
+#ifndef STAR_GPUCULLER_HPP
+#define STAR_GPUCULLER_HPP
+
+#include "DepthPyramid.hpp"
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+#include "TextureTable.hpp"
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// std430 layout shared with cull.comp and the indirect vertex shaders
+struct GpuInstance {
+    glm::mat4 model;
+    glm::vec4 sphere;
+    glm::vec4 dqOffset;
+    glm::vec4 dqScale;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t group;
+    uint32_t commandBase;
+    // TextureTable slot the fragment shader samples
+    uint32_t texture;
+    uint32_t pad[2];
+};
+
+static_assert(sizeof(GpuInstance) == 144);
+
+// std140 uniform block of cull.comp
+struct CullData {
+    glm::mat4 viewProj;
+    std::array<glm::vec4, 6> planes;
+    glm::vec2 pyramidSize;
+    uint32_t instanceCount;
+    uint32_t occlusion;
+    uint32_t lateCommands;
+    uint32_t lateCounts;
+};
+
+// early draws what was visible last frame, late draws what the depth pyramid shows was missed
+enum class CullPhase {
+    Early,
+    Late
+};
+
+// gpu driven path: instances are frustum culled by a compute pass that writes compacted
+// VkDrawIndexedIndirectCommands, one range and one count per group of instances sharing vertex
+// and index buffers, consumed by vkCmdDrawIndexedIndirectCount. with a depth pyramid the culling
+// runs in two phases so that instances hidden behind occluders are skipped without popping in
+// when they come into view
+class GpuCuller {
+public:
+    static constexpr uint32_t MAX_INSTANCES = 1u << 16;
+    static constexpr uint32_t MAX_GROUPS = 64;
+
+    GpuCuller() = default;
+
+    ~GpuCuller() {
+        destroy();
+    }
+
+    GpuCuller(GpuCuller const&) = delete;
+    void operator=(GpuCuller const&) = delete;
+
+    // without drawIndirectCount every group draws its full range, culled slots stay zeroed
+    void init(VkDevice dev, VmaAllocator alloc, uint32_t frames, bool drawIndirectCount);
+    void destroy();
+
+    // set 1 of the indirect graphics pipelines, the vertex shaders read the instance buffer from it
+    [[nodiscard]] VkDescriptorSetLayout getSetLayout() const;
+    // enables occlusion culling against the pyramid; call again after every resize, with no frame in flight
+    void setPyramid(const DepthPyramid& pyramid);
+    void setOcclusion(bool enabled);
+    [[nodiscard]] bool getOcclusion() const;
+
+    // start the instance list for the next frame, before Screen::drawFrame
+    void begin(const glm::mat4& viewProj);
+    // last frame's visibility is kept per instance index, so add the same instances in the same
+    // order every frame and append new ones at the end
+    void add(const Mesh& mesh, const glm::mat4& model, uint32_t lod = 0, uint32_t texture = TextureTable::NO_TEXTURE);
+    [[nodiscard]] bool hasInstances(uint32_t frame) const;
+    // added since begin, before the dispatch has seen them
+    [[nodiscard]] size_t getInstanceCount() const;
+
+    // outside the render pass: uploads the instances and records the early culling dispatch. the
+    // frame graph orders both dispatches against the draws and last frame's late phase
+    void dispatch(VkCommandBuffer cb, uint32_t frame);
+    // outside the render pass, after the pyramid was built from the early phase's depth
+    void dispatchLate(VkCommandBuffer cb, uint32_t frame);
+    // outside the render pass, after both phases: copies the counts for readBack. runs every
+    // frame, with or without the late phase
+    void copyCounts(VkCommandBuffer cb, uint32_t frame);
+    // inside the render pass, with set 0 already bound
+    void draw(VkCommandBuffer cb, uint32_t frame, VkPipelineLayout layout, VkPipeline standard, VkPipeline compact,
+              CullPhase phase = CullPhase::Early);
+    // once the frame's fence has passed: reads back what the gpu kept and checks it against the cpu
+    void readBack(uint32_t frame);
+
+    // instances drawn in the last frame read back, the late phase's share of them, and the cpu
+    // frustum-only reference for the same frame
+    [[nodiscard]] uint32_t getGpuVisibleCount() const;
+    [[nodiscard]] uint32_t getLateCount() const;
+    [[nodiscard]] uint32_t getCpuVisibleCount() const;
+
+private:
+    struct Group {
+        VkBuffer vertexBuffer{VK_NULL_HANDLE};
+        VkBuffer indexBuffer{VK_NULL_HANDLE};
+        VkIndexType indexType{VK_INDEX_TYPE_UINT16};
+        VertexFormat format{VertexFormat::Standard};
+        uint32_t size{0};
+        uint32_t base{0};
+    };
+
+    struct FrameResources {
+        VkBuffer instances{VK_NULL_HANDLE};
+        VmaAllocation instancesAlloc{VK_NULL_HANDLE};
+        void* mappedInstances{nullptr};
+        VkBuffer commands{VK_NULL_HANDLE};
+        VmaAllocation commandsAlloc{VK_NULL_HANDLE};
+        VkBuffer counts{VK_NULL_HANDLE};
+        VmaAllocation countsAlloc{VK_NULL_HANDLE};
+        VkBuffer readback{VK_NULL_HANDLE};
+        VmaAllocation readbackAlloc{VK_NULL_HANDLE};
+        void* mappedReadback{nullptr};
+        VkBuffer cullData{VK_NULL_HANDLE};
+        VmaAllocation cullDataAlloc{VK_NULL_HANDLE};
+        void* mappedCullData{nullptr};
+        VkDescriptorSet set{VK_NULL_HANDLE};
+        std::vector<Group> groups;
+        uint32_t instanceCount{0};
+        uint32_t cpuVisible{0};
+        // whether the late phase runs, set by dispatch
+        bool occlusion{false};
+        bool pending{false};
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    bool indirectCount{false};
+    // both layouts belong to Screen's layout cache
+    VkDescriptorSetLayout setLayout{VK_NULL_HANDLE};
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout{VK_NULL_HANDLE};
+    VkPipeline pipeline{VK_NULL_HANDLE};
+    std::vector<FrameResources> frames;
+    // shared by all frames, queue order keeps one frame's late phase ahead of the next early phase
+    VkBuffer visibility{VK_NULL_HANDLE};
+    VmaAllocation visibilityAlloc{VK_NULL_HANDLE};
+    bool visibilityCleared{false};
+
+    bool occlusion{true};
+    glm::vec2 pyramidSize{0.0f};
+
+    glm::mat4 viewProj{1.0f};
+    Frustum frustum;
+    std::vector<GpuInstance> instances;
+    std::vector<Group> groups;
+
+    uint32_t gpuVisible{0};
+    uint32_t lateVisible{0};
+    uint32_t cpuVisible{0};
+};
+
+
+#endif //STAR_GPUCULLER_HPP
@@ -0,0 +1,31 @@
+#include "Hash.hpp"
+
+void Fnv1a::bytes(const void *data, size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+}
+
+void Fnv1a::mix(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        hash ^= (value >> (i * 8)) & 0xffu;
+        hash *= 0x100000001b3ull;
+    }
+}
+
+uint64_t hashBytes(const void *data, size_t size) {
+    Fnv1a hash;
+    hash.bytes(data, size);
+    return hash.get();
+}
+
+size_t WordsHash::operator()(const std::vector<uint64_t> &words) const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const uint64_t word : words) {
+        hash ^= word;
+        hash *= 0x100000001b3ull;
+    }
+    return static_cast<size_t>(hash);
+}
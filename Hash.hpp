@@ -0,0 +1,32 @@
+#ifndef STAR_HASH_HPP
+#define STAR_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FNV-1a, 64 bit: cache keys and file checksums, nothing that has to stand up to crafted input
+class Fnv1a {
+public:
+    void bytes(const void* data, size_t size);
+    // four bytes, lowest first, so the result does not depend on struct padding or endianness
+    void mix(uint32_t value);
+
+    [[nodiscard]] uint64_t get() const {
+        return hash;
+    }
+
+private:
+    uint64_t hash{0xcbf29ce484222325ull};
+};
+
+uint64_t hashBytes(const void* data, size_t size);
+
+// unordered_map hasher for keys built as a list of 64 bit words, mixed a whole word at a time
+// since the keys are short
+struct WordsHash {
+    size_t operator()(const std::vector<uint64_t>& words) const;
+};
+
+
+#endif //STAR_HASH_HPP
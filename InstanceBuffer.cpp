@@ -0,0 +1,113 @@
+#include "InstanceBuffer.hpp"
+
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+void InstanceBuffer::init(VkDevice dev, VmaAllocator alloc, uint32_t frameCount, VkDescriptorSetLayout setLayout) {
+    device = dev;
+    allocator = alloc;
+
+    // the shared layout also declares the culling pass's bindings, the pool has to cover them
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 4};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount};
+    poolSizes[2] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create instance descriptor pool");
+    }
+
+    frames.resize(frameCount);
+    for (auto& frame : frames) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = sizeof(GpuInstance) * MAX_INSTANCES;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // written once per frame and read once by the vertex shader, fine to leave in host memory
+        VmaAllocationCreateInfo vmaInfo{};
+        vmaInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        vmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VmaAllocationInfo allocInfo{};
+        if (vmaCreateBuffer(allocator, &bufferInfo, &vmaInfo, &frame.buffer, &frame.alloc, &allocInfo) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create instance buffer");
+        }
+        frame.mapped = static_cast<GpuInstance*>(allocInfo.pMappedData);
+
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = pool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &setLayout;
+        if (vkAllocateDescriptorSets(device, &setInfo, &frame.set) != VK_SUCCESS) {
+            throw std::runtime_error("cannot allocate instance descriptor set");
+        }
+
+        VkDescriptorBufferInfo descInfo{frame.buffer, 0, VK_WHOLE_SIZE};
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &descInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+}
+
+void InstanceBuffer::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (auto& frame : frames) {
+        vmaDestroyBuffer(allocator, frame.buffer, frame.alloc);
+    }
+    frames.clear();
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+void InstanceBuffer::reset(uint32_t frameIndex) {
+    assert(frameIndex < frames.size());
+    frames[frameIndex].count = 0;
+}
+
+uint32_t InstanceBuffer::push(uint32_t frameIndex, const Mesh &mesh, std::span<const glm::mat4> models, uint32_t texture) {
+    assert(frameIndex < frames.size());
+    auto& frame = frames[frameIndex];
+    if (frame.count + models.size() > MAX_INSTANCES) {
+        throw std::runtime_error("too many instances in one frame");
+    }
+
+    // the draw itself carries index range and offsets, only the per instance fields matter here
+    const VertexDequantization dq = mesh.getDequantization();
+    const uint32_t first = frame.count;
+    for (const auto& model : models) {
+        GpuInstance& instance = frame.mapped[frame.count++];
+        instance.model = model;
+        instance.dqOffset = dq.offset;
+        instance.dqScale = dq.scale;
+        instance.texture = texture;
+    }
+    return first;
+}
+
+VkDescriptorSet InstanceBuffer::getSet(uint32_t frameIndex) const {
+    assert(frameIndex < frames.size());
+    return frames[frameIndex].set;
+}
+
+uint32_t InstanceBuffer::getCount(uint32_t frameIndex) const {
+    assert(frameIndex < frames.size());
+    return frames[frameIndex].count;
+}
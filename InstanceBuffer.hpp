@@ -0,0 +1,58 @@
+#ifndef STAR_INSTANCEBUFFER_HPP
+#define STAR_INSTANCEBUFFER_HPP
+
+#include "GpuCuller.hpp"
+#include "Mesh.hpp"
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// per frame ring of GpuInstance records for instanced draws, read by the same vertex shaders as
+// the gpu culling path through gl_InstanceIndex; a draw's firstInstance is its offset in the ring
+class InstanceBuffer {
+public:
+    static constexpr uint32_t MAX_INSTANCES = 1u << 16;
+
+    InstanceBuffer() = default;
+
+    ~InstanceBuffer() {
+        destroy();
+    }
+
+    InstanceBuffer(InstanceBuffer const&) = delete;
+    void operator=(InstanceBuffer const&) = delete;
+
+    // setLayout is set 1 of the indirect pipelines, only its instance binding is written here
+    void init(VkDevice dev, VmaAllocator alloc, uint32_t frames, VkDescriptorSetLayout setLayout);
+    void destroy();
+
+    // once the frame's fence has passed, before anything is pushed for it
+    void reset(uint32_t frame);
+    // copies one record per model into the frame's ring and returns the first one's index
+    uint32_t push(uint32_t frame, const Mesh& mesh, std::span<const glm::mat4> models, uint32_t texture = TextureTable::NO_TEXTURE);
+
+    [[nodiscard]] VkDescriptorSet getSet(uint32_t frame) const;
+    // records pushed for the frame so far
+    [[nodiscard]] uint32_t getCount(uint32_t frame) const;
+
+private:
+    struct FrameResources {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VmaAllocation alloc{VK_NULL_HANDLE};
+        GpuInstance* mapped{nullptr};
+        VkDescriptorSet set{VK_NULL_HANDLE};
+        uint32_t count{0};
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    std::vector<FrameResources> frames;
+};
+
+
+#endif //STAR_INSTANCEBUFFER_HPP
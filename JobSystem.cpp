@@ -0,0 +1,109 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+JobSystem &JobSystem::getInstance() {
+    static JobSystem jobSystem;
+
+    return jobSystem;
+}
+
+JobSystem::JobSystem() {
+    const size_t numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    workers.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t JobSystem::getNumWorkers() const {
+    return workers.size();
+}
+
+void JobSystem::enqueue(std::function<void()> job) {
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+}
+
+void JobSystem::workerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping && jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+
+    // helpers may start after the caller has already returned, so the state is shared
+    auto state = std::make_shared<State>();
+    const size_t total = count;
+    auto work = [state, total, fn]() {
+        for (size_t i = state->next++; i < total; i = state->next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard lock(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+
+            if (++state->done == total) {
+                std::lock_guard lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        enqueue(work);
+    }
+
+    // never block on the helpers themselves: if every worker is busy the caller finishes the range alone
+    work();
+
+    std::unique_lock lock(state->mutex);
+    state->cv.wait(lock, [&]() { return state->done == total; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
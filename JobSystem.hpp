@@ -0,0 +1,53 @@
+#ifndef STAR_JOBSYSTEM_HPP
+#define STAR_JOBSYSTEM_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed pool of worker threads shared by loaders and renderer helpers
+class JobSystem {
+public:
+    static JobSystem& getInstance();
+
+    ~JobSystem();
+
+    JobSystem(JobSystem const&) = delete;
+    void operator=(JobSystem const&) = delete;
+
+    template<typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        auto future = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return future;
+    }
+
+    // runs fn(i) for every i in [0, count); the caller takes part and returns once all are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    [[nodiscard]] size_t getNumWorkers() const;
+
+private:
+    JobSystem();
+
+    void enqueue(std::function<void()> job);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping{false};
+};
+
+
+#endif //STAR_JOBSYSTEM_HPP
@@ -0,0 +1,127 @@
+#include "LayoutCache.hpp"
+
+#include <stdexcept>
+
+void LayoutCache::init(VkDevice dev) {
+    device = dev;
+    hits = 0;
+}
+
+void LayoutCache::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (const auto& [key, layout] : pipelineLayouts) {
+        vkDestroyPipelineLayout(device, layout, nullptr);
+    }
+    for (const auto& [key, layout] : setLayouts) {
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    }
+    pipelineLayouts.clear();
+    setLayouts.clear();
+    device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSetLayout LayoutCache::getSetLayout(std::span<const VkDescriptorSetLayoutBinding> bindings,
+                                               std::span<const VkDescriptorBindingFlags> bindingFlags) {
+    if (!bindingFlags.empty() && bindingFlags.size() != bindings.size()) {
+        throw std::runtime_error("descriptor binding flags do not match the bindings");
+    }
+
+    // immutable samplers would need their handles in the key, nothing uses them
+    std::vector<uint64_t> key;
+    key.reserve(bindings.size() * 3);
+    VkDescriptorBindingFlags allFlags = 0;
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        const auto& binding = bindings[i];
+        const VkDescriptorBindingFlags flags = bindingFlags.empty() ? 0 : bindingFlags[i];
+        key.push_back((static_cast<uint64_t>(binding.binding) << 32) | static_cast<uint32_t>(binding.descriptorType));
+        key.push_back((static_cast<uint64_t>(binding.descriptorCount) << 32) | binding.stageFlags);
+        key.push_back(flags);
+        allFlags |= flags;
+    }
+
+    if (const auto it = setLayouts.find(key); it != setLayouts.end()) {
+        ++hits;
+        return it->second;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    flagsInfo.pBindingFlags = bindingFlags.data();
+    if (allFlags) {
+        layoutInfo.pNext = &flagsInfo;
+    }
+    if (allFlags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+        layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+
+    VkDescriptorSetLayout layout{VK_NULL_HANDLE};
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create descriptor set layout");
+    }
+    setLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+VkPipelineLayout LayoutCache::getPipelineLayout(std::span<const VkDescriptorSetLayout> sets, std::span<const VkPushConstantRange> ranges) {
+    // set layouts come from this cache or live as long as it, so their handles are their identity
+    std::vector<uint64_t> key;
+    key.reserve(sets.size() + ranges.size() * 2 + 1);
+    key.push_back(sets.size());
+    for (const auto set : sets) {
+        key.push_back(reinterpret_cast<uint64_t>(set));
+    }
+    for (const auto& range : ranges) {
+        key.push_back(range.stageFlags);
+        key.push_back((static_cast<uint64_t>(range.offset) << 32) | range.size);
+    }
+
+    if (const auto it = pipelineLayouts.find(key); it != pipelineLayouts.end()) {
+        ++hits;
+        return it->second;
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(sets.size());
+    pipelineLayoutInfo.pSetLayouts = sets.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
+    pipelineLayoutInfo.pPushConstantRanges = ranges.data();
+
+    VkPipelineLayout layout{VK_NULL_HANDLE};
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create pipeline layout");
+    }
+    pipelineLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+VkPipelineLayout LayoutCache::getPipelineLayout(const ShaderReflection &reflection) {
+    std::vector<VkDescriptorSetLayout> sets(reflection.getSetCount());
+    for (uint32_t s = 0; s < sets.size(); ++s) {
+        const auto bindings = reflection.getSet(s);
+        sets[s] = getSetLayout(bindings);
+    }
+    const auto ranges = reflection.getPushConstantRanges();
+    return getPipelineLayout(sets, ranges);
+}
+
+size_t LayoutCache::getSetLayoutCount() const {
+    return setLayouts.size();
+}
+
+size_t LayoutCache::getPipelineLayoutCount() const {
+    return pipelineLayouts.size();
+}
+
+uint32_t LayoutCache::getHits() const {
+    return hits;
+}
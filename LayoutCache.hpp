@@ -0,0 +1,53 @@
+#ifndef STAR_LAYOUTCACHE_HPP
+#define STAR_LAYOUTCACHE_HPP
+
+#include "Hash.hpp"
+#include "ShaderReflection.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// descriptor set and pipeline layouts keyed by their signature: asking twice for the same bindings
+// or the same sets and push constants returns the same handle. the cache owns every layout it hands
+// out, callers never destroy them
+class LayoutCache {
+public:
+    LayoutCache() = default;
+
+    ~LayoutCache() {
+        destroy();
+    }
+
+    LayoutCache(LayoutCache const&) = delete;
+    void operator=(LayoutCache const&) = delete;
+
+    void init(VkDevice dev);
+    void destroy();
+
+    // bindingFlags is empty or has one entry per binding; update after bind flags make the layout
+    // one for update after bind pools
+    VkDescriptorSetLayout getSetLayout(std::span<const VkDescriptorSetLayoutBinding> bindings,
+                                       std::span<const VkDescriptorBindingFlags> bindingFlags = {});
+    VkPipelineLayout getPipelineLayout(std::span<const VkDescriptorSetLayout> setLayouts, std::span<const VkPushConstantRange> ranges);
+    // every set the reflection uses, with empty layouts for the gaps
+    VkPipelineLayout getPipelineLayout(const ShaderReflection& reflection);
+
+    [[nodiscard]] size_t getSetLayoutCount() const;
+    [[nodiscard]] size_t getPipelineLayoutCount() const;
+    // requests answered with an existing layout
+    [[nodiscard]] uint32_t getHits() const;
+
+private:
+    VkDevice device{VK_NULL_HANDLE};
+    std::unordered_map<std::vector<uint64_t>, VkDescriptorSetLayout, WordsHash> setLayouts;
+    std::unordered_map<std::vector<uint64_t>, VkPipelineLayout, WordsHash> pipelineLayouts;
+    uint32_t hits{0};
+};
+
+
+#endif //STAR_LAYOUTCACHE_HPP
@@ -5,20 +5,16 @@
 #include "Mesh.hpp"
 #include "Screen.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <utility>
 
-void Mesh::createBuffers() {
-    if (allocated) {
-        return;
-    }
-
-    auto& screen = Screen::getInstance();
-    assert(screen.getAllocator());
-
+static ArenaRange createHostVisibleBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocation* alloc) {
     VkBufferCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    info.size = sizeof(vertices[0]) * vertices.size();
-    info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    info.size = size;
+    info.usage = usage;
     info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VmaAllocationCreateInfo vmaInfo{};
@@ -26,23 +22,29 @@ void Mesh::createBuffers() {
     vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
     vmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    if (vmaCreateBuffer(screen.getAllocator(), &info, &vmaInfo, &vertexBuffer, &vertexBufferAlloc, nullptr) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create vertex buffer");
+    ArenaRange range{};
+    range.size = size;
+    if (vmaCreateBuffer(Screen::getInstance().getAllocator(), &info, &vmaInfo, &range.buffer, alloc, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error(usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT ? "cannot create vertex buffer" : "cannot create index buffer");
     }
+    return range;
+}
 
-    VkBufferCreateInfo iInfo{};
-    iInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    iInfo.size = sizeof(indices[0]) * indices.size();
-    iInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void Mesh::createBuffers(BufferPlacement where) {
+    if (allocated) {
+        return;
+    }
 
-    VmaAllocationCreateInfo  iVmaInfo{};
-    iVmaInfo.usage = VMA_MEMORY_USAGE_AUTO;
-    iVmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
-    iVmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    auto& screen = Screen::getInstance();
+    assert(screen.getAllocator());
 
-    if (vmaCreateBuffer(screen.getAllocator(), &iInfo, &iVmaInfo, &indexBuffer, &indexBufferAlloc, nullptr) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create index buffer");
+    placement = where;
+    if (placement == BufferPlacement::DeviceLocal) {
+        vertexRange = screen.getGeometryArena().allocateVertices(vertexFormat, getVertexData().size_bytes());
+        indexRange = screen.getGeometryArena().allocateIndices(indexType, getIndexData().size_bytes());
+    } else {
+        vertexRange = createHostVisibleBuffer(getVertexData().size_bytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vertexBufferAlloc);
+        indexRange = createHostVisibleBuffer(getIndexData().size_bytes(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indexBufferAlloc);
     }
 
     allocated = true;
@@ -56,28 +58,77 @@ void Mesh::destroy() {
     auto& screen = Screen::getInstance();
     assert(screen.getAllocator());
 
-    vkDeviceWaitIdle(screen.getDevice());
-    vmaDestroyBuffer(screen.getAllocator(), vertexBuffer, vertexBufferAlloc);
-    vmaDestroyBuffer(screen.getAllocator(), indexBuffer, indexBufferAlloc);
+    // frames in flight and staged copies may still use the ranges, they are freed once those are done
+    if (placement == BufferPlacement::DeviceLocal) {
+        screen.deferRelease([format = vertexFormat, type = indexType, vertices = vertexRange, indices = indexRange] {
+            auto& arena = Screen::getInstance().getGeometryArena();
+            arena.freeVertices(format, vertices);
+            arena.freeIndices(type, indices);
+        });
+    } else {
+        screen.deferRelease([vertices = vertexRange.buffer, vertexAlloc = vertexBufferAlloc, indices = indexRange.buffer, indexAlloc = indexBufferAlloc] {
+            auto allocator = Screen::getInstance().getAllocator();
+            vmaDestroyBuffer(allocator, vertices, vertexAlloc);
+            vmaDestroyBuffer(allocator, indices, indexAlloc);
+        });
+    }
+    vertexBufferAlloc = VK_NULL_HANDLE;
+    indexBufferAlloc = VK_NULL_HANDLE;
+    vertexRange = {};
+    indexRange = {};
 
     allocated = false;
 }
 
 void Mesh::upload() {
     assert(allocated);
+    if (cpuDataReleased) {
+        throw std::runtime_error("cannot upload a mesh whose cpu data was released");
+    }
 
     auto& screen = Screen::getInstance();
     assert(screen.getAllocator());
 
-    if (vmaCopyMemoryToAllocation(screen.getAllocator(), vertices.data(), vertexBufferAlloc, 0, sizeof(vertices[0]) * vertices.size()) != VK_SUCCESS) {
+    const auto verts = getVertexData();
+    const auto idcs = getIndexData();
+
+    if (placement == BufferPlacement::DeviceLocal) {
+        screen.getUploadEngine().enqueue(vertexRange.buffer, vertexRange.offset, verts);
+        screen.getUploadEngine().enqueue(indexRange.buffer, indexRange.offset, idcs);
+        return;
+    }
+
+    if (vmaCopyMemoryToAllocation(screen.getAllocator(), verts.data(), vertexBufferAlloc, 0, verts.size_bytes()) != VK_SUCCESS) {
         throw std::runtime_error("cannot upload mesh vertices");
     };
 
-    if (vmaCopyMemoryToAllocation(screen.getAllocator(), indices.data(), indexBufferAlloc, 0, sizeof(indices[0]) * indices.size()) != VK_SUCCESS) {
+    if (vmaCopyMemoryToAllocation(screen.getAllocator(), idcs.data(), indexBufferAlloc, 0, idcs.size_bytes()) != VK_SUCCESS) {
         throw std::runtime_error("cannot upload mesh indices");
     }
 }
 
+void Mesh::releaseCpuData() {
+    // host visible meshes are written in place and keep their source
+    if (!allocated || placement != BufferPlacement::DeviceLocal || cpuDataReleased) {
+        return;
+    }
+
+    // the upload engine copied everything into staging on enqueue, nothing points back here
+    releasedIndexCount = getNumIndices();
+    std::vector<Vertex>().swap(vertices);
+    std::vector<CompactVertex>().swap(compactVertices);
+    std::vector<std::byte>().swap(indices);
+    mappedVertices = {};
+    mappedCompactVertices = {};
+    mappedIndices = {};
+    mapping.reset();
+    cpuDataReleased = true;
+}
+
+bool Mesh::hasCpuData() const {
+    return !cpuDataReleased;
+}
+
 Mesh Mesh::triangle() {
     Mesh mesh;
     std::vector<Vertex> vertices = {
@@ -87,10 +138,10 @@ Mesh Mesh::triangle() {
     };
     mesh.setVertices(vertices);
 
-    std::vector<uint16_t> indices = {
+    std::vector<uint32_t> indices = {
             0, 1, 2
     };
-    mesh.setIndices(indices);
+    mesh.setIndices(indices, chooseIndexType(vertices.size(), Screen::getInstance().supportsUint8Indices()));
 
     mesh.createBuffers();
     mesh.upload();
@@ -99,37 +150,234 @@ Mesh Mesh::triangle() {
 }
 
 void Mesh::setVertices(std::vector<Vertex> verts) {
+    detachMapping();
+    vertexFormat = VertexFormat::Standard;
+    dequantization = {};
     vertices = std::move(verts);
+    compactVertices.clear();
 }
 
-void Mesh::draw(VkCommandBuffer cb) {
+void Mesh::setCompactVertices(std::vector<CompactVertex> verts, VertexDequantization dq) {
+    detachMapping();
+    vertexFormat = VertexFormat::Compact;
+    dequantization = dq;
+    compactVertices = std::move(verts);
+    vertices.clear();
+}
+
+void Mesh::compress() {
+    if (vertexFormat == VertexFormat::Compact) {
+        return;
+    }
+
+    const auto verts = getVertices();
+    const auto dq = Vertex::computeDequantization(verts);
+    setCompactVertices(Vertex::compress(verts, dq), dq);
+}
+
+void Mesh::draw(VkCommandBuffer cb, uint32_t lod) {
     assert(allocated);
     assert(cb);
 
-    VkBuffer vertexBuffers[] = {vertexBuffer};
+    VkBuffer vertexBuffers[] = {vertexRange.buffer};
     VkDeviceSize offsets[] = {0};
 
     vkCmdBindVertexBuffers(cb, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(cb, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindIndexBuffer(cb, indexRange.buffer, 0, indexType);
 
 //    vkCmdDraw(cb, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-    vkCmdDrawIndexed(cb, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    const MeshLod level = getLod(lod);
+    vkCmdDrawIndexed(cb, level.indexCount, 1, getFirstIndex() + level.firstIndex, getVertexOffset(), 0);
+}
+
+template<typename T>
+static void packIndices(std::span<const uint32_t> in, std::byte* out) {
+    for (size_t i = 0; i < in.size(); ++i) {
+        assert(in[i] <= std::numeric_limits<T>::max());
+        const auto v = static_cast<T>(in[i]);
+        std::memcpy(out + i * sizeof(T), &v, sizeof(T));
+    }
+}
+
+template<typename T>
+static void unpackIndices(std::span<const std::byte> in, uint32_t* out) {
+    for (size_t i = 0; i < in.size() / sizeof(T); ++i) {
+        T v;
+        std::memcpy(&v, in.data() + i * sizeof(T), sizeof(T));
+        out[i] = v;
+    }
+}
+
+void Mesh::setIndices(std::span<const uint32_t> idcs, VkIndexType type) {
+    detachMapping();
+    indexType = type;
+    indices.resize(idcs.size() * getIndexSize(type));
+    switch (type) {
+        case VK_INDEX_TYPE_UINT8_EXT:
+            packIndices<uint8_t>(idcs, indices.data());
+            break;
+        case VK_INDEX_TYPE_UINT16:
+            packIndices<uint16_t>(idcs, indices.data());
+            break;
+        default:
+            packIndices<uint32_t>(idcs, indices.data());
+            break;
+    }
+}
+
+void Mesh::setIndexType(VkIndexType type) {
+    if (type != indexType) {
+        setIndices(decodeIndices(), type);
+    }
 }
 
-void Mesh::setIndices(std::vector<uint16_t> idcs) {
-    indices = std::move(idcs);
+std::vector<uint32_t> Mesh::decodeIndices() const {
+    const auto data = getIndexData();
+    std::vector<uint32_t> out(data.size() / getIndexSize(indexType));
+    switch (indexType) {
+        case VK_INDEX_TYPE_UINT8_EXT:
+            unpackIndices<uint8_t>(data, out.data());
+            break;
+        case VK_INDEX_TYPE_UINT16:
+            unpackIndices<uint16_t>(data, out.data());
+            break;
+        default:
+            unpackIndices<uint32_t>(data, out.data());
+            break;
+    }
+    return out;
+}
+
+VkIndexType Mesh::chooseIndexType(size_t vertexCount, bool allowUint8) {
+    // primitive restart is never enabled, so the all-ones value is a usable index
+    if (allowUint8 && vertexCount <= (1u << 8)) {
+        return VK_INDEX_TYPE_UINT8_EXT;
+    }
+    if (vertexCount <= (1u << 16)) {
+        return VK_INDEX_TYPE_UINT16;
+    }
+    return VK_INDEX_TYPE_UINT32;
+}
+
+uint32_t Mesh::getIndexSize(VkIndexType type) {
+    switch (type) {
+        case VK_INDEX_TYPE_UINT8_EXT:
+            return 1;
+        case VK_INDEX_TYPE_UINT16:
+            return 2;
+        case VK_INDEX_TYPE_UINT32:
+            return 4;
+        default:
+            throw std::runtime_error("unsupported index type");
+    }
+}
+
+void Mesh::setMappedData(std::shared_ptr<const void> owner, std::span<const Vertex> verts, std::span<const std::byte> idcs, VkIndexType type) {
+    vertices.clear();
+    compactVertices.clear();
+    indices.clear();
+    vertexFormat = VertexFormat::Standard;
+    dequantization = {};
+    indexType = type;
+    mapping = std::move(owner);
+    mappedVertices = verts;
+    mappedCompactVertices = {};
+    mappedIndices = idcs;
+}
+
+void Mesh::setMappedData(std::shared_ptr<const void> owner, std::span<const CompactVertex> verts, VertexDequantization dq, std::span<const std::byte> idcs, VkIndexType type) {
+    vertices.clear();
+    compactVertices.clear();
+    indices.clear();
+    vertexFormat = VertexFormat::Compact;
+    dequantization = dq;
+    indexType = type;
+    mapping = std::move(owner);
+    mappedVertices = {};
+    mappedCompactVertices = verts;
+    mappedIndices = idcs;
+}
+
+void Mesh::detachMapping() {
+    if (!mapping) {
+        return;
+    }
+
+    // keep whichever half is not being replaced
+    vertices.assign(mappedVertices.begin(), mappedVertices.end());
+    compactVertices.assign(mappedCompactVertices.begin(), mappedCompactVertices.end());
+    indices.assign(mappedIndices.begin(), mappedIndices.end());
+    mappedVertices = {};
+    mappedCompactVertices = {};
+    mappedIndices = {};
+    mapping.reset();
+}
+
+VertexFormat Mesh::getVertexFormat() const {
+    return vertexFormat;
+}
+
+VertexDequantization Mesh::getDequantization() const {
+    return dequantization;
+}
+
+std::span<const std::byte> Mesh::getVertexData() const {
+    if (vertexFormat == VertexFormat::Compact) {
+        return std::as_bytes(getCompactVertices());
+    }
+    return std::as_bytes(getVertices());
+}
+
+std::span<const CompactVertex> Mesh::getCompactVertices() const {
+    if (mapping) {
+        return mappedCompactVertices;
+    }
+    return compactVertices;
+}
+
+std::span<const Vertex> Mesh::getVertices() const {
+    if (mapping) {
+        return mappedVertices;
+    }
+    return vertices;
+}
+
+VkIndexType Mesh::getIndexType() const {
+    return indexType;
+}
+
+std::span<const std::byte> Mesh::getIndexData() const {
+    if (mapping) {
+        return mappedIndices;
+    }
+    return indices;
 }
 
 VkBuffer Mesh::getVertexBuffer() const {
-    return vertexBuffer;
+    return vertexRange.buffer;
 }
 
 VkBuffer Mesh::getIndexBuffer() const {
-    return indexBuffer;
+    return indexRange.buffer;
+}
+
+int32_t Mesh::getVertexOffset() const {
+    return static_cast<int32_t>(vertexRange.offset / Vertex::getStride(vertexFormat));
+}
+
+uint32_t Mesh::getFirstIndex() const {
+    return static_cast<uint32_t>(indexRange.offset / getIndexSize(indexType));
+}
+
+VkDeviceSize Mesh::getMemorySize() const {
+    return vertexRange.size + indexRange.size;
 }
 
 uint32_t Mesh::getNumIndices() const {
-    return static_cast<uint32_t>(indices.size());
+    if (cpuDataReleased) {
+        return releasedIndexCount;
+    }
+    return static_cast<uint32_t>(getIndexData().size() / getIndexSize(indexType));
 }
 
 Mesh Mesh::square() {
@@ -142,14 +390,86 @@ Mesh Mesh::square() {
     };
     mesh.setVertices(vertices);
 
-    std::vector<uint16_t> indices = {
+    std::vector<uint32_t> indices = {
             0, 1, 2,
             2, 3, 0
     };
-    mesh.setIndices(indices);
+    mesh.setIndices(indices, chooseIndexType(vertices.size(), Screen::getInstance().supportsUint8Indices()));
 
     mesh.createBuffers();
     mesh.upload();
 
     return mesh;
 }
+
+void Mesh::setLods(std::vector<MeshLod> levels) {
+    lods = std::move(levels);
+}
+
+uint32_t Mesh::getNumLods() const {
+    return lods.empty() ? 1 : static_cast<uint32_t>(lods.size());
+}
+
+MeshLod Mesh::getLod(uint32_t level) const {
+    if (lods.empty()) {
+        return MeshLod{0, getNumIndices(), 0.0f};
+    }
+
+    return lods[std::min<size_t>(level, lods.size() - 1)];
+}
+
+std::span<const MeshLod> Mesh::getLods() const {
+    return lods;
+}
+
+void Mesh::setMeshlets(std::vector<Meshlet> clusters) {
+    meshlets = std::move(clusters);
+}
+
+std::span<const Meshlet> Mesh::getMeshlets() const {
+    return meshlets;
+}
+
+void Mesh::setBoundingSphere(glm::vec4 sphere) {
+    boundingSphere = sphere;
+}
+
+glm::vec4 Mesh::getBoundingSphere() const {
+    return boundingSphere;
+}
+
+glm::vec4 Mesh::computeBoundingSphere(std::span<const Vertex> verts) {
+    if (verts.empty()) {
+        return glm::vec4(0.0f);
+    }
+
+    const BoundingBox box = computeBoundingBox(verts);
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& v : verts) {
+        radius = std::max(radius, glm::distance(center, v.pos));
+    }
+
+    return glm::vec4(center, radius);
+}
+
+void Mesh::setBoundingBox(BoundingBox box) {
+    boundingBox = box;
+}
+
+BoundingBox Mesh::getBoundingBox() const {
+    return boundingBox;
+}
+
+BoundingBox Mesh::computeBoundingBox(std::span<const Vertex> verts) {
+    if (verts.empty()) {
+        return {};
+    }
+
+    BoundingBox box{verts[0].pos, verts[0].pos};
+    for (const auto& v : verts) {
+        box.min = glm::min(box.min, v.pos);
+        box.max = glm::max(box.max, v.pos);
+    }
+    return box;
+}
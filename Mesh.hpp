@@ -6,39 +6,135 @@
 #define STAR_MESH_HPP
 
 #include "Vertex.hpp"
+#include "Meshlet.hpp"
+#include "GeometryArena.hpp"
 
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// a range of the shared index buffer, level 0 is the full resolution mesh
+struct MeshLod {
+    uint32_t firstIndex{0};
+    uint32_t indexCount{0};
+    float error{0.0f}; // object space simplification error
+};
+
+// object space axis aligned bounds
+struct BoundingBox {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+};
+
+// where vertex and index buffers live; device local meshes are sub-allocated from the shared
+// geometry arena and filled through the upload engine, host visible meshes get buffers of their
+// own that are written in place and suit data that changes every frame
+enum class BufferPlacement {
+    DeviceLocal,
+    HostVisible,
+};
 
 class Mesh {
 public:
     Mesh() = default;
     ~Mesh() = default;
 
-    void createBuffers();
+    void createBuffers(BufferPlacement where = BufferPlacement::DeviceLocal);
     void setVertices(std::vector<Vertex> verts);
-    void setIndices(std::vector<uint16_t> idcs);
+    void setCompactVertices(std::vector<CompactVertex> verts, VertexDequantization dq);
+    // quantize the current vertices into the compact layout relative to their bounds
+    void compress();
+    // stores the indices at the given width, every index must fit
+    void setIndices(std::span<const uint32_t> idcs, VkIndexType type);
+    // re-encodes the current indices at another width
+    void setIndexType(VkIndexType type);
+    // point the mesh at externally owned data (e.g. a mapped cache file); owner keeps it alive
+    void setMappedData(std::shared_ptr<const void> owner, std::span<const Vertex> verts, std::span<const std::byte> idcs, VkIndexType type);
+    void setMappedData(std::shared_ptr<const void> owner, std::span<const CompactVertex> verts, VertexDequantization dq, std::span<const std::byte> idcs, VkIndexType type);
+    // index buffer holds every level back to back; without lods the whole buffer is level 0
+    void setLods(std::vector<MeshLod> levels);
+    void setBoundingSphere(glm::vec4 sphere);
+    void setBoundingBox(BoundingBox box);
+    // clusters partition the level 0 index range
+    void setMeshlets(std::vector<Meshlet> clusters);
     void upload();
+    // drops the vertex and index arrays (or the cache mapping) of an uploaded device local mesh;
+    // draws keep working, anything reading the geometry back sees empty spans
+    void releaseCpuData();
+    [[nodiscard]] bool hasCpuData() const;
     void destroy();
-    void draw(VkCommandBuffer cb);
+    void draw(VkCommandBuffer cb, uint32_t lod = 0);
+
+    // narrowest index type that can address vertexCount vertices
+    static VkIndexType chooseIndexType(size_t vertexCount, bool allowUint8);
+    static uint32_t getIndexSize(VkIndexType type);
 
     static Mesh triangle();
     static Mesh square();
 
     [[nodiscard]] VkBuffer getVertexBuffer() const;
     [[nodiscard]] VkBuffer getIndexBuffer() const;
+    // where the mesh starts inside its (possibly shared) buffers, in vertices and indices
+    [[nodiscard]] int32_t getVertexOffset() const;
+    [[nodiscard]] uint32_t getFirstIndex() const;
+
+    // bytes of vertex and index buffer this mesh occupies, 0 until createBuffers
+    [[nodiscard]] VkDeviceSize getMemorySize() const;
 
     [[nodiscard]] uint32_t getNumIndices() const;
+    [[nodiscard]] uint32_t getNumLods() const;
+    [[nodiscard]] MeshLod getLod(uint32_t level) const;
+    [[nodiscard]] std::span<const MeshLod> getLods() const;
+    [[nodiscard]] std::span<const Meshlet> getMeshlets() const;
+
+    // xyz center, w radius, in object space
+    [[nodiscard]] glm::vec4 getBoundingSphere() const;
+    static glm::vec4 computeBoundingSphere(std::span<const Vertex> verts);
+    [[nodiscard]] BoundingBox getBoundingBox() const;
+    static BoundingBox computeBoundingBox(std::span<const Vertex> verts);
+
+    [[nodiscard]] VertexFormat getVertexFormat() const;
+    [[nodiscard]] VertexDequantization getDequantization() const;
+    // raw vertex buffer contents in whichever format the mesh uses
+    [[nodiscard]] std::span<const std::byte> getVertexData() const;
+    // empty unless the mesh is in that format
+    [[nodiscard]] std::span<const Vertex> getVertices() const;
+    [[nodiscard]] std::span<const CompactVertex> getCompactVertices() const;
+    [[nodiscard]] VkIndexType getIndexType() const;
+    // raw index buffer contents at getIndexType() width
+    [[nodiscard]] std::span<const std::byte> getIndexData() const;
+    // indices widened back to 32 bit
+    [[nodiscard]] std::vector<uint32_t> decodeIndices() const;
 
 private:
+    void detachMapping();
+
+    VertexFormat vertexFormat{VertexFormat::Standard};
+    VertexDequantization dequantization{};
     std::vector<Vertex> vertices;
-    std::vector<uint16_t> indices;
-    VkBuffer vertexBuffer;
-    VmaAllocation vertexBufferAlloc;
-    VkBuffer indexBuffer;
-    VmaAllocation indexBufferAlloc;
+    std::vector<CompactVertex> compactVertices;
+    BufferPlacement placement{BufferPlacement::DeviceLocal};
+    VkIndexType indexType{VK_INDEX_TYPE_UINT16};
+    std::vector<std::byte> indices;
+    std::shared_ptr<const void> mapping;
+    std::span<const Vertex> mappedVertices;
+    std::span<const CompactVertex> mappedCompactVertices;
+    std::span<const std::byte> mappedIndices;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    glm::vec4 boundingSphere{0.0f};
+    BoundingBox boundingBox{};
+    bool cpuDataReleased{false};
+    uint32_t releasedIndexCount{0};
+    ArenaRange vertexRange{};
+    ArenaRange indexRange{};
+    VmaAllocation vertexBufferAlloc{VK_NULL_HANDLE};
+    VmaAllocation indexBufferAlloc{VK_NULL_HANDLE};
     bool allocated{false};
 };
 
@@ -0,0 +1,263 @@
+#include "MeshCache.hpp"
+#include "AtomicFile.hpp"
+#include "Hash.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+static constexpr std::array<char, 8> CACHE_MAGIC = {'S', 'T', 'A', 'R', 'M', 'S', 'H', '\0'};
+static constexpr uint32_t CACHE_VERSION = 7;
+static constexpr uint64_t CACHE_ALIGNMENT = 16;
+
+struct CacheHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t importFlags;
+    uint64_t sourceHash;
+    uint32_t vertexStride;
+    uint32_t loaderOptions;
+    uint64_t meshCount;
+};
+
+struct CacheMeshRecord {
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t lodOffset;
+    uint64_t lodCount;
+    uint64_t meshletOffset;
+    uint64_t meshletCount;
+    uint32_t vertexFormat;
+    uint32_t indexType;
+    float boundingSphere[4];
+    float boundingBox[6];
+    float dequantization[8];
+};
+
+static uint64_t alignUp(uint64_t v, uint64_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+MappedFile::MappedFile(const std::string &fn) {
+    const int fd = open(fn.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + fn);
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat " + fn);
+    }
+
+    void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        throw std::runtime_error("cannot map " + fn);
+    }
+
+    base = static_cast<const std::byte*>(ptr);
+    length = static_cast<size_t>(st.st_size);
+}
+
+MappedFile::~MappedFile() {
+    if (base) {
+        munmap(const_cast<std::byte*>(base), length);
+    }
+}
+
+MeshCache &MeshCache::getInstance() {
+    static MeshCache cache;
+
+    return cache;
+}
+
+uint64_t MeshCache::hashSource(const std::string &fn) {
+    std::ifstream in(fn, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot open model file " + fn);
+    }
+
+    Fnv1a hash;
+    std::array<char, 1 << 16> buffer{};
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        hash.bytes(buffer.data(), static_cast<size_t>(in.gcount()));
+    }
+
+    return hash.get();
+}
+
+std::string MeshCache::cachePath(const std::string &fn, uint32_t importFlags, uint32_t loaderOptions) {
+    std::ostringstream path;
+    path << fn << '.' << std::hex << std::setfill('0') << std::setw(8) << importFlags << '-' << std::setw(8) << loaderOptions << ".starmesh";
+    return path.str();
+}
+
+std::optional<std::vector<Mesh>> MeshCache::load(const std::string &fn, uint64_t sourceHash, uint32_t importFlags, uint32_t loaderOptions) {
+    const auto path = cachePath(fn, importFlags, loaderOptions);
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(path);
+    } catch (const std::runtime_error& e) {
+        std::cout << "warning: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+
+    if (file->size() < sizeof(CacheHeader)) {
+        return std::nullopt;
+    }
+
+    CacheHeader header{};
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION ||
+        header.importFlags != importFlags ||
+        header.loaderOptions != loaderOptions ||
+        header.sourceHash != sourceHash ||
+        header.vertexStride != sizeof(Vertex)) {
+        return std::nullopt;
+    }
+
+    const uint64_t recordsEnd = sizeof(CacheHeader) + header.meshCount * sizeof(CacheMeshRecord);
+    if (header.meshCount > file->size() || recordsEnd > file->size()) {
+        return std::nullopt;
+    }
+
+    const auto* records = reinterpret_cast<const CacheMeshRecord*>(file->data() + sizeof(CacheHeader));
+    std::vector<Mesh> meshes(header.meshCount);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const auto& rec = records[i];
+        if (rec.vertexFormat != static_cast<uint32_t>(VertexFormat::Standard) && rec.vertexFormat != static_cast<uint32_t>(VertexFormat::Compact)) {
+            return std::nullopt;
+        }
+        if (rec.indexType != VK_INDEX_TYPE_UINT8_EXT && rec.indexType != VK_INDEX_TYPE_UINT16 && rec.indexType != VK_INDEX_TYPE_UINT32) {
+            return std::nullopt;
+        }
+
+        const auto format = static_cast<VertexFormat>(rec.vertexFormat);
+        const auto indexType = static_cast<VkIndexType>(rec.indexType);
+        const uint64_t vertexEnd = rec.vertexOffset + rec.vertexCount * Vertex::getStride(format);
+        const uint64_t indexEnd = rec.indexOffset + rec.indexCount * Mesh::getIndexSize(indexType);
+        const uint64_t lodEnd = rec.lodOffset + rec.lodCount * sizeof(MeshLod);
+        const uint64_t meshletEnd = rec.meshletOffset + rec.meshletCount * sizeof(Meshlet);
+        if (vertexEnd > file->size() || indexEnd > file->size() || lodEnd > file->size() || meshletEnd > file->size() ||
+            rec.vertexOffset % CACHE_ALIGNMENT != 0 || rec.indexOffset % CACHE_ALIGNMENT != 0 ||
+            rec.lodOffset % CACHE_ALIGNMENT != 0 || rec.meshletOffset % CACHE_ALIGNMENT != 0) {
+            return std::nullopt;
+        }
+
+        const std::span<const std::byte> idcs(file->data() + rec.indexOffset, rec.indexCount * Mesh::getIndexSize(indexType));
+        const auto* lods = reinterpret_cast<const MeshLod*>(file->data() + rec.lodOffset);
+        if (format == VertexFormat::Compact) {
+            const auto* verts = reinterpret_cast<const CompactVertex*>(file->data() + rec.vertexOffset);
+            VertexDequantization dq{};
+            dq.offset = glm::vec4(rec.dequantization[0], rec.dequantization[1], rec.dequantization[2], rec.dequantization[3]);
+            dq.scale = glm::vec4(rec.dequantization[4], rec.dequantization[5], rec.dequantization[6], rec.dequantization[7]);
+            meshes[i].setMappedData(file, {verts, rec.vertexCount}, dq, idcs, indexType);
+        } else {
+            const auto* verts = reinterpret_cast<const Vertex*>(file->data() + rec.vertexOffset);
+            meshes[i].setMappedData(file, {verts, rec.vertexCount}, idcs, indexType);
+        }
+        const auto* clusters = reinterpret_cast<const Meshlet*>(file->data() + rec.meshletOffset);
+        meshes[i].setLods(std::vector<MeshLod>(lods, lods + rec.lodCount));
+        meshes[i].setMeshlets(std::vector<Meshlet>(clusters, clusters + rec.meshletCount));
+        meshes[i].setBoundingSphere(glm::vec4(rec.boundingSphere[0], rec.boundingSphere[1], rec.boundingSphere[2], rec.boundingSphere[3]));
+        meshes[i].setBoundingBox({glm::vec3(rec.boundingBox[0], rec.boundingBox[1], rec.boundingBox[2]),
+                                  glm::vec3(rec.boundingBox[3], rec.boundingBox[4], rec.boundingBox[5])});
+    }
+
+    return meshes;
+}
+
+void MeshCache::store(const std::string &fn, uint64_t sourceHash, uint32_t importFlags, uint32_t loaderOptions, const std::vector<Mesh> &meshes) {
+    CacheHeader header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.importFlags = importFlags;
+    header.loaderOptions = loaderOptions;
+    header.sourceHash = sourceHash;
+    header.vertexStride = sizeof(Vertex);
+    header.meshCount = meshes.size();
+
+    std::vector<CacheMeshRecord> records(meshes.size());
+    uint64_t offset = alignUp(sizeof(CacheHeader) + records.size() * sizeof(CacheMeshRecord), CACHE_ALIGNMENT);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const auto format = meshes[i].getVertexFormat();
+        records[i].vertexFormat = static_cast<uint32_t>(format);
+        records[i].vertexOffset = offset;
+        records[i].vertexCount = meshes[i].getVertexData().size_bytes() / Vertex::getStride(format);
+        offset = alignUp(offset + meshes[i].getVertexData().size_bytes(), CACHE_ALIGNMENT);
+
+        records[i].indexType = meshes[i].getIndexType();
+        records[i].indexOffset = offset;
+        records[i].indexCount = meshes[i].getNumIndices();
+        offset = alignUp(offset + meshes[i].getIndexData().size_bytes(), CACHE_ALIGNMENT);
+
+        records[i].lodOffset = offset;
+        records[i].lodCount = meshes[i].getLods().size();
+        offset = alignUp(offset + meshes[i].getLods().size_bytes(), CACHE_ALIGNMENT);
+
+        records[i].meshletOffset = offset;
+        records[i].meshletCount = meshes[i].getMeshlets().size();
+        offset = alignUp(offset + meshes[i].getMeshlets().size_bytes(), CACHE_ALIGNMENT);
+
+        const glm::vec4 sphere = meshes[i].getBoundingSphere();
+        records[i].boundingSphere[0] = sphere.x;
+        records[i].boundingSphere[1] = sphere.y;
+        records[i].boundingSphere[2] = sphere.z;
+        records[i].boundingSphere[3] = sphere.w;
+
+        const BoundingBox box = meshes[i].getBoundingBox();
+        for (glm::length_t k = 0; k < 3; ++k) {
+            records[i].boundingBox[k] = box.min[k];
+            records[i].boundingBox[3 + k] = box.max[k];
+        }
+
+        const VertexDequantization dq = meshes[i].getDequantization();
+        for (glm::length_t k = 0; k < 4; ++k) {
+            records[i].dequantization[k] = dq.offset[k];
+            records[i].dequantization[4 + k] = dq.scale[k];
+        }
+    }
+
+    // loads of the same model may run on several workers and processes at once
+    writeFileAtomic(cachePath(fn, importFlags, loaderOptions), "mesh cache", [&](std::ostream& out) {
+        const std::array<char, CACHE_ALIGNMENT> zeros{};
+        const auto pad = [&]() {
+            const auto pos = static_cast<uint64_t>(out.tellp());
+            out.write(zeros.data(), static_cast<std::streamsize>(alignUp(pos, CACHE_ALIGNMENT) - pos));
+        };
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(CacheMeshRecord)));
+        pad();
+        for (const auto& mesh : meshes) {
+            out.write(reinterpret_cast<const char*>(mesh.getVertexData().data()), static_cast<std::streamsize>(mesh.getVertexData().size_bytes()));
+            pad();
+            out.write(reinterpret_cast<const char*>(mesh.getIndexData().data()), static_cast<std::streamsize>(mesh.getIndexData().size_bytes()));
+            pad();
+            out.write(reinterpret_cast<const char*>(mesh.getLods().data()), static_cast<std::streamsize>(mesh.getLods().size_bytes()));
+            pad();
+            out.write(reinterpret_cast<const char*>(mesh.getMeshlets().data()), static_cast<std::streamsize>(mesh.getMeshlets().size_bytes()));
+            pad();
+        }
+    });
+}
@@ -0,0 +1,53 @@
+#ifndef STAR_MESHCACHE_HPP
+#define STAR_MESHCACHE_HPP
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fn);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] const std::byte* data() const {
+        return base;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return length;
+    }
+
+private:
+    const std::byte* base{nullptr};
+    size_t length{0};
+};
+
+// versioned binary dump of imported meshes, stored next to the source as
+// <source>.<import flags>-<loader options>.starmesh so every set of options keeps its own file
+class MeshCache {
+public:
+    static MeshCache& getInstance();
+
+    ~MeshCache() = default;
+
+    static uint64_t hashSource(const std::string& fn);
+    static std::string cachePath(const std::string& fn, uint32_t importFlags, uint32_t loaderOptions);
+
+    std::optional<std::vector<Mesh>> load(const std::string& fn, uint64_t sourceHash, uint32_t importFlags, uint32_t loaderOptions);
+    void store(const std::string& fn, uint64_t sourceHash, uint32_t importFlags, uint32_t loaderOptions, const std::vector<Mesh>& meshes);
+
+private:
+    MeshCache() = default;
+};
+
+
+#endif //STAR_MESHCACHE_HPP
@@ -0,0 +1,314 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+static constexpr size_t SCORE_CACHE_SIZE = 32;
+static constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+static constexpr uint32_t INVALID_INDEX = ~0u;
+
+// Forsyth's vertex score: recently used vertices and vertices with few remaining triangles win
+static float vertexScore(int32_t cachePos, uint32_t remaining) {
+    if (remaining == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePos >= 0) {
+        if (cachePos < 3) {
+            score = 0.75f;
+        } else {
+            const float scaler = 1.0f / static_cast<float>(SCORE_CACHE_SIZE - 3);
+            score = std::pow(1.0f - static_cast<float>(cachePos - 3) * scaler, 1.5f);
+        }
+    }
+
+    score += 2.0f / std::sqrt(static_cast<float>(remaining));
+    return score;
+}
+
+// FIFO cache simulation via timestamps, a vertex is cached while it was loaded less than size misses ago
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, uint32_t size) : loadedAt(vertexCount, 0), cacheSize(size), time(size + 1) {}
+
+    uint32_t touch(uint32_t v) {
+        if (time - loadedAt[v] > cacheSize) {
+            loadedAt[v] = time++;
+            return 1;
+        }
+        return 0;
+    }
+
+    uint32_t touchTriangle(const uint32_t* tri) {
+        return touch(tri[0]) + touch(tri[1]) + touch(tri[2]);
+    }
+
+    void reset() {
+        time += cacheSize + 1;
+    }
+
+private:
+    std::vector<uint32_t> loadedAt;
+    uint32_t cacheSize;
+    uint32_t time;
+};
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize) {
+    assert(indices.size() % 3 == 0);
+
+    VertexCacheStats stats{};
+    if (indices.empty()) {
+        return stats;
+    }
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t misses = 0;
+    size_t unique = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        misses += cache.touchTriangle(&indices[i]);
+        for (size_t k = 0; k < 3; ++k) {
+            if (!referenced[indices[i + k]]) {
+                referenced[indices[i + k]] = true;
+                ++unique;
+            }
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    assert(indices.size() % 3 == 0);
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0) {
+        return;
+    }
+
+    // vertex -> triangle adjacency, compacted as triangles get emitted
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (const auto idx : indices) {
+        ++remaining[idx];
+    }
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triCount; ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+                adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    std::vector<int32_t> cachePos(vertexCount, -1);
+    std::vector<float> vScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        vScore[v] = vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> tScore(triCount);
+    std::vector<bool> emitted(triCount, false);
+    for (size_t t = 0; t < triCount; ++t) {
+        tScore[t] = vScore[indices[t * 3]] + vScore[indices[t * 3 + 1]] + vScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(SCORE_CACHE_SIZE + 3);
+    newCache.reserve(SCORE_CACHE_SIZE + 3);
+
+    size_t cursor = 0;
+    auto best = static_cast<uint32_t>(std::max_element(tScore.begin(), tScore.end()) - tScore.begin());
+    while (out.size() < indices.size()) {
+        if (best == INVALID_INDEX) {
+            // nothing in the cache has triangles left, continue with the next unemitted triangle
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            best = static_cast<uint32_t>(cursor);
+        }
+
+        emitted[best] = true;
+        const uint32_t* tri = &indices[static_cast<size_t>(best) * 3];
+        out.insert(out.end(), tri, tri + 3);
+
+        newCache.clear();
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t v = tri[k];
+            const auto begin = adjacency.begin() + offsets[v];
+            const auto end = begin + remaining[v];
+            const auto it = std::find(begin, end, best);
+            assert(it != end);
+            *it = *(end - 1);
+            --remaining[v];
+
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+
+        for (const auto v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                newCache.push_back(v);
+            }
+        }
+
+        // rescore everything that moved in or fell out of the cache
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            const uint32_t v = newCache[i];
+            cachePos[v] = i < SCORE_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+            const float score = vertexScore(cachePos[v], remaining[v]);
+            const float delta = score - vScore[v];
+            vScore[v] = score;
+            for (uint32_t a = 0; a < remaining[v]; ++a) {
+                tScore[adjacency[offsets[v] + a]] += delta;
+            }
+        }
+
+        newCache.resize(std::min(newCache.size(), SCORE_CACHE_SIZE));
+        cache.swap(newCache);
+
+        best = INVALID_INDEX;
+        float bestScore = 0.0f;
+        for (const auto v : cache) {
+            for (uint32_t a = 0; a < remaining[v]; ++a) {
+                const uint32_t t = adjacency[offsets[v] + a];
+                if (tScore[t] > bestScore) {
+                    bestScore = tScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(out);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices, std::span<const Vertex> vertices, float threshold) {
+    assert(indices.size() % 3 == 0);
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0) {
+        return;
+    }
+
+    FifoCache cache(vertices.size(), OVERDRAW_CACHE_SIZE);
+
+    // hard boundaries: triangles where the cache order already restarts from nothing
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triCount; ++t) {
+        if (cache.touchTriangle(&indices[t * 3]) == 3) {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(triCount);
+
+    // soft boundaries: split hard clusters further wherever a cut costs at most threshold x their ACMR
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); ++h) {
+        const size_t start = hard[h];
+        const size_t end = hard[h + 1];
+
+        cache.reset();
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; ++t) {
+            clusterMisses += cache.touchTriangle(&indices[t * 3]);
+        }
+        const float clusterAcmr = static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+        cache.reset();
+        clusters.push_back(start);
+        size_t misses = 0;
+        size_t subStart = start;
+        for (size_t t = start; t < end; ++t) {
+            misses += cache.touchTriangle(&indices[t * 3]);
+            const float acmr = static_cast<float>(misses) / static_cast<float>(t - subStart + 1);
+            if (t + 1 < end && acmr <= clusterAcmr * threshold) {
+                clusters.push_back(t + 1);
+                subStart = t + 1;
+                misses = 0;
+                cache.reset();
+            }
+        }
+    }
+    clusters.push_back(triCount);
+
+    // area weighted centroid of the whole mesh
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triCount; ++t) {
+        const glm::vec3& a = vertices[indices[t * 3]].pos;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].pos;
+        const float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+    // clusters facing away from the centre are likely to occlude the rest, draw them first
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3& p0 = vertices[indices[t * 3]].pos;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float triArea = glm::length(n);
+            centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+            normal += n;
+            area += triArea;
+        }
+
+        centroid = area > 0.0f ? centroid / area : centroid;
+        const float normalLength = glm::length(normal);
+        normal = normalLength > 0.0f ? normal / normalLength : normal;
+        sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    for (const auto c : order) {
+        out.insert(out.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+
+    indices.swap(out);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+    std::vector<uint32_t> remap(vertices.size(), INVALID_INDEX);
+    std::vector<Vertex> out;
+    out.reserve(vertices.size());
+
+    for (auto& idx : indices) {
+        if (remap[idx] == INVALID_INDEX) {
+            remap[idx] = static_cast<uint32_t>(out.size());
+            out.push_back(vertices[idx]);
+        }
+        idx = remap[idx];
+    }
+
+    vertices.swap(out);
+}
@@ -0,0 +1,33 @@
+#ifndef STAR_MESHOPTIMIZER_HPP
+#define STAR_MESHOPTIMIZER_HPP
+
+#include "Vertex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct VertexCacheStats {
+    float acmr{0.0f}; // transformed vertices per triangle, 0.5 is ideal and 3.0 is worst
+    float atvr{0.0f}; // transformed vertices per referenced vertex, 1.0 is ideal
+};
+
+// CPU passes over imported index/vertex lists, run once at load time
+class MeshOptimizer {
+public:
+    // simulates a FIFO post-transform cache of the given size
+    static VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+    // reorders triangles for post-transform cache hits (Forsyth's linear-speed algorithm)
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // reorders cache-friendly clusters front-to-back from outside in; threshold bounds the ACMR loss
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, std::span<const Vertex> vertices, float threshold = 1.05f);
+
+    // reorders vertices by first use and drops unreferenced ones, rewriting indices to match
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+};
+
+
+#endif //STAR_MESHOPTIMIZER_HPP
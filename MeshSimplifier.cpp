@@ -0,0 +1,402 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    enum class VertexKind : uint8_t {
+        Manifold, // interior vertex with a single attribute set, collapses anywhere
+        Border,   // on an open edge, only slides along the border
+        Seam,     // interior but split in two by attributes, both wedges collapse along the seam together
+        Locked,   // anything more complex never moves
+    };
+
+    struct Quadric {
+        double a00{0}, a01{0}, a02{0}, a03{0};
+        double a11{0}, a12{0}, a13{0};
+        double a22{0}, a23{0};
+        double a33{0};
+        double w{0};
+
+        Quadric& operator+=(const Quadric& o) {
+            a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+            a11 += o.a11; a12 += o.a12; a13 += o.a13;
+            a22 += o.a22; a23 += o.a23;
+            a33 += o.a33;
+            w += o.w;
+            return *this;
+        }
+
+        // squared distance to the accumulated planes, averaged by weight
+        [[nodiscard]] double error(const glm::vec3& p) const {
+            const double x = p.x;
+            const double y = p.y;
+            const double z = p.z;
+            const double r = a00 * x * x + a11 * y * y + a22 * z * z
+                    + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                    + 2.0 * (a03 * x + a13 * y + a23 * z)
+                    + a33;
+            return w > 0.0 ? std::fabs(r) / w : 0.0;
+        }
+    };
+
+    Quadric planeQuadric(const glm::vec3& n, const glm::vec3& p, double weight) {
+        const double d = -glm::dot(n, p);
+        Quadric q;
+        q.a00 = n.x * n.x * weight; q.a01 = n.x * n.y * weight; q.a02 = n.x * n.z * weight; q.a03 = n.x * d * weight;
+        q.a11 = n.y * n.y * weight; q.a12 = n.y * n.z * weight; q.a13 = n.y * d * weight;
+        q.a22 = n.z * n.z * weight; q.a23 = n.z * d * weight;
+        q.a33 = d * d * weight;
+        q.w = weight;
+        return q;
+    }
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            std::memcpy(bits, &p.x, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return (static_cast<uint64_t>(a) << 32) | b;
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double error;
+    };
+
+    constexpr double BORDER_WEIGHT = 10.0;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+                                               size_t targetIndexCount, float targetError, float *resultError) {
+    assert(indices.size() % 3 == 0);
+    const size_t vertexCount = vertices.size();
+    std::vector<uint32_t> result(indices.begin(), indices.end());
+    if (resultError) {
+        *resultError = 0.0f;
+    }
+    if (result.size() <= targetIndexCount || vertexCount == 0) {
+        return result;
+    }
+
+    // weld wedges that share a position, wedges of one position form a ring through nextWedge
+    std::vector<uint32_t> posId(vertexCount);
+    std::vector<uint32_t> nextWedge(vertexCount);
+    {
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> firstAt;
+        firstAt.reserve(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            const auto [it, inserted] = firstAt.emplace(vertices[v].pos, v);
+            posId[v] = it->second;
+            if (inserted) {
+                nextWedge[v] = v;
+            } else {
+                nextWedge[v] = nextWedge[it->second];
+                nextWedge[it->second] = v;
+            }
+        }
+    }
+
+    glm::vec3 minPos = vertices[0].pos;
+    glm::vec3 maxPos = vertices[0].pos;
+    for (const auto& v : vertices) {
+        minPos = glm::min(minPos, v.pos);
+        maxPos = glm::max(maxPos, v.pos);
+    }
+    const glm::vec3 size = maxPos - minPos;
+    const float extent = std::max(size.x, std::max(size.y, size.z));
+    const double errorLimit = static_cast<double>(targetError) * extent;
+    const double errorLimitSq = errorLimit * errorLimit;
+
+    // directed edges in position space, an edge without its reverse is a real border
+    std::unordered_set<uint64_t> posEdges;
+    posEdges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t k = 0; k < 3; ++k) {
+            posEdges.insert(edgeKey(posId[result[i + k]], posId[result[i + (k + 1) % 3]]));
+        }
+    }
+    const auto isBorderEdge = [&](uint32_t pa, uint32_t pb) {
+        return posEdges.count(edgeKey(pa, pb)) != posEdges.count(edgeKey(pb, pa));
+    };
+
+    std::vector<bool> onBorder(vertexCount, false);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t pa = posId[result[i + k]];
+            const uint32_t pb = posId[result[i + (k + 1) % 3]];
+            if (isBorderEdge(pa, pb)) {
+                onBorder[pa] = true;
+                onBorder[pb] = true;
+            }
+        }
+    }
+
+    std::vector<VertexKind> kind(vertexCount, VertexKind::Locked);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        const uint32_t p = posId[v];
+        size_t wedges = 1;
+        for (uint32_t w = nextWedge[p]; w != p; w = nextWedge[w]) {
+            ++wedges;
+        }
+
+        if (wedges == 1) {
+            kind[v] = onBorder[p] ? VertexKind::Border : VertexKind::Manifold;
+        } else if (wedges == 2 && !onBorder[p]) {
+            kind[v] = VertexKind::Seam;
+        }
+    }
+
+    // area weighted plane quadrics per position, plus perpendicular planes along borders
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const uint32_t p[3] = {posId[result[i]], posId[result[i + 1]], posId[result[i + 2]]};
+        const glm::vec3& p0 = vertices[p[0]].pos;
+        const glm::vec3& p1 = vertices[p[1]].pos;
+        const glm::vec3& p2 = vertices[p[2]].pos;
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(n);
+        if (area <= 0.0f) {
+            continue;
+        }
+
+        const Quadric q = planeQuadric(n / area, p0, area);
+        for (const auto pk : p) {
+            quadrics[pk] += q;
+        }
+
+        for (size_t k = 0; k < 3; ++k) {
+            const uint32_t pa = p[k];
+            const uint32_t pb = p[(k + 1) % 3];
+            if (!isBorderEdge(pa, pb)) {
+                continue;
+            }
+
+            const glm::vec3 edge = vertices[pb].pos - vertices[pa].pos;
+            const float length = glm::length(edge);
+            if (length <= 0.0f) {
+                continue;
+            }
+            const glm::vec3 borderNormal = glm::cross(edge, n / area);
+            const float borderLength = glm::length(borderNormal);
+            if (borderLength <= 0.0f) {
+                continue;
+            }
+            const Quadric bq = planeQuadric(borderNormal / borderLength, vertices[pa].pos, length * length * BORDER_WEIGHT);
+            quadrics[pa] += bq;
+            quadrics[pb] += bq;
+        }
+    }
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> triOffsets(vertexCount + 1);
+    std::vector<uint32_t> triAdjacency;
+    std::unordered_set<uint64_t> indexEdges;
+    std::vector<Collapse> collapses;
+    double maxError = 0.0;
+
+    while (result.size() > targetIndexCount) {
+        // vertex -> triangle adjacency and undirected index space edges for this pass
+        std::fill(triOffsets.begin(), triOffsets.end(), 0);
+        for (const auto idx : result) {
+            ++triOffsets[idx + 1];
+        }
+        for (size_t v = 0; v < vertexCount; ++v) {
+            triOffsets[v + 1] += triOffsets[v];
+        }
+        triAdjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i) {
+                triAdjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        indexEdges.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t a = result[i + k];
+                const uint32_t b = result[i + (k + 1) % 3];
+                indexEdges.insert(edgeKey(std::min(a, b), std::max(a, b)));
+            }
+        }
+        const auto hasIndexEdge = [&](uint32_t a, uint32_t b) {
+            return indexEdges.count(edgeKey(std::min(a, b), std::max(a, b))) != 0;
+        };
+
+        // for a seam, the other wedge has to follow along an edge to some wedge of the target
+        const auto seamPartner = [&](uint32_t from, uint32_t to) -> uint32_t {
+            const uint32_t other = nextWedge[from];
+            const uint32_t target = posId[to];
+            for (uint32_t w = target;; w = nextWedge[w]) {
+                if (w != to && hasIndexEdge(other, w)) {
+                    return w;
+                }
+                if (nextWedge[w] == target) {
+                    break;
+                }
+            }
+            return ~0u;
+        };
+
+        const auto canCollapse = [&](uint32_t from, uint32_t to) {
+            const uint32_t pa = posId[from];
+            const uint32_t pb = posId[to];
+            if (pa == pb) {
+                return false;
+            }
+            switch (kind[from]) {
+                case VertexKind::Manifold:
+                    return true;
+                case VertexKind::Border:
+                    return isBorderEdge(pa, pb);
+                case VertexKind::Seam:
+                    return kind[to] == VertexKind::Seam && seamPartner(from, to) != ~0u;
+                case VertexKind::Locked:
+                    return false;
+            }
+            return false;
+        };
+
+        // cheapest legal collapse per source vertex
+        collapses.clear();
+        std::vector<Collapse> best(vertexCount, Collapse{~0u, ~0u, 0.0});
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t e[2] = {result[i + k], result[i + (k + 1) % 3]};
+                for (size_t dir = 0; dir < 2; ++dir) {
+                    const uint32_t from = e[dir];
+                    const uint32_t to = e[1 - dir];
+                    if (!canCollapse(from, to)) {
+                        continue;
+                    }
+
+                    Quadric q = quadrics[posId[from]];
+                    q += quadrics[posId[to]];
+                    const double error = q.error(vertices[to].pos);
+                    if (best[from].from == ~0u || error < best[from].error) {
+                        best[from] = Collapse{from, to, error};
+                    }
+                }
+            }
+        }
+        for (const auto& c : best) {
+            if (c.from != ~0u) {
+                collapses.push_back(c);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t triCount = result.size() / 3;
+        size_t performed = 0;
+        for (const auto& c : collapses) {
+            if (triCount * 3 <= targetIndexCount || c.error > errorLimitSq) {
+                break;
+            }
+
+            const uint32_t pa = posId[c.from];
+            const uint32_t pb = posId[c.to];
+            if (touched[pa] || touched[pb]) {
+                continue;
+            }
+
+            // reject collapses that flip any surviving triangle around the source position
+            const glm::vec3& target = vertices[c.to].pos;
+            bool flips = false;
+            size_t removed = 0;
+            for (uint32_t w = pa;;) {
+                for (uint32_t a = triOffsets[w]; a < triOffsets[w + 1] && !flips; ++a) {
+                    const uint32_t* tri = &result[static_cast<size_t>(triAdjacency[a]) * 3];
+                    if (posId[tri[0]] == pb || posId[tri[1]] == pb || posId[tri[2]] == pb) {
+                        ++removed;
+                        continue;
+                    }
+
+                    glm::vec3 p[3] = {vertices[tri[0]].pos, vertices[tri[1]].pos, vertices[tri[2]].pos};
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    for (auto& pk : p) {
+                        if (pk == vertices[pa].pos) {
+                            pk = target;
+                        }
+                    }
+                    const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+                        flips = true;
+                    }
+                }
+                w = nextWedge[w];
+                if (w == pa || flips) {
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            if (kind[c.from] == VertexKind::Seam) {
+                remap[nextWedge[c.from]] = seamPartner(c.from, c.to);
+            }
+
+            // freeze the whole one-ring so later collapses in this pass see valid geometry
+            for (uint32_t w = pa;;) {
+                for (uint32_t a = triOffsets[w]; a < triOffsets[w + 1]; ++a) {
+                    const uint32_t* tri = &result[static_cast<size_t>(triAdjacency[a]) * 3];
+                    touched[posId[tri[0]]] = true;
+                    touched[posId[tri[1]]] = true;
+                    touched[posId[tri[2]]] = true;
+                }
+                w = nextWedge[w];
+                if (w == pa) {
+                    break;
+                }
+            }
+
+            quadrics[pb] += quadrics[pa];
+            maxError = std::max(maxError, c.error);
+            triCount -= std::min(triCount, removed);
+            ++performed;
+        }
+
+        if (performed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const uint32_t a = remap[result[i]];
+            const uint32_t b = remap[result[i + 1]];
+            const uint32_t c = remap[result[i + 2]];
+            if (posId[a] == posId[b] || posId[b] == posId[c] || posId[a] == posId[c]) {
+                continue;
+            }
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError) {
+        *resultError = static_cast<float>(std::sqrt(maxError));
+    }
+
+    return result;
+}
@@ -0,0 +1,22 @@
+#ifndef STAR_MESHSIMPLIFIER_HPP
+#define STAR_MESHSIMPLIFIER_HPP
+
+#include "Vertex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// quadric error edge collapse that only moves vertices onto existing neighbours,
+// so every simplified index list can keep sharing the original vertex buffer
+class MeshSimplifier {
+public:
+    // targetError is relative to the largest bounding box dimension; resultError receives
+    // the largest collapse error in object space units
+    static std::vector<uint32_t> simplify(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+                                          size_t targetIndexCount, float targetError, float* resultError = nullptr);
+};
+
+
+#endif //STAR_MESHSIMPLIFIER_HPP
@@ -0,0 +1,186 @@
+#include "Meshlet.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+std::vector<Meshlet> MeshletBuilder::build(std::span<uint32_t> indices, std::span<const Vertex> vertices, uint32_t baseIndex,
+                                           size_t maxVertices, size_t maxTriangles) {
+    assert(indices.size() % 3 == 0);
+    assert(maxVertices >= 3 && maxTriangles >= 1);
+    const size_t triCount = indices.size() / 3;
+    const size_t vertexCount = vertices.size();
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (const auto idx : indices) {
+        ++offsets[idx + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<bool> used(triCount, false);
+    // which meshlet last referenced a vertex, avoids clearing a set per meshlet
+    std::vector<uint32_t> vertexStamp(vertexCount, ~0u);
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    meshletVertices.reserve(maxVertices);
+
+    size_t cursor = 0;
+    size_t emitted = 0;
+    while (emitted < triCount) {
+        const auto stamp = static_cast<uint32_t>(meshlets.size());
+        Meshlet meshlet{};
+        meshlet.firstIndex = baseIndex + static_cast<uint32_t>(out.size());
+        meshletVertices.clear();
+
+        const auto newVertices = [&](size_t t) {
+            uint32_t count = 0;
+            for (size_t k = 0; k < 3; ++k) {
+                count += vertexStamp[indices[t * 3 + k]] != stamp ? 1 : 0;
+            }
+            return count;
+        };
+
+        while (meshlet.indexCount / 3 < maxTriangles) {
+            // prefer the unused neighbour that brings in the fewest new vertices
+            size_t best = triCount;
+            uint32_t bestNew = 4;
+            for (const auto v : meshletVertices) {
+                for (uint32_t a = offsets[v]; a < offsets[v + 1]; ++a) {
+                    const uint32_t t = adjacency[a];
+                    if (used[t]) {
+                        continue;
+                    }
+                    const uint32_t n = newVertices(t);
+                    if (n < bestNew) {
+                        bestNew = n;
+                        best = t;
+                    }
+                }
+            }
+
+            if (best == triCount) {
+                // nothing connected left, seed from the next triangle in the original order
+                while (cursor < triCount && used[cursor]) {
+                    ++cursor;
+                }
+                if (cursor == triCount) {
+                    break;
+                }
+                best = cursor;
+                bestNew = newVertices(best);
+            }
+
+            if (meshletVertices.size() + bestNew > maxVertices) {
+                break;
+            }
+
+            used[best] = true;
+            ++emitted;
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t v = indices[best * 3 + k];
+                if (vertexStamp[v] != stamp) {
+                    vertexStamp[v] = stamp;
+                    meshletVertices.push_back(v);
+                }
+                out.push_back(v);
+            }
+            meshlet.indexCount += 3;
+        }
+
+        meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(out.begin(), out.end(), indices.begin());
+
+    for (auto& meshlet : meshlets) {
+        computeBounds(meshlet, indices.subspan(meshlet.firstIndex - baseIndex, meshlet.indexCount), vertices);
+    }
+
+    return meshlets;
+}
+
+void MeshletBuilder::computeBounds(Meshlet &meshlet, std::span<const uint32_t> indices, std::span<const Vertex> vertices) {
+    if (indices.empty()) {
+        return;
+    }
+
+    glm::vec3 minPos = vertices[indices[0]].pos;
+    glm::vec3 maxPos = minPos;
+    for (const auto idx : indices) {
+        minPos = glm::min(minPos, vertices[idx].pos);
+        maxPos = glm::max(maxPos, vertices[idx].pos);
+    }
+    const glm::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+    for (const auto idx : indices) {
+        radius = std::max(radius, glm::distance(center, vertices[idx].pos));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    // normal cone: average of unit triangle normals, opened up to the widest one
+    std::vector<glm::vec3> normals;
+    normals.reserve(indices.size() / 3);
+    glm::vec3 axis(0.0f);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& p0 = vertices[indices[i]].pos;
+        const glm::vec3& p1 = vertices[indices[i + 1]].pos;
+        const glm::vec3& p2 = vertices[indices[i + 2]].pos;
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        if (length > 0.0f) {
+            normals.push_back(n / length);
+            axis += n / length;
+        }
+    }
+
+    const float axisLength = glm::length(axis);
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    meshlet.coneApex = glm::vec4(center, 0.0f);
+    if (normals.empty() || axisLength <= 0.0f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const auto& n : normals) {
+        minDot = std::min(minDot, glm::dot(n, axis));
+    }
+
+    // cones wider than ~84 degrees practically never cull, leave them at a cutoff of 1
+    if (minDot <= 0.1f) {
+        meshlet.cone = glm::vec4(axis, 1.0f);
+        return;
+    }
+
+    // move the apex back until every triangle plane lies in front of it
+    float maxT = 0.0f;
+    size_t n = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const glm::vec3& p0 = vertices[indices[i]].pos;
+        const glm::vec3& p1 = vertices[indices[i + 1]].pos;
+        const glm::vec3& p2 = vertices[indices[i + 2]].pos;
+        if (glm::length(glm::cross(p1 - p0, p2 - p0)) <= 0.0f) {
+            continue;
+        }
+        const glm::vec3& normal = normals[n++];
+        const float dc = glm::dot(center - p0, normal);
+        const float dn = glm::dot(axis, normal);
+        maxT = std::max(maxT, dc / dn);
+    }
+
+    meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+    meshlet.coneApex = glm::vec4(center - axis * maxT, 0.0f);
+}
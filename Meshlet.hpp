@@ -0,0 +1,38 @@
+#ifndef STAR_MESHLET_HPP
+#define STAR_MESHLET_HPP
+
+#include "Vertex.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// small triangle cluster, a contiguous range of the mesh index buffer with its own culling data
+struct Meshlet {
+    uint32_t firstIndex{0};
+    uint32_t indexCount{0};
+    uint32_t vertexCount{0};
+    uint32_t padding{0};
+    glm::vec4 sphere{0.0f};   // object space center and radius
+    glm::vec4 cone{0.0f};     // average normal in xyz, cutoff in w; backfacing when dot(normalize(apex - eye), axis) >= cutoff
+    glm::vec4 coneApex{0.0f}; // w unused
+};
+
+class MeshletBuilder {
+public:
+    static constexpr size_t MAX_VERTICES = 64;
+    static constexpr size_t MAX_TRIANGLES = 124;
+
+    // regroups the triangles of indices in place so every meshlet is a contiguous run,
+    // firstIndex values are offset by baseIndex
+    static std::vector<Meshlet> build(std::span<uint32_t> indices, std::span<const Vertex> vertices, uint32_t baseIndex = 0,
+                                      size_t maxVertices = MAX_VERTICES, size_t maxTriangles = MAX_TRIANGLES);
+
+    static void computeBounds(Meshlet& meshlet, std::span<const uint32_t> indices, std::span<const Vertex> vertices);
+};
+
+
+#endif //STAR_MESHLET_HPP
@@ -3,92 +3,221 @@
 //
 
 #include "ModelLoader.hpp"
+#include "MeshCache.hpp"
+#include "JobSystem.hpp"
+#include "Screen.hpp"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <bit>
 #include <iostream>
 
+uint32_t ModelLoadOptions::key() const {
+    // FNV-1a over the fields, floats by bit pattern
+    uint32_t hash = 0x811c9dc5u;
+    const auto mix = [&](uint32_t v) {
+        for (size_t i = 0; i < 4; ++i) {
+            hash ^= (v >> (i * 8)) & 0xffu;
+            hash *= 0x01000193u;
+        }
+    };
+
+    mix(optimize ? 1u : 0u);
+    mix(lodLevels);
+    mix(meshlets ? 1u : 0u);
+    mix(compact ? 1u : 0u);
+    if (lodLevels > 0) {
+        mix(std::bit_cast<uint32_t>(lodRatio));
+        mix(std::bit_cast<uint32_t>(lodError));
+    }
+    return hash;
+}
+
 ModelLoader &ModelLoader::getInstance() {
     static ModelLoader loader;
 
     return loader;
 }
 
-std::vector<Mesh> ModelLoader::load(const std::string &fn) {
+std::vector<Mesh> ModelLoader::load(const std::string &fn, const ModelLoadOptions& options) {
+    // winding is part of the import flags, which already key the mesh cache
+    uint32_t flags = aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_FlipUVs;
+    if (options.flipWinding) {
+        flags |= aiProcess_FlipWindingOrder;
+    }
+    return import(fn, flags, options);
+}
+
+std::vector<Mesh> ModelLoader::import(const std::string &fn, uint32_t flags, const ModelLoadOptions& options) {
+    auto& cache = MeshCache::getInstance();
+    const uint64_t sourceHash = MeshCache::hashSource(fn);
+    const bool allowUint8 = Screen::getInstance().supportsUint8Indices();
+    if (auto cached = cache.load(fn, sourceHash, flags, options.key())) {
+        // the cache may come from a device with 8 bit index support
+        if (!allowUint8) {
+            for (auto& mesh : *cached) {
+                if (mesh.getIndexType() == VK_INDEX_TYPE_UINT8_EXT) {
+                    mesh.setIndexType(VK_INDEX_TYPE_UINT16);
+                }
+            }
+        }
+        return std::move(*cached);
+    }
+
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-            fn.c_str(),
-            aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_FlipUVs);
+    const aiScene* scene = importer.ReadFile(fn.c_str(), flags);
     if (scene == nullptr) {
         throw std::runtime_error("cannot open model file " + fn);
     }
 
-    std::vector<Mesh> meshes;
+    std::vector<const aiMesh*> sceneMeshes;
+    processNode(sceneMeshes, scene, scene->mRootNode);
+
+    // one job per aiMesh, each writing its own slot so the output order matches the scene walk
+    std::vector<Mesh> meshes(sceneMeshes.size());
+    std::vector<std::pair<VertexCacheStats, VertexCacheStats>> stats(sceneMeshes.size());
+    JobSystem::getInstance().parallelFor(sceneMeshes.size(), [&](size_t i) {
+        MeshData data = convertMesh(sceneMeshes[i]);
+        if (options.optimize) {
+            stats[i].first = MeshOptimizer::analyzeVertexCache(data.indices, data.vertices.size());
+            optimizeMesh(data);
+        }
 
-    processNode(meshes, scene, scene->mRootNode);
+        if (options.meshlets) {
+            // regroups level 0 triangles, so it runs before the lods are derived from them
+            data.meshlets = MeshletBuilder::build(data.indices, data.vertices);
+        }
+
+        if (options.lodLevels > 0) {
+            generateLods(data, options);
+        }
+
+        if (options.optimize) {
+            // every level only references level 0 vertices, so first use order covers them all
+            MeshOptimizer::optimizeVertexFetch(data.vertices, data.indices);
+            const size_t baseCount = data.lods.empty() ? data.indices.size() : data.lods[0].indexCount;
+            stats[i].second = MeshOptimizer::analyzeVertexCache(std::span(data.indices).first(baseCount), data.vertices.size());
+        }
+
+        meshes[i] = buildMesh(std::move(data), options, allowUint8);
+    });
+
+    if (options.optimize) {
+        for (size_t i = 0; i < stats.size(); ++i) {
+            const auto& [before, after] = stats[i];
+            std::cout << fn << " mesh " << i << ": ACMR " << before.acmr << " -> " << after.acmr
+                      << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+        }
+    }
+
+    cache.store(fn, sourceHash, flags, options.key(), meshes);
 
     return meshes;
 }
 
-void ModelLoader::processNode(std::vector<Mesh> &meshes, const aiScene* scene, aiNode *node) {
+void ModelLoader::processNode(std::vector<const aiMesh*> &meshes, const aiScene* scene, const aiNode *node) {
     for (size_t i = 0; i < node->mNumMeshes; ++i) {
-        const auto meshIdx = node->mMeshes[i];
-        const auto mesh = scene->mMeshes[meshIdx];
-        const auto numVerts = mesh->mNumVertices;
-        const auto numFaces = mesh->mNumFaces;
-        std::vector<Vertex> vertices;
-        std::vector<uint16_t> indices;
-        vertices.reserve(numVerts);
-
-        for (size_t j = 0; j < numVerts; ++j) {
-            const auto meshPos = mesh->mVertices + j;
-            const auto meshNorm = mesh->mNormals + j;
-            glm::vec3 tex(0.0f);
-            if (mesh->mTextureCoords[0]) {
-                tex.x = mesh->mTextureCoords[0][j].x;
-                tex.y = mesh->mTextureCoords[0][j].y;
-            } else {
-                std::cout << "warning: no texture data" << std::endl;
-            }
-            const glm::vec3 pos(meshPos->x, meshPos->y, meshPos->z);
-            const glm::vec3 norm(meshNorm->x, meshNorm->y, meshNorm->z);
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+    }
 
-            vertices.emplace_back(pos, norm, pos, tex);
-        }
+    for (size_t i = 0; i < node->mNumChildren; ++i) {
+        processNode(meshes, scene, node->mChildren[i]);
+    }
+}
 
-        for (size_t j = 0; j < numFaces; ++j) {
-            const auto face = mesh->mFaces + j;
-            for (size_t k = 0; k < face->mNumIndices; ++k) {
-                indices.push_back(face->mIndices[k]);
-            }
+MeshData ModelLoader::convertMesh(const aiMesh *mesh) {
+    const auto numVerts = mesh->mNumVertices;
+    const auto numFaces = mesh->mNumFaces;
+    const aiVector3D* texCoords = mesh->mTextureCoords[0];
+    if (!texCoords) {
+        std::cout << "warning: no texture data in mesh " << mesh->mName.C_Str() << std::endl;
+    }
+
+    MeshData data;
+    auto& vertices = data.vertices;
+    vertices.resize(numVerts);
+    for (size_t j = 0; j < numVerts; ++j) {
+        const auto& meshPos = mesh->mVertices[j];
+        const glm::vec3 pos(meshPos.x, meshPos.y, meshPos.z);
+        glm::vec3 norm(0.0f);
+        if (mesh->mNormals) {
+            norm = glm::vec3(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z);
+        }
+        glm::vec2 tex(0.0f);
+        if (texCoords) {
+            tex = glm::vec2(texCoords[j].x, texCoords[j].y);
         }
 
-        Mesh loaded;
-        loaded.setVertices(vertices);
-        loaded.setIndices(indices);
-        meshes.push_back(std::move(loaded));
+        vertices[j] = Vertex(pos, norm, pos, tex);
     }
 
-    for (size_t i = 0; i < node->mNumChildren; ++i) {
-        processNode(meshes, scene, node->mChildren[i]);
+    auto& indices = data.indices;
+    indices.reserve(static_cast<size_t>(numFaces) * 3);
+    for (size_t j = 0; j < numFaces; ++j) {
+        const auto& face = mesh->mFaces[j];
+        indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
     }
+
+    return data;
 }
 
-Mesh ModelLoader::loadSkybox(const std::string &fn) {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-            fn.c_str(),
-            aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType | aiProcess_FlipUVs | aiProcess_FlipWindingOrder);
-    if (scene == nullptr) {
-        throw std::runtime_error("cannot open model file " + fn);
+void ModelLoader::optimizeMesh(MeshData &data) {
+    MeshOptimizer::optimizeVertexCache(data.indices, data.vertices.size());
+    MeshOptimizer::optimizeOverdraw(data.indices, data.vertices);
+}
+
+void ModelLoader::generateLods(MeshData &data, const ModelLoadOptions &options) {
+    data.lods.push_back(MeshLod{0, static_cast<uint32_t>(data.indices.size()), 0.0f});
+
+    // each level simplifies the previous one, so errors add up along the chain
+    std::vector<uint32_t> previous = data.indices;
+    float previousError = 0.0f;
+    for (uint32_t level = 1; level <= options.lodLevels; ++level) {
+        const size_t target = static_cast<size_t>(static_cast<float>(previous.size()) * options.lodRatio) / 3 * 3;
+        float error = 0.0f;
+        std::vector<uint32_t> lod = MeshSimplifier::simplify(previous, data.vertices, target, options.lodError, &error);
+
+        // stop once the error bound keeps the simplifier from making real progress
+        if (lod.empty() || lod.size() > previous.size() * 9 / 10) {
+            break;
+        }
+
+        if (options.optimize) {
+            MeshOptimizer::optimizeVertexCache(lod, data.vertices.size());
+        }
+
+        previousError += error;
+        data.lods.push_back(MeshLod{static_cast<uint32_t>(data.indices.size()), static_cast<uint32_t>(lod.size()), previousError});
+        data.indices.insert(data.indices.end(), lod.begin(), lod.end());
+        previous = std::move(lod);
     }
+}
 
-    std::vector<Mesh> meshes;
+Mesh ModelLoader::buildMesh(MeshData data, const ModelLoadOptions& options, bool allowUint8) {
+    Mesh loaded;
+    loaded.setBoundingBox(Mesh::computeBoundingBox(data.vertices));
+    loaded.setBoundingSphere(Mesh::computeBoundingSphere(data.vertices));
+    loaded.setIndices(data.indices, Mesh::chooseIndexType(data.vertices.size(), allowUint8));
+    loaded.setVertices(std::move(data.vertices));
+    loaded.setLods(std::move(data.lods));
+    loaded.setMeshlets(std::move(data.meshlets));
+    if (options.compact) {
+        loaded.compress();
+    }
+    return loaded;
+}
 
-    processNode(meshes, scene, scene->mRootNode);
+Mesh ModelLoader::loadSkybox(const std::string &fn) {
+    std::vector<Mesh> meshes = load(fn, {.flipWinding = true});
+    if (meshes.empty()) {
+        throw std::runtime_error("skybox has no meshes " + fn);
+    }
 
-    meshes[0].createBuffers();
-    meshes[0].upload();
-    return meshes[0];
+    // move rather than copy, and keep only the gpu copy once it is staged
+    Mesh sky = std::move(meshes.front());
+    sky.createBuffers();
+    sky.upload();
+    sky.releaseCpuData();
+    return sky;
 }
@@ -7,23 +7,63 @@
 
 
 #include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
 #include <assimp/scene.h>
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
+struct ModelLoadOptions {
+    // reorder triangles for vertex cache and overdraw, then vertices for fetch locality
+    bool optimize{false};
+
+    // number of simplified levels appended after level 0, each aiming for lodRatio of the previous
+    // level's triangles without exceeding lodError (relative to the mesh extent) per step
+    uint32_t lodLevels{0};
+    float lodRatio{0.5f};
+    float lodError{0.02f};
+
+    // split level 0 into clusters with bounds and normal cones for Screen::drawMeshlets
+    bool meshlets{false};
+
+    // store vertices in the 16 byte CompactVertex layout, drawn through the compact pipeline
+    bool compact{false};
+
+    // reverse triangle winding, for geometry seen from the inside such as the skybox
+    bool flipWinding{false};
+
+    // part of the mesh cache key so differently processed imports never alias
+    [[nodiscard]] uint32_t key() const;
+};
+
+// intermediate import result, indices stay 32 bit until the final Mesh picks its index width
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+};
+
 class ModelLoader {
 public:
     static ModelLoader& getInstance();
 
     ~ModelLoader() = default;
 
-    std::vector<Mesh> load(const std::string& fn);
+    std::vector<Mesh> load(const std::string& fn, const ModelLoadOptions& options = {});
     Mesh loadSkybox(const std::string& fn);
 
 private:
     ModelLoader() = default;
 
-    void processNode(std::vector<Mesh>& meshes, const aiScene* scene, aiNode* node);
+    std::vector<Mesh> import(const std::string& fn, uint32_t flags, const ModelLoadOptions& options);
+    void processNode(std::vector<const aiMesh*>& meshes, const aiScene* scene, const aiNode* node);
+    static MeshData convertMesh(const aiMesh* mesh);
+    static void optimizeMesh(MeshData& data);
+    static void generateLods(MeshData& data, const ModelLoadOptions& options);
+    static Mesh buildMesh(MeshData data, const ModelLoadOptions& options, bool allowUint8);
 };
 
 
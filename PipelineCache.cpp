@@ -0,0 +1,227 @@
+#include "PipelineCache.hpp"
+#include "AtomicFile.hpp"
+#include "Hash.hpp"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+static constexpr std::array<char, 8> CACHE_MAGIC = {'S', 'T', 'A', 'R', 'P', 'S', 'O', '\0'};
+static constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheFileHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t uuid[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+static bool matchesDevice(const CacheFileHeader& header, const VkPhysicalDeviceProperties& properties) {
+    return header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+           header.driverVersion == properties.driverVersion &&
+           std::memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::init(VkDevice dev, const VkPhysicalDeviceProperties &properties, const std::string &directory) {
+    device = dev;
+    deviceProperties = properties;
+    stats = {};
+
+    // a driver update changes the key, the stale file is simply never opened again
+    std::ostringstream name;
+    name << "pipelines_" << std::hex << std::setfill('0')
+         << std::setw(4) << properties.vendorID << '_' << std::setw(4) << properties.deviceID << '_'
+         << std::setw(8) << properties.driverVersion << '_';
+    for (const auto byte : properties.pipelineCacheUUID) {
+        name << std::setw(2) << static_cast<uint32_t>(byte);
+    }
+    name << ".bin";
+    path = (std::filesystem::path(directory) / name.str()).string();
+
+    VkPipelineCacheCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    std::string data;
+    load(info, data);
+
+    if (vkCreatePipelineCache(device, &info, nullptr, &cache) != VK_SUCCESS) {
+        // some drivers reject data that passed every check above, retry cold
+        std::cout << "warning: driver rejected pipeline cache " << path << std::endl;
+        info.initialDataSize = 0;
+        info.pInitialData = nullptr;
+        stats.loadedBytes = 0;
+        if (vkCreatePipelineCache(device, &info, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create pipeline cache");
+        }
+    }
+}
+
+void PipelineCache::load(VkPipelineCacheCreateInfo &info, std::string &data) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return;
+    }
+
+    const auto size = static_cast<size_t>(in.tellg());
+    in.seekg(0);
+    CacheFileHeader header{};
+    if (size < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::cout << "warning: pipeline cache " << path << " is truncated" << std::endl;
+        return;
+    }
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || !matchesDevice(header, deviceProperties)) {
+        std::cout << "warning: pipeline cache " << path << " belongs to another build or device" << std::endl;
+        return;
+    }
+    if (header.dataSize != size - sizeof(header)) {
+        std::cout << "warning: pipeline cache " << path << " is truncated" << std::endl;
+        return;
+    }
+
+    data.resize(header.dataSize);
+    if (!in.read(data.data(), static_cast<std::streamsize>(data.size())) || hashBytes(data.data(), data.size()) != header.dataHash) {
+        std::cout << "warning: pipeline cache " << path << " is corrupt" << std::endl;
+        data.clear();
+        return;
+    }
+
+    // the driver's own header has to agree as well before it is handed over
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) {
+        data.clear();
+        return;
+    }
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerSize < sizeof(driverHeader) || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.vendorID != deviceProperties.vendorID || driverHeader.deviceID != deviceProperties.deviceID ||
+        std::memcmp(driverHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "warning: pipeline cache " << path << " has a mismatched driver header" << std::endl;
+        data.clear();
+        return;
+    }
+
+    info.initialDataSize = data.size();
+    info.pInitialData = data.data();
+    stats.loadedBytes = data.size();
+}
+
+void PipelineCache::destroy() {
+    if (!device) {
+        return;
+    }
+
+    save();
+    std::cout << "pipeline cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.unknown
+              << " without feedback, " << stats.creationNanos / 1000000 << " ms creating pipelines" << std::endl;
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+}
+
+void PipelineCache::save() {
+    assert(cache);
+
+    // nothing was compiled that the file does not already hold
+    if (stats.misses == 0 && stats.unknown == 0 && stats.loadedBytes > 0) {
+        return;
+    }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+        std::cout << "warning: cannot read pipeline cache data" << std::endl;
+        return;
+    }
+    data.resize(size);
+
+    CacheFileHeader header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.vendorID = deviceProperties.vendorID;
+    header.deviceID = deviceProperties.deviceID;
+    header.driverVersion = deviceProperties.driverVersion;
+    std::memcpy(header.uuid, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = hashBytes(data.data(), data.size());
+
+    writeFileAtomic(path, "pipeline cache", [&](std::ostream& out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    });
+}
+
+VkPipelineCache PipelineCache::get() const {
+    return cache;
+}
+
+const std::string &PipelineCache::getPath() const {
+    return path;
+}
+
+const PipelineCacheStats &PipelineCache::getStats() const {
+    return stats;
+}
+
+VkResult PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo &info, VkPipeline *pipeline) {
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pNext = info.pNext;
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+    VkGraphicsPipelineCreateInfo withFeedback = info;
+    withFeedback.pNext = &feedbackInfo;
+
+    const auto start = std::chrono::steady_clock::now();
+    const VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &withFeedback, nullptr, pipeline);
+    const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    if (result == VK_SUCCESS) {
+        record(feedback, static_cast<uint64_t>(nanos));
+    }
+    return result;
+}
+
+VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo &info, VkPipeline *pipeline) {
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo{};
+    feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedbackInfo.pNext = info.pNext;
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+    VkComputePipelineCreateInfo withFeedback = info;
+    withFeedback.pNext = &feedbackInfo;
+
+    const auto start = std::chrono::steady_clock::now();
+    const VkResult result = vkCreateComputePipelines(device, cache, 1, &withFeedback, nullptr, pipeline);
+    const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    if (result == VK_SUCCESS) {
+        record(feedback, static_cast<uint64_t>(nanos));
+    }
+    return result;
+}
+
+void PipelineCache::record(const VkPipelineCreationFeedback &feedback, uint64_t nanos) {
+    std::lock_guard lock(statsMutex);
+    stats.creationNanos += nanos;
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        ++stats.unknown;
+    } else if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        ++stats.hits;
+    } else {
+        ++stats.misses;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef STAR_PIPELINECACHE_HPP
+#define STAR_PIPELINECACHE_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// pipelines created through the cache since init, from VkPipelineCreationFeedback
+struct PipelineCacheStats {
+    uint32_t hits{0};
+    uint32_t misses{0};
+    // the driver gave no feedback
+    uint32_t unknown{0};
+    uint64_t creationNanos{0};
+    // bytes of driver data accepted from disk, 0 when starting cold
+    size_t loadedBytes{0};
+};
+
+// VkPipelineCache persisted across runs, one file per device and driver under the given directory.
+// the file is checked against the device and its own checksum before the driver sees it, and
+// anything that does not match starts an empty cache instead
+class PipelineCache {
+public:
+    PipelineCache() = default;
+
+    ~PipelineCache() {
+        destroy();
+    }
+
+    PipelineCache(PipelineCache const&) = delete;
+    void operator=(PipelineCache const&) = delete;
+
+    void init(VkDevice dev, const VkPhysicalDeviceProperties& properties, const std::string& directory);
+    // saves, then destroys the cache
+    void destroy();
+    // writes the driver's data to a temp file and renames it over the old one
+    void save();
+
+    [[nodiscard]] VkPipelineCache get() const;
+    [[nodiscard]] const std::string& getPath() const;
+    [[nodiscard]] const PipelineCacheStats& getStats() const;
+
+    // one pipeline through the cache, counted as a hit or miss; fine from worker threads
+    VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& info, VkPipeline* pipeline);
+    VkResult createComputePipeline(const VkComputePipelineCreateInfo& info, VkPipeline* pipeline);
+
+private:
+    void load(VkPipelineCacheCreateInfo& info, std::string& data);
+    void record(const VkPipelineCreationFeedback& feedback, uint64_t nanos);
+
+    VkDevice device{VK_NULL_HANDLE};
+    VkPipelineCache cache{VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties deviceProperties{};
+    std::string path;
+    PipelineCacheStats stats;
+    std::mutex statsMutex;
+};
+
+
+#endif //STAR_PIPELINECACHE_HPP
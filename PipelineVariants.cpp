@@ -0,0 +1,248 @@
+#include "PipelineVariants.hpp"
+#include "Hash.hpp"
+#include "JobSystem.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+size_t RenderStateHash::operator()(const RenderState &state) const {
+    // field by field, padding stays out of it
+    Fnv1a hash;
+    hash.mix(static_cast<uint32_t>(state.blend));
+    hash.mix(state.cullMode);
+    hash.mix(state.depthWrite ? 1u : 0u);
+    hash.mix(static_cast<uint32_t>(state.depthCompare));
+    hash.mix(state.constantCount);
+    for (const auto constant : state.constants) {
+        hash.mix(constant);
+    }
+    return static_cast<size_t>(hash.get());
+}
+
+void PipelineVariants::init(VkDevice dev, PipelineCache &cache, const PipelineTemplate &tmpl) {
+    device = dev;
+    pipelineCache = &cache;
+    base = tmpl;
+
+    // the fallbacks, nothing may wait on them
+    const uint32_t state = addState(RenderState{});
+    assert(state == DEFAULT_STATE);
+    for (uint32_t i = 0; i < COMBINATIONS; ++i) {
+        const VkPipeline pipeline = build(states[state], i);
+        if (!pipeline) {
+            throw std::runtime_error("failed to create pipeline");
+        }
+        variants[i].pipeline.store(pipeline);
+        variants[i].requested = true;
+    }
+}
+
+void PipelineVariants::destroy() {
+    if (!device) {
+        return;
+    }
+
+    for (auto& variant : variants) {
+        if (variant.compile.valid()) {
+            variant.compile.wait();
+        }
+        if (const VkPipeline pipeline = variant.pipeline.load()) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+    }
+    variants.clear();
+    states.clear();
+    stateIds.clear();
+    device = VK_NULL_HANDLE;
+}
+
+uint32_t PipelineVariants::addState(const RenderState &state) {
+    assert(state.constantCount <= RenderState::MAX_CONSTANTS);
+    const auto [it, inserted] = stateIds.try_emplace(state, static_cast<uint32_t>(states.size()));
+    if (inserted) {
+        states.push_back(state);
+        for (uint32_t i = 0; i < COMBINATIONS; ++i) {
+            variants.emplace_back();
+        }
+    }
+    return it->second;
+}
+
+uint32_t PipelineVariants::getVariant(uint32_t state, VertexFormat format, bool instanced) {
+    return state * COMBINATIONS + (instanced ? 2u : 0u) + (format == VertexFormat::Compact ? 1u : 0u);
+}
+
+uint32_t PipelineVariants::resolve(uint32_t state, VertexFormat format, bool instanced) {
+    assert(state < states.size());
+    const uint32_t id = getVariant(state, format, instanced);
+    const uint32_t index = id % COMBINATIONS;
+    Variant& variant = variants[id];
+    if (variant.requested) {
+        return id;
+    }
+
+    variant.requested = true;
+    const RenderState& renderState = states[state];
+    const auto compile = [this, &variant, &renderState, index]() {
+        const VkPipeline pipeline = build(renderState, index);
+        // a failed variant keeps drawing with its fallback
+        if (!pipeline) {
+            std::cout << "warning: cannot compile pipeline variant, keeping the fallback" << std::endl;
+        }
+        variant.pipeline.store(pipeline, std::memory_order_release);
+        --pending;
+    };
+
+    ++pending;
+    // without workers the job would never run, take the hitch instead
+    if (JobSystem::getInstance().getNumWorkers() == 0) {
+        compile();
+    } else {
+        variant.compile = JobSystem::getInstance().submit(compile);
+    }
+    return id;
+}
+
+VkPipeline PipelineVariants::get(uint32_t variant) const {
+    assert(variant < variants.size());
+    const VkPipeline pipeline = variants[variant].pipeline.load(std::memory_order_acquire);
+    return pipeline ? pipeline : variants[variant % COMBINATIONS].pipeline.load(std::memory_order_relaxed);
+}
+
+bool PipelineVariants::isReady(uint32_t variant) const {
+    assert(variant < variants.size());
+    return variants[variant].pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+}
+
+uint32_t PipelineVariants::getPendingCount() const {
+    return pending.load();
+}
+
+uint32_t PipelineVariants::getStateCount() const {
+    return static_cast<uint32_t>(states.size());
+}
+
+VkPipeline PipelineVariants::build(const RenderState &state, uint32_t index) const {
+    const bool instanced = index >= 2;
+    const VertexFormat format = (index & 1) ? VertexFormat::Compact : VertexFormat::Standard;
+
+    std::array<VkDynamicState, 2> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    auto bindingDesc = Vertex::getBindingDesc(format);
+    const auto& attribDescs = base.attributes[instanced ? 1 : 0][static_cast<uint32_t>(format)];
+
+    VkPipelineVertexInputStateCreateInfo vertexInput{};
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInput.vertexBindingDescriptionCount = 1;
+    vertexInput.pVertexBindingDescriptions = &bindingDesc;
+    vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribDescs.size());
+    vertexInput.pVertexAttributeDescriptions = attribDescs.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // viewport and scissor are dynamic, only the counts matter
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = state.cullMode;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = state.blend == BlendMode::Opaque ? VK_FALSE : VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = state.blend == BlendMode::Additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = state.blend == BlendMode::Additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = state.depthCompare;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.minDepthBounds = 0.0f;
+    depthStencil.maxDepthBounds = 1.0f;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    // ids a stage does not declare are ignored, so both stages share one map
+    std::array<VkSpecializationMapEntry, RenderState::MAX_CONSTANTS> entries{};
+    for (uint32_t i = 0; i < state.constantCount; ++i) {
+        entries[i] = {i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)};
+    }
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = state.constantCount;
+    specialization.pMapEntries = entries.data();
+    specialization.dataSize = state.constantCount * sizeof(uint32_t);
+    specialization.pData = state.constants.data();
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = base.vertexShaders[instanced ? 1 : 0][static_cast<uint32_t>(format)];
+    stages[0].pName = "main";
+    stages[0].pSpecializationInfo = state.constantCount ? &specialization : nullptr;
+    stages[1] = stages[0];
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = base.fragmentShader;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+    pipelineInfo.pStages = stages.data();
+    pipelineInfo.pVertexInputState = &vertexInput;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = instanced ? base.instancedLayout : base.layout;
+    pipelineInfo.renderPass = base.renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline{VK_NULL_HANDLE};
+    if (pipelineCache->createGraphicsPipeline(pipelineInfo, &pipeline) != VK_SUCCESS) {
+        return VK_NULL_HANDLE;
+    }
+    return pipeline;
+}
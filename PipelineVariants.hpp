@@ -0,0 +1,114 @@
+#ifndef STAR_PIPELINEVARIANTS_HPP
+#define STAR_PIPELINEVARIANTS_HPP
+
+#include "PipelineCache.hpp"
+#include "Vertex.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+enum class BlendMode : uint8_t {
+    Opaque = 0,
+    Alpha = 1,
+    Additive = 2,
+};
+
+// fixed function state and specialization constants a material can pick; layouts, render pass and
+// shader modules follow from vertex format and instancing
+struct RenderState {
+    static constexpr uint32_t MAX_CONSTANTS = 4;
+
+    BlendMode blend{BlendMode::Alpha};
+    VkCullModeFlags cullMode{VK_CULL_MODE_BACK_BIT};
+    bool depthWrite{true};
+    VkCompareOp depthCompare{VK_COMPARE_OP_LESS};
+    // constant_id i of both stages takes constants[i], for the first constantCount ids; raw 32 bit
+    // words, floats go in through std::bit_cast
+    std::array<uint32_t, MAX_CONSTANTS> constants{};
+    uint32_t constantCount{0};
+
+    bool operator==(const RenderState&) const = default;
+};
+
+struct RenderStateHash {
+    size_t operator()(const RenderState& state) const;
+};
+
+// what every variant shares, owned by Screen
+struct PipelineTemplate {
+    VkRenderPass renderPass{VK_NULL_HANDLE};
+    VkPipelineLayout layout{VK_NULL_HANDLE};
+    VkPipelineLayout instancedLayout{VK_NULL_HANDLE};
+    // indexed [instanced][vertex format]
+    std::array<std::array<VkShaderModule, 2>, 2> vertexShaders{};
+    // the attributes each vertex shader reads, same indexing
+    std::array<std::array<std::vector<VkVertexInputAttributeDescription>, 2>, 2> attributes;
+    VkShaderModule fragmentShader{VK_NULL_HANDLE};
+};
+
+// graphics pipelines for every render state times vertex format and instancing. state 0 is the
+// default and compiled up front; any other variant compiles on the job system the first time a draw
+// resolves it, and until it is done draws get the default state's pipeline for the same format and
+// instancing, which shares layout and vertex input
+class PipelineVariants {
+public:
+    static constexpr uint32_t COMBINATIONS = 4;
+    static constexpr uint32_t DEFAULT_STATE = 0;
+
+    PipelineVariants() = default;
+
+    ~PipelineVariants() {
+        destroy();
+    }
+
+    PipelineVariants(PipelineVariants const&) = delete;
+    void operator=(PipelineVariants const&) = delete;
+
+    void init(VkDevice dev, PipelineCache& cache, const PipelineTemplate& base);
+    // waits for compiles still running
+    void destroy();
+
+    // the same state always gets the same id; nothing is compiled yet. render thread only
+    uint32_t addState(const RenderState& state);
+    // id of a state's variant, without starting anything
+    static uint32_t getVariant(uint32_t state, VertexFormat format, bool instanced);
+    // the variant a draw with this state, format and instancing binds, starting its compile the
+    // first time. render thread only
+    uint32_t resolve(uint32_t state, VertexFormat format, bool instanced);
+    // the variant's pipeline once compiled, otherwise its fallback. safe from any thread
+    [[nodiscard]] VkPipeline get(uint32_t variant) const;
+    [[nodiscard]] bool isReady(uint32_t variant) const;
+
+    // compiles started and not yet finished
+    [[nodiscard]] uint32_t getPendingCount() const;
+    [[nodiscard]] uint32_t getStateCount() const;
+
+private:
+    struct Variant {
+        std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+        std::future<void> compile;
+        bool requested{false};
+    };
+
+    VkPipeline build(const RenderState& state, uint32_t combination) const;
+
+    VkDevice device{VK_NULL_HANDLE};
+    PipelineCache* pipelineCache{nullptr};
+    PipelineTemplate base;
+    // deques so compile jobs can hold on to their entries while states are added
+    std::deque<RenderState> states;
+    std::deque<Variant> variants;
+    std::unordered_map<RenderState, uint32_t, RenderStateHash> stateIds;
+    std::atomic<uint32_t> pending{0};
+};
+
+
+#endif //STAR_PIPELINEVARIANTS_HPP
@@ -0,0 +1,76 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <array>
+
+uint64_t RenderQueue::makeKey(RenderLayer layer, uint32_t pipeline, uint32_t material, uint32_t geometry, float depth) {
+    constexpr uint32_t depthMax = (1u << DEPTH_BITS) - 1;
+    const auto quantized = static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(depthMax));
+
+    // ids past their field saturate, which only costs sorting quality
+    uint64_t key = static_cast<uint64_t>(layer) << (PIPELINE_BITS + MATERIAL_BITS + GEOMETRY_BITS + DEPTH_BITS);
+    key |= static_cast<uint64_t>(std::min(pipeline, (1u << PIPELINE_BITS) - 1)) << (MATERIAL_BITS + GEOMETRY_BITS + DEPTH_BITS);
+    key |= static_cast<uint64_t>(std::min(material, (1u << MATERIAL_BITS) - 1)) << (GEOMETRY_BITS + DEPTH_BITS);
+    key |= static_cast<uint64_t>(std::min(geometry, (1u << GEOMETRY_BITS) - 1)) << DEPTH_BITS;
+    key |= quantized;
+    return key;
+}
+
+void RenderQueue::clear() {
+    items.clear();
+    materials.clear();
+    geometry.clear();
+}
+
+uint32_t RenderQueue::getMaterialId(VkDescriptorSet set) {
+    return materials.try_emplace(set, static_cast<uint32_t>(materials.size())).first->second;
+}
+
+uint32_t RenderQueue::getGeometryId(const Mesh &mesh) {
+    const BufferPair pair{mesh.getVertexBuffer(), mesh.getIndexBuffer()};
+    return geometry.try_emplace(pair, static_cast<uint32_t>(geometry.size())).first->second;
+}
+
+void RenderQueue::push(const RenderItem &item) {
+    items.push_back(item);
+}
+
+std::span<const RenderItem> RenderQueue::sort() {
+    entries.resize(items.size());
+    scratch.resize(items.size());
+    for (uint32_t i = 0; i < items.size(); ++i) {
+        entries[i] = {items[i].key, i};
+    }
+
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        std::array<uint32_t, 256> offsets{};
+        for (const auto& entry : entries) {
+            ++offsets[(entry.key >> shift) & 0xff];
+        }
+        // everything lands in one bucket, the pass would not move anything
+        if (entries.empty() || offsets[(entries.front().key >> shift) & 0xff] == entries.size()) {
+            continue;
+        }
+
+        uint32_t sum = 0;
+        for (auto& offset : offsets) {
+            const uint32_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (const auto& entry : entries) {
+            scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+
+    sorted.resize(items.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        sorted[i] = items[entries[i].index];
+    }
+    return sorted;
+}
+
+size_t RenderQueue::size() const {
+    return items.size();
+}
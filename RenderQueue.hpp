@@ -0,0 +1,124 @@
+#ifndef STAR_RENDERQUEUE_HPP
+#define STAR_RENDERQUEUE_HPP
+
+#include "Mesh.hpp"
+#include "TextureTable.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// coarsest sort criterion, layers are played back in this order
+enum class RenderLayer : uint8_t {
+    Opaque = 0,
+    // drawn after the opaque layer so early depth testing rejects whatever it would cover
+    Sky = 1,
+};
+
+// one queued draw, everything playback needs to bind and draw it
+struct RenderItem {
+    uint64_t key{0};
+    const Mesh* mesh{nullptr};
+    VkDescriptorSet set{VK_NULL_HANDLE};
+    // PipelineVariants id, its fallback is bound while it compiles
+    uint32_t pipeline{0};
+    // pushed for direct draws, written into the instance records otherwise
+    uint32_t texture{TextureTable::NO_TEXTURE};
+    uint32_t lod{0};
+    uint32_t firstInstance{0};
+    uint32_t instanceCount{1};
+    bool instanced{false};
+};
+
+// binds recorded and binds skipped because the state was already bound, per frame
+struct BindStats {
+    uint32_t draws{0};
+    uint32_t pipelineBinds{0};
+    uint32_t pipelineSkips{0};
+    uint32_t descriptorBinds{0};
+    uint32_t descriptorSkips{0};
+    uint32_t vertexBinds{0};
+    uint32_t vertexSkips{0};
+    uint32_t indexBinds{0};
+    uint32_t indexSkips{0};
+
+    [[nodiscard]] uint32_t getSaved() const {
+        return pipelineSkips + descriptorSkips + vertexSkips + indexSkips;
+    }
+
+    // sums the counts of command buffers recorded side by side
+    BindStats& operator+=(const BindStats& other) {
+        draws += other.draws;
+        pipelineBinds += other.pipelineBinds;
+        pipelineSkips += other.pipelineSkips;
+        descriptorBinds += other.descriptorBinds;
+        descriptorSkips += other.descriptorSkips;
+        vertexBinds += other.vertexBinds;
+        vertexSkips += other.vertexSkips;
+        indexBinds += other.indexBinds;
+        indexSkips += other.indexSkips;
+        return *this;
+    }
+};
+
+// draws collected over a frame and played back sorted by a packed 64 bit key, so that draws
+// sharing pipeline, descriptor set and geometry buffers end up next to each other:
+//   63..60 layer | 59..52 pipeline | 51..36 material | 35..20 geometry | 19..0 depth
+class RenderQueue {
+public:
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t GEOMETRY_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 20;
+
+    // depth in [0, 1], front to back within everything else that matches
+    static uint64_t makeKey(RenderLayer layer, uint32_t pipeline, uint32_t material, uint32_t geometry, float depth);
+
+    void clear();
+
+    // small ids handed out in first submission order, reset by clear
+    uint32_t getMaterialId(VkDescriptorSet set);
+    // meshes sharing vertex and index buffers (arena meshes) share an id
+    uint32_t getGeometryId(const Mesh& mesh);
+
+    void push(const RenderItem& item);
+    // stable lsd radix sort on the keys, one byte per pass; passes where every key has the same
+    // byte are skipped
+    std::span<const RenderItem> sort();
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct BufferPair {
+        VkBuffer vertex;
+        VkBuffer index;
+
+        bool operator==(const BufferPair&) const = default;
+    };
+
+    struct BufferPairHash {
+        size_t operator()(const BufferPair& pair) const {
+            const size_t a = std::hash<VkBuffer>()(pair.vertex);
+            return a ^ (std::hash<VkBuffer>()(pair.index) + 0x9e3779b9 + (a << 6) + (a >> 2));
+        }
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<RenderItem> items;
+    std::vector<RenderItem> sorted;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+    std::unordered_map<VkDescriptorSet, uint32_t> materials;
+    std::unordered_map<BufferPair, uint32_t, BufferPairHash> geometry;
+};
+
+
+#endif //STAR_RENDERQUEUE_HPP
@@ -0,0 +1,121 @@
+#include "ResidencyManager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iterator>
+
+void ResidencyManager::init(VmaAllocator alloc, float budgetFraction) {
+    allocator = alloc;
+    fraction = budgetFraction;
+}
+
+void ResidencyManager::destroy() {
+    lru.clear();
+    entries.clear();
+    trackedBytes = 0;
+    pending.clear();
+    pendingBytes = 0;
+    allocator = VK_NULL_HANDLE;
+}
+
+void ResidencyManager::track(uint64_t id, VkDeviceSize bytes, uint64_t frame) {
+    untrack(id);
+    lru.push_back(id);
+    entries[id] = Entry{std::prev(lru.end()), bytes, frame};
+    trackedBytes += bytes;
+}
+
+void ResidencyManager::untrack(uint64_t id) {
+    const auto it = entries.find(id);
+    if (it == entries.end()) {
+        return;
+    }
+
+    trackedBytes -= it->second.bytes;
+    lru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+void ResidencyManager::touch(uint64_t id, uint64_t frame) {
+    const auto it = entries.find(id);
+    if (it == entries.end()) {
+        return;
+    }
+
+    it->second.lastUsed = frame;
+    lru.splice(lru.end(), lru, it->second.lru);
+}
+
+std::vector<uint64_t> ResidencyManager::selectEvictions(uint64_t frame) {
+    std::vector<uint64_t> victims;
+    VkDeviceSize overshoot = getOvershoot();
+    VkDeviceSize selected = 0;
+    for (auto it = lru.begin(); it != lru.end() && overshoot > 0; ++it) {
+        const auto& entry = entries.at(*it);
+        // everything past here is even hotter
+        if (entry.lastUsed + MIN_IDLE_FRAMES > frame) {
+            break;
+        }
+
+        victims.push_back(*it);
+        overshoot -= std::min(overshoot, entry.bytes);
+        selected += entry.bytes;
+    }
+
+    if (selected > 0) {
+        pending.push_back({frame, selected});
+        pendingBytes += selected;
+    }
+    evictions += victims.size();
+    return victims;
+}
+
+void ResidencyManager::releasePending(uint64_t frame) {
+    while (!pending.empty() && pending.front().frame <= frame) {
+        pendingBytes -= pending.front().bytes;
+        pending.pop_front();
+    }
+}
+
+std::vector<HeapBudget> ResidencyManager::getBudgets() const {
+    assert(allocator);
+
+    const VkPhysicalDeviceMemoryProperties* props = nullptr;
+    vmaGetMemoryProperties(allocator, &props);
+
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(allocator, budgets.data());
+
+    std::vector<HeapBudget> out;
+    for (uint32_t h = 0; h < props->memoryHeapCount; ++h) {
+        if (props->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            out.push_back({h, budgets[h].usage, budgets[h].budget});
+        }
+    }
+    return out;
+}
+
+VkDeviceSize ResidencyManager::getOvershoot() const {
+    VkDeviceSize overshoot = 0;
+    for (const auto& heap : getBudgets()) {
+        const auto target = static_cast<VkDeviceSize>(static_cast<double>(heap.budget) * fraction);
+        if (heap.usage > target) {
+            overshoot += heap.usage - target;
+        }
+    }
+    // the heaps still show evictions whose frees wait for their frames to finish
+    return overshoot - std::min(overshoot, pendingBytes);
+}
+
+VkDeviceSize ResidencyManager::getPendingBytes() const {
+    return pendingBytes;
+}
+
+VkDeviceSize ResidencyManager::getTrackedBytes() const {
+    return trackedBytes;
+}
+
+size_t ResidencyManager::getEvictionCount() const {
+    return evictions;
+}
@@ -0,0 +1,73 @@
+#ifndef STAR_RESIDENCYMANAGER_HPP
+#define STAR_RESIDENCYMANAGER_HPP
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// one device local heap as VMA sees it, budget comes from VK_EXT_memory_budget when available
+struct HeapBudget {
+    uint32_t heap{0};
+    VkDeviceSize usage{0};
+    VkDeviceSize budget{0};
+};
+
+// least recently used list of gpu resident assets, keyed by an id their owner picks; when the device
+// local heaps run over budget the coldest entries are handed back to the owner for eviction
+class ResidencyManager {
+public:
+    // entries drawn this recently are never picked, their frames may still be in flight
+    static constexpr uint64_t MIN_IDLE_FRAMES = 3;
+
+    // budgetFraction leaves headroom below the reported budget for the driver and transient allocations
+    void init(VmaAllocator alloc, float budgetFraction = 0.9f);
+    void destroy();
+
+    void track(uint64_t id, VkDeviceSize bytes, uint64_t frame);
+    void untrack(uint64_t id);
+    // marks the entry as used in frame, moving it to the hot end
+    void touch(uint64_t id, uint64_t frame);
+
+    // coldest first, just enough entries to get back under budget; the caller frees them and untracks.
+    // their bytes count as freed from here on, until releasePending says the memory is really gone
+    std::vector<uint64_t> selectEvictions(uint64_t frame);
+    // the frees of evictions selected up to and including frame have run
+    void releasePending(uint64_t frame);
+
+    [[nodiscard]] std::vector<HeapBudget> getBudgets() const;
+    // bytes above the target summed over the device local heaps
+    [[nodiscard]] VkDeviceSize getOvershoot() const;
+    // evicted but still waiting for the frames in flight before the memory goes back
+    [[nodiscard]] VkDeviceSize getPendingBytes() const;
+    [[nodiscard]] VkDeviceSize getTrackedBytes() const;
+    [[nodiscard]] size_t getEvictionCount() const;
+
+private:
+    struct Entry {
+        std::list<uint64_t>::iterator lru;
+        VkDeviceSize bytes{0};
+        uint64_t lastUsed{0};
+    };
+
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    float fraction{0.9f};
+    std::list<uint64_t> lru; // front is coldest
+    std::unordered_map<uint64_t, Entry> entries;
+    VkDeviceSize trackedBytes{0};
+    struct Pending {
+        uint64_t frame;
+        VkDeviceSize bytes;
+    };
+    std::deque<Pending> pending;
+    VkDeviceSize pendingBytes{0};
+    size_t evictions{0};
+};
+
+
+#endif //STAR_RESIDENCYMANAGER_HPP
@@ -4,8 +4,12 @@
 
 #include "Screen.hpp"
 #include "Vertex.hpp"
+#include "JobSystem.hpp"
+#include "DescriptorSet.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <set>
 
@@ -18,7 +22,11 @@
 #include <iostream>
 
 #include "shaders/build/shader.vert.spv.inl"
+#include "shaders/build/shader_compact.vert.spv.inl"
+#include "shaders/build/shader_indirect.vert.spv.inl"
+#include "shaders/build/shader_indirect_compact.vert.spv.inl"
 #include "shaders/build/shader.frag.spv.inl"
+#include "shaders/build/shader_set0.frag.spv.inl"
 
 #define MAX_FRAMES_IN_FLIGHT 2
 
@@ -41,7 +49,7 @@ VkFormat Screen::findDepthFormat() {
     return findSupportedFormat(
             {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
             VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
     );
 }
 
@@ -49,16 +57,6 @@ static bool hasStencilComponent(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-std::vector<char> fromArray(const std::vector<unsigned char>& data) {
-    std::vector<char> out;
-    out.reserve(data.size());
-    for (const auto c : data) {
-        out.push_back(c);
-    }
-
-    return out;
-}
-
 Screen& Screen::getInstance() {
     static Screen screen;
     return screen;
@@ -125,6 +123,21 @@ SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurface
     return details;
 }
 
+static bool hasDevExtension(VkPhysicalDevice device, const char* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> available(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, available.data());
+
+    for (const auto& extension : available) {
+        if (strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool checkDevExtensionSupport(VkPhysicalDevice device) {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -154,6 +167,26 @@ bool isDeviceSuitable(VkPhysicalDevice pd, VkSurfaceKHR surface) {
     return indices.isComplete() && extensionsSupported && swapchainAdequate;
 }
 
+// the texture table: a partially bound runtime array indexed per draw and written after bind. none of
+// it is mandated by 1.3, and the vulkan 1.2 feature struct may only be queried on a 1.2 device
+bool supportsTextureTable(VkPhysicalDevice pd) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(pd, &props);
+    if (props.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(pd, &features2);
+    return supported12.descriptorIndexing && supported12.runtimeDescriptorArray && supported12.descriptorBindingPartiallyBound &&
+           supported12.shaderSampledImageArrayNonUniformIndexing && supported12.descriptorBindingSampledImageUpdateAfterBind &&
+           supported12.descriptorBindingUpdateUnusedWhilePending;
+}
+
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
     for (const auto& format : availableFormats) {
         if (format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -283,20 +316,32 @@ void Screen::create() {
     std::vector<VkPhysicalDevice> devices(numDevices);
     vkEnumeratePhysicalDevices(instance, &numDevices, devices.data());
 
+    // a device with the texture table wins, otherwise the first suitable one samples set 0's texture
+    VkPhysicalDevice fallback = VK_NULL_HANDLE;
     for (VkPhysicalDevice dev : devices) {
         vkGetPhysicalDeviceProperties(dev, &properties);
         vkGetPhysicalDeviceFeatures(dev, &features);
 
         const bool fitness = (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) && features.geometryShader;
         if (fitness && isDeviceSuitable(dev, surface)) {
-            pDevice = dev;
-            break;
+            if (supportsTextureTable(dev)) {
+                pDevice = dev;
+                break;
+            }
+            if (fallback == VK_NULL_HANDLE) {
+                fallback = dev;
+            }
         }
     }
 
+    if (pDevice == VK_NULL_HANDLE) {
+        pDevice = fallback;
+    }
     if (pDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("no suitable device found");
     }
+    vkGetPhysicalDeviceProperties(pDevice, &properties);
+    vkGetPhysicalDeviceFeatures(pDevice, &features);
 
 
     QueueFamilyIndices indices = findQueueFamilies(pDevice, surface);
@@ -313,51 +358,87 @@ void Screen::create() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // indirect draws from the culling pass carry the instance index in firstInstance, without it
+    // the gpu culled path is off and callers draw cpu culled meshes instead
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    vkGetPhysicalDeviceFeatures(pDevice, &supportedFeatures);
     VkPhysicalDeviceFeatures devFeatures{};
+    devFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    gpuCulling = devFeatures.drawIndirectFirstInstance == VK_TRUE;
+    std::vector<const char*> enabledExtensions(deviceExtensions.begin(), deviceExtensions.end());
+
+    // 8 bit indices are optional, small meshes fall back to 16 bit without them
+    VkPhysicalDeviceIndexTypeUint8FeaturesEXT uint8Features{};
+    uint8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+    uint8Indices = false;
+    if (hasDevExtension(pDevice, VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &uint8Features;
+        vkGetPhysicalDeviceFeatures2(pDevice, &features2);
+        uint8Indices = uint8Features.indexTypeUint8 == VK_TRUE;
+    }
+
+    // draw indirect count is core since 1.2 but still optional, the gpu culling path falls back without it
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &supported12;
+        vkGetPhysicalDeviceFeatures2(pDevice, &features2);
+    }
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.drawIndirectCount = supported12.drawIndirectCount;
+    indirectCount = features12.drawIndirectCount == VK_TRUE;
+
+    // without the texture table the main pipelines use the fragment shader built without it, and every
+    // draw samples set 0's texture
+    bindlessTextures = supportsTextureTable(pDevice);
+    if (bindlessTextures) {
+        features12.descriptorIndexing = VK_TRUE;
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+        features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    }
 
     VkDeviceCreateInfo logicalDevCreateInfo{};
     logicalDevCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     logicalDevCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
     logicalDevCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     logicalDevCreateInfo.pEnabledFeatures = &devFeatures;
-    logicalDevCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    logicalDevCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    logicalDevCreateInfo.pNext = &features12;
+    if (uint8Indices) {
+        enabledExtensions.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+        uint8Features.pNext = nullptr;
+        features12.pNext = &uint8Features;
+    }
+    // lets vma report real per-heap budgets instead of guessing from the heap size
+    memoryBudget = hasDevExtension(pDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget) {
+        enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    logicalDevCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    logicalDevCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     if (vkCreateDevice(pDevice, &logicalDevCreateInfo, nullptr, &device) != VK_SUCCESS) {
         throw std::runtime_error("cannot create logical device");
     }
 
+    // properties was queried again for the picked device after the search
+    char* prefPath = SDL_GetPrefPath("patrick", "star");
+    pipelineCache.init(device, properties, prefPath ? prefPath : ".");
+    SDL_free(prefPath);
+
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
 
     auto swapChainSupport = querySwapChainSupport(pDevice, surface);
     swapChain.create(device, indices, swapChainSupport, surface, window);
 
-    std::vector<VkDynamicState> dynamicStates = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR,
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
-
-    auto bindingDesc = Vertex::getBindingDesc();
-    auto attribDescs = Vertex::getAttributeDescs();
-
-    VkPipelineVertexInputStateCreateInfo vertexInput{};
-    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInput.vertexBindingDescriptionCount = 1;
-    vertexInput.pVertexBindingDescriptions = &bindingDesc;
-    vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribDescs.size());
-    vertexInput.pVertexAttributeDescriptions = attribDescs.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
     VmaAllocationCreateInfo vmaInfo{};
     vmaInfo.usage = VMA_MEMORY_USAGE_AUTO;
     vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
@@ -366,130 +447,49 @@ void Screen::create() {
     VmaAllocatorCreateInfo allocatorCreateInfo{};
     allocatorCreateInfo.device = device;
     allocatorCreateInfo.instance = instance;
-    allocatorCreateInfo.flags = 0;
+    allocatorCreateInfo.flags = memoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0;
     allocatorCreateInfo.physicalDevice = pDevice;
+    allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_3;
 
     vmaCreateAllocator(&allocatorCreateInfo, &allocator);
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChain.getExtent().width;
-    viewport.height = (float)swapChain.getExtent().height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChain.getExtent();
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.scissorCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f; // Optional
-    multisampling.pSampleMask = nullptr; // Optional
-    multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-    multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-
-    addVertexShader("main", fromArray(std::vector(shader_vert->begin(), shader_vert->end())));
-    addFragmentShader("main", fromArray(std::vector(shader_frag->begin(), shader_frag->end())));
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-//    colorBlendAttachment.blendEnable = VK_FALSE;
-//    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-//    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-//    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-//    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-//    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-//    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-    colorBlendAttachment.blendEnable = VK_TRUE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f; // Optional
-    colorBlending.blendConstants[1] = 0.0f; // Optional
-    colorBlending.blendConstants[2] = 0.0f; // Optional
-    colorBlending.blendConstants[3] = 0.0f; // Optional
-
-    // descriptor set layout info
-    VkDescriptorSetLayoutBinding uboLayoutBinding{};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 1;
-    samplerLayoutBinding.descriptorCount = 1;
-//    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    VkDescriptorSetLayoutBinding textureLayoutBinding{};
-    textureLayoutBinding.binding = 2;
-    textureLayoutBinding.descriptorCount = 1;
-    textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    textureLayoutBinding.pImmutableSamplers = nullptr;
-    textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, textureLayoutBinding};
-
-    VkDescriptorSetLayoutCreateInfo dsLayoutInfo{};
-    dsLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    dsLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    dsLayoutInfo.pBindings = bindings.data();
-    if (vkCreateDescriptorSetLayout(device, &dsLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create descriptor set layout");
-    }
-
-    // pipeline layout info
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create pipeline layout");
+    // indexed instanced * 2 + vertex format, like PipelineTemplate::vertexShaders
+    const std::array<std::span<const uint32_t>, 4> vertexCode = {
+            shader_vert,
+            shader_compact_vert,
+            shader_indirect_vert,
+            shader_indirect_compact_vert,
+    };
+    const std::span<const uint32_t> fragmentCode = bindlessTextures ? std::span<const uint32_t>(shader_frag)
+                                                                    : std::span<const uint32_t>(shader_set0_frag);
+    addVertexShader("main", vertexCode[0]);
+    addFragmentShader("main", fragmentCode);
+
+    // set 0 and the push constants come from the shaders themselves. every vertex shader shares them
+    // with the fragment shader, so set 0 stays bound whichever pipeline a draw switches to
+    std::array<ShaderReflection, 4> vertexReflections;
+    materialReflection = ShaderReflection(fragmentCode);
+    for (size_t i = 0; i < vertexCode.size(); ++i) {
+        vertexReflections[i] = ShaderReflection(vertexCode[i]);
+        materialReflection.merge(vertexReflections[i]);
     }
 
+    layoutCache.init(device);
+    const auto materialBindings = materialReflection.getSet(0);
+    descriptorSetLayout = layoutCache.getSetLayout(materialBindings);
+    const auto pushConstantRanges = materialReflection.getPushConstantRanges();
+
+    descriptorCache.init(device, MAX_FRAMES_IN_FLIGHT);
+    const std::array<VkDescriptorUpdateTemplateEntry, 3> materialEntries = {{
+            {getMaterialBinding("ubo"), 0, 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+             offsetof(MaterialDescriptors, ubo), sizeof(VkDescriptorBufferInfo)},
+            {getMaterialBinding("texSampler"), 0, 1, VK_DESCRIPTOR_TYPE_SAMPLER,
+             offsetof(MaterialDescriptors, sampler), sizeof(VkDescriptorImageInfo)},
+            {getMaterialBinding("tex"), 0, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+             offsetof(MaterialDescriptors, texture), sizeof(VkDescriptorImageInfo)},
+    }};
+    materialTemplate = descriptorCache.createTemplate(descriptorSetLayout, materialEntries);
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChain.getImageFormat();
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -497,8 +497,9 @@ void Screen::create() {
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // layouts stay put through both passes, the frame graph transitions around them
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -508,10 +509,11 @@ void Screen::create() {
     depthAttachment.format = findDepthFormat();
     depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // kept for the depth pyramid and the late pass
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference depthAttachmentRef{};
@@ -532,55 +534,78 @@ void Screen::create() {
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
     if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass");
     }
 
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f; // Optional
-    depthStencil.maxDepthBounds = 1.0f; // Optional
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {}; // Optional
-    depthStencil.back = {}; // Optional
-
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = pipelineShaders.data();
-    pipelineInfo.pVertexInputState = &vertexInput;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = &depthStencil;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-    pipelineInfo.basePipelineIndex = -1; // Optional
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline");
+    // same attachments, so the swapchain framebuffers and every pipeline stay compatible with it
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    std::array<VkAttachmentDescription, 2> lateAttachments = {colorAttachment, depthAttachment};
+    renderPassInfo.pAttachments = lateAttachments.data();
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &lateRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create late render pass");
     }
 
+    // indirect variants for the gpu culling path: set 1 holds the culled instances, push constants
+    // stay identical so set 0 remains bound when switching between the direct and indirect pipelines
+    gpuCuller.init(device, allocator, MAX_FRAMES_IN_FLIGHT, indirectCount);
+    depthPyramid.init(device);
+    // instanced draws reuse the indirect pipelines, their vertex shaders read the same records
+    instanceBuffer.init(device, allocator, MAX_FRAMES_IN_FLIGHT, gpuCuller.getSetLayout());
+
+    // direct and indirect pipelines share one layout: set 1 is the culling layout, a superset of what
+    // the indirect vertex shaders declare there, and set 2 the texture table where the device has one,
+    // so no pipeline switch disturbs a bound set
+    std::vector<VkDescriptorSetLayout> setLayouts = {descriptorSetLayout, gpuCuller.getSetLayout()};
+    if (bindlessTextures) {
+        const ReflectedBinding* textures = materialReflection.findBinding("textures");
+        if (!textures || textures->set != TextureTable::SET) {
+            throw std::runtime_error("the main shaders do not declare the texture table in set 2");
+        }
+        VkPhysicalDeviceVulkan12Properties properties12{};
+        properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &properties12;
+        vkGetPhysicalDeviceProperties2(pDevice, &properties2);
+        textureTable.init(device, layoutCache, textures->binding, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                          MAX_FRAMES_IN_FLIGHT);
+        setLayouts.push_back(textureTable.getSetLayout());
+    }
+    pipelineLayout = layoutCache.getPipelineLayout(setLayouts, pushConstantRanges);
+    indirectPipelineLayout = pipelineLayout;
+
+    // indexed [instanced][vertex format], the main pair came in through addVertexShader and addFragmentShader
+    PipelineTemplate pipelineTemplate{};
+    pipelineTemplate.renderPass = renderPass;
+    pipelineTemplate.layout = pipelineLayout;
+    pipelineTemplate.instancedLayout = indirectPipelineLayout;
+    pipelineTemplate.fragmentShader = pipelineShaders[1].module;
+    pipelineTemplate.vertexShaders[0][0] = pipelineShaders[0].module;
+    for (uint32_t i = 1; i < vertexCode.size(); ++i) {
+        pipelineTemplate.vertexShaders[i / 2][i % 2] = Shader::createShaderModule(device, vertexCode[i]);
+        shaders.push_back(pipelineTemplate.vertexShaders[i / 2][i % 2]);
+    }
+    // vertex attributes the shader reads, in the format the vertex layout stores them
+    for (uint32_t i = 0; i < vertexCode.size(); ++i) {
+        const auto format = static_cast<VertexFormat>(i % 2);
+        const auto available = Vertex::getAttributeDescs(format);
+        auto& attributes = pipelineTemplate.attributes[i / 2][i % 2];
+        for (const auto& input : vertexReflections[i].getInputs()) {
+            const auto it = std::find_if(available.begin(), available.end(), [&](const VkVertexInputAttributeDescription& desc) {
+                return desc.location == input.location;
+            });
+            if (it == available.end()) {
+                throw std::runtime_error("vertex shader input " + input.name + " is missing from the vertex format");
+            }
+            attributes.push_back(*it);
+        }
+    }
+    pipelineVariants.init(device, pipelineCache, pipelineTemplate);
+
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -594,8 +619,17 @@ void Screen::create() {
     swapChain.setRenderPass(device, renderPass);
 
     frameProcessor.init(device, commandPool, MAX_FRAMES_IN_FLIGHT);
+    // one slot for the draws callback and one queue chunk for every thread taking part in parallelFor
+    commandRecorder.init(device, indices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT,
+                         static_cast<uint32_t>(JobSystem::getInstance().getNumWorkers()) + 2);
+    uploadEngine.init(device, allocator, graphicsQueue, indices.graphicsFamily.value());
+    geometryArena.init(allocator);
+    residencyManager.init(allocator);
+
+    depthPyramid.resize(swapChain.getDepthImage().getImageView(), swapChain.getExtent());
+    frameGraph.init(device, allocator);
+    buildFrameGraph();
 
-    createDescriptorPool();
     createTextureSampler();
 }
 
@@ -606,25 +640,44 @@ void Screen::destroy() {
 
         vkDestroySampler(device, sampler, nullptr);
 
+        // before the arena goes, evicted meshes give their ranges back to it
+        drainDeferredReleases();
+
         assert(uniformBuffers.size() == uniformBuffersAlloc.size());
         for (size_t i = 0; i < uniformBuffers.size(); ++i) {
             vmaDestroyBuffer(getAllocator(), uniformBuffers[i], uniformBuffersAlloc[i]);
         }
 
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        textureTable.destroy();
+        descriptorCache.destroy();
 
         frameProcessor.destroy();
+        commandRecorder.destroy();
+        // the pyramid's level views go before the graph's transient image they view
+        depthPyramid.destroy();
+        frameGraph.destroy();
+        uploadEngine.destroy();
+        geometryArena.destroy();
+        residencyManager.destroy();
+        gpuCuller.destroy();
+        instanceBuffer.destroy();
 
         vkDestroyCommandPool(device, commandPool, nullptr);
         for (const auto info : pipelineShaders) {
             vkDestroyShaderModule(device, info.module, nullptr);
         }
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        for (const auto module : shaders) {
+            vkDestroyShaderModule(device, module, nullptr);
+        }
+        pipelineVariants.destroy();
+        layoutCache.destroy();
+        pipelineCache.destroy();
         swapChain.destroy(device);
+        // the swapchain's depth image is freed through deferRelease as well
+        drainDeferredReleases();
         vmaDestroyAllocator(allocator);
+        vkDestroyRenderPass(device, lateRenderPass, nullptr);
         vkDestroyRenderPass(device, renderPass, nullptr);
         vkDestroySurfaceKHR(instance, surface, nullptr);
         vkDestroyDevice(device, nullptr);
@@ -638,7 +691,7 @@ void Screen::destroy() {
     }
 }
 
-void Screen::addVertexShader(const std::string& name, const std::vector<char>& data) {
+void Screen::addVertexShader(const std::string& name, std::span<const uint32_t> data) {
     auto shader = Shader::createShaderModule(device, data);
 
     VkPipelineShaderStageCreateInfo info{};
@@ -650,7 +703,7 @@ void Screen::addVertexShader(const std::string& name, const std::vector<char>& d
     pipelineShaders.push_back(info);
 }
 
-void Screen::addFragmentShader(const std::string &name, const std::vector<char>& data) {
+void Screen::addFragmentShader(const std::string &name, std::span<const uint32_t> data) {
     auto shader = Shader::createShaderModule(device, data);
 
     VkPipelineShaderStageCreateInfo info{};
@@ -679,11 +732,91 @@ void Screen::endCommandBuffer(VkCommandBuffer cb) {
     }
 }
 
+void Screen::buildFrameGraph() {
+    frameGraph.reset();
+
+    // the main pass clears both attachments, nothing from before the frame is kept
+    const VkFormat depthFormat = findDepthFormat();
+    colorTarget = frameGraph.importImage("swapchain", {VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT, 1,
+                                                       FrameAccess::Present, FrameAccess::Present, true});
+    depthTarget = frameGraph.importImage("depth", {VK_NULL_HANDLE,
+                                                   hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT,
+                                                   1, FrameAccess::DepthAttachment, FrameAccess::DepthAttachment, true});
+    // only read by the late culling of the same frame, its memory is the graph's
+    pyramidTarget = frameGraph.createImage("depth pyramid", depthPyramid.getImageDesc());
+    // commands, counts and the visibility carried into the next frame, last touched by the
+    // readback copy which the late phase's writes are chained behind
+    cullBuffers = frameGraph.importBuffer("culling", FrameAccess::TransferWrite, FrameAccess::TransferWrite);
+
+    const auto early = frameGraph.addPass("early culling", [this](VkCommandBuffer cb) {
+        gpuCuller.dispatch(cb, frameProcessor.getCurrentFrame());
+    });
+    frameGraph.write(early, cullBuffers, FrameAccess::TransferWrite);
+    frameGraph.write(early, cullBuffers, FrameAccess::ComputeWrite);
+
+    const auto mainPass = frameGraph.addPass("main", [this](VkCommandBuffer cb) {
+        recordMainPass(cb);
+    });
+    frameGraph.write(mainPass, colorTarget, FrameAccess::ColorAttachment);
+    frameGraph.write(mainPass, depthTarget, FrameAccess::DepthAttachment);
+    frameGraph.read(mainPass, cullBuffers, FrameAccess::IndirectRead);
+
+    pyramidPass = frameGraph.addPass("depth pyramid", [this](VkCommandBuffer cb) {
+        depthPyramid.build(cb);
+    });
+    frameGraph.read(pyramidPass, depthTarget, FrameAccess::DepthSampled);
+    frameGraph.write(pyramidPass, pyramidTarget, FrameAccess::ComputeWrite);
+
+    lateCullPass = frameGraph.addPass("late culling", [this](VkCommandBuffer cb) {
+        gpuCuller.dispatchLate(cb, frameProcessor.getCurrentFrame());
+    });
+    frameGraph.read(lateCullPass, pyramidTarget, FrameAccess::ComputeRead);
+    frameGraph.read(lateCullPass, cullBuffers, FrameAccess::ComputeRead);
+    frameGraph.write(lateCullPass, cullBuffers, FrameAccess::ComputeWrite);
+
+    const auto latePass = frameGraph.addPass("late", [this](VkCommandBuffer cb) {
+        recordLatePass(cb);
+    });
+    frameGraph.read(latePass, colorTarget, FrameAccess::ColorAttachment);
+    frameGraph.write(latePass, colorTarget, FrameAccess::ColorAttachment);
+    frameGraph.read(latePass, depthTarget, FrameAccess::DepthAttachment);
+    frameGraph.read(latePass, cullBuffers, FrameAccess::IndirectRead);
+
+    // runs every frame, after whichever culling phase wrote the counts last
+    const auto readbackPass = frameGraph.addPass("culling readback", [this](VkCommandBuffer cb) {
+        gpuCuller.copyCounts(cb, frameProcessor.getCurrentFrame());
+    });
+    frameGraph.read(readbackPass, cullBuffers, FrameAccess::TransferRead);
+    frameGraph.write(readbackPass, cullBuffers, FrameAccess::TransferWrite);
+
+    frameGraph.compile();
+    depthPyramid.setImage(frameGraph.getImage(pyramidTarget), frameGraph.getImageView(pyramidTarget));
+    gpuCuller.setPyramid(depthPyramid);
+}
+
 void Screen::doRenderPass(std::function<void(Screen&)> draws, VkCommandBuffer cb, uint32_t imageIndex) {
+    frameGraph.setImage(colorTarget, swapChain.getImage(imageIndex));
+    frameGraph.setImage(depthTarget, swapChain.getDepthImage().getImage());
+
+    // two phase occlusion culling: reduce what the main pass drew into the depth pyramid, test
+    // every instance against it and draw the ones the early phase missed
+    const bool late = gpuCuller.getInstanceCount() > 0 && gpuCuller.getOcclusion();
+    frameGraph.setEnabled(pyramidPass, late);
+    frameGraph.setEnabled(lateCullPass, late);
+
+    frameDraws = &draws;
+    frameFramebuffer = swapChain.getFrameBuffer(imageIndex);
+    frameGraph.execute(cb);
+    frameDraws = nullptr;
+}
+
+void Screen::recordMainPass(VkCommandBuffer cb) {
+    assert(frameDraws);
+
     VkRenderPassBeginInfo rpInfo{};
     rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     rpInfo.renderPass = renderPass;
-    rpInfo.framebuffer = swapChain.getFrameBuffer(imageIndex);
+    rpInfo.framebuffer = frameFramebuffer;
     rpInfo.renderArea.offset = {0, 0};
     rpInfo.renderArea.extent = swapChain.getExtent();
 
@@ -693,22 +826,25 @@ void Screen::doRenderPass(std::function<void(Screen&)> draws, VkCommandBuffer cb
     rpInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     rpInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(cb, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swapChain.getExtent().width);
-    viewport.height = static_cast<float>(swapChain.getExtent().height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(cb, 0, 1, &viewport);
+    // a subpass takes either inline commands or secondaries, so in parallel mode even the draws
+    // callback records into a secondary
+    const uint32_t frame = frameProcessor.getCurrentFrame();
+    std::vector<VkCommandBuffer> secondaries;
+    if (parallelRecording) {
+        vkCmdBeginRenderPass(cb, &rpInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        recording = commandRecorder.begin(frame, 0, renderPass, rpInfo.framebuffer);
+        secondaries.push_back(recording);
+    } else {
+        vkCmdBeginRenderPass(cb, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+        recording = cb;
+    }
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChain.getExtent();
-    vkCmdSetScissor(cb, 0, 1, &scissor);
+    bound = {};
+    bound.pipeline = pipelineVariants.get(PipelineVariants::DEFAULT_STATE);
+    vkCmdBindPipeline(recording, VK_PIPELINE_BIND_POINT_GRAPHICS, bound.pipeline);
+    culledDescriptorSet = VK_NULL_HANDLE;
+    setViewport(recording);
+    bindTextureTable(recording);
 
 //    VkBuffer vertexBuffers[] = {vertexBuffer};
 //    VkDeviceSize offsets[] = {0};
@@ -716,13 +852,62 @@ void Screen::doRenderPass(std::function<void(Screen&)> draws, VkCommandBuffer cb
 
 //    vkCmdDraw(cb, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
 
-    draws(*this);
+    (*frameDraws)(*this);
+    lastBindStats = {};
+    flushRenderQueue(recording, rpInfo.framebuffer, secondaries);
+    lastBindStats += bound.stats;
+
+    if (parallelRecording) {
+        commandRecorder.end(recording);
+        vkCmdExecuteCommands(cb, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    }
+    recording = cb;
+
+    vkCmdEndRenderPass(cb);
+}
+
+void Screen::recordLatePass(VkCommandBuffer cb) {
+    VkRenderPassBeginInfo rpInfo{};
+    rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    rpInfo.renderPass = lateRenderPass;
+    rpInfo.framebuffer = frameFramebuffer;
+    rpInfo.renderArea.offset = {0, 0};
+    rpInfo.renderArea.extent = swapChain.getExtent();
 
+    const uint32_t frame = frameProcessor.getCurrentFrame();
+    vkCmdBeginRenderPass(cb, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (gpuCuller.hasInstances(frame) && gpuCuller.getOcclusion() && culledDescriptorSet) {
+        setViewport(cb);
+        bindTextureTable(cb);
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipelineLayout, 0, 1, &culledDescriptorSet, 0, nullptr);
+        gpuCuller.draw(cb, frame, indirectPipelineLayout, getDefaultPipeline(VertexFormat::Standard, true),
+                       getDefaultPipeline(VertexFormat::Compact, true), CullPhase::Late);
+    }
     vkCmdEndRenderPass(cb);
 }
 
 void Screen::drawFrame(std::function<void(Screen&)> draws) {
     vkWaitForFences(device, 1, frameProcessor.fence(), VK_TRUE, UINT64_MAX);
+    // the fence covers every frame up to MAX_FRAMES_IN_FLIGHT back, and the uploads submitted before them
+    if (frameNumber >= MAX_FRAMES_IN_FLIGHT) {
+        const uint64_t done = frameNumber - MAX_FRAMES_IN_FLIGHT;
+        bool released = false;
+        while (!deferredReleases.empty() && deferredReleases.front().frame <= done) {
+            deferredReleases.front().release();
+            deferredReleases.pop_front();
+            released = true;
+        }
+        // freed ranges only lower heap usage once a whole arena block is empty
+        if (released) {
+            geometryArena.trim();
+        }
+        residencyManager.releasePending(done);
+    }
+    descriptorCache.beginFrame(frameProcessor.getCurrentFrame());
+    textureTable.beginFrame();
+    gpuCuller.readBack(frameProcessor.getCurrentFrame());
+    instanceBuffer.reset(frameProcessor.getCurrentFrame());
+    commandRecorder.reset(frameProcessor.getCurrentFrame());
 
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChain.getChain(), UINT64_MAX, *frameProcessor.imageAvailableSem(), VK_NULL_HANDLE, &imageIndex);
@@ -734,6 +919,17 @@ void Screen::drawFrame(std::function<void(Screen&)> draws) {
     }
 
     vkResetFences(device, 1, frameProcessor.fence());
+    vmaSetCurrentFrameIndex(allocator, static_cast<uint32_t>(frameNumber));
+
+    // geometry staged since the last frame lands before this frame's draws
+    uploadEngine.flush();
+
+    // the pyramid follows the depth attachment through swapchain recreation
+    if (!depthPyramid.matches(swapChain.getDepthImage().getImageView(), swapChain.getExtent())) {
+        vkDeviceWaitIdle(device);
+        depthPyramid.resize(swapChain.getDepthImage().getImageView(), swapChain.getExtent());
+        buildFrameGraph();
+    }
 
     vkResetCommandBuffer(*frameProcessor.commandBuffer(), 0);
     recordCommandBuffer(*frameProcessor.commandBuffer(), imageIndex);
@@ -776,14 +972,75 @@ void Screen::drawFrame(std::function<void(Screen&)> draws) {
     }
 
     frameProcessor.nextFrame();
+    ++frameNumber;
 }
 
 VmaAllocator Screen::getAllocator() {
     return allocator;
 }
 
+void Screen::deferRelease(std::function<void()> release) {
+    deferredReleases.push_back({std::move(release), frameNumber});
+}
+
+void Screen::drainDeferredReleases() {
+    while (!deferredReleases.empty()) {
+        auto release = std::move(deferredReleases.front().release);
+        deferredReleases.pop_front();
+        release();
+    }
+}
+
+UploadEngine &Screen::getUploadEngine() {
+    return uploadEngine;
+}
+
+GeometryArena &Screen::getGeometryArena() {
+    return geometryArena;
+}
+
+ResidencyManager &Screen::getResidencyManager() {
+    return residencyManager;
+}
+
+GpuCuller &Screen::getGpuCuller() {
+    return gpuCuller;
+}
+
+PipelineCache &Screen::getPipelineCache() {
+    return pipelineCache;
+}
+
+const PipelineVariants &Screen::getPipelineVariants() const {
+    return pipelineVariants;
+}
+
+LayoutCache &Screen::getLayoutCache() {
+    return layoutCache;
+}
+
+DescriptorCache &Screen::getDescriptorCache() {
+    return descriptorCache;
+}
+
+VkDescriptorUpdateTemplate Screen::getMaterialTemplate() const {
+    return materialTemplate;
+}
+
+TextureTable &Screen::getTextureTable() {
+    return textureTable;
+}
+
+uint32_t Screen::getMaterialBinding(const std::string &name) const {
+    const ReflectedBinding* binding = materialReflection.findBinding(name);
+    if (!binding || binding->set != 0) {
+        throw std::runtime_error("no material binding named " + name);
+    }
+    return binding->binding;
+}
+
 VkCommandBuffer* Screen::getCommandBuffer() {
-    return frameProcessor.commandBuffer();
+    return &recording;
 }
 
 VkDevice Screen::getDevice() {
@@ -823,10 +1080,37 @@ void Screen::setUniformData(UniformBufferData data) {
 }
 
 void Screen::bindDescriptorSet(VkDescriptorSet descriptorSet) {
+    bindSet(recording, bound, descriptorSet);
+}
+
+void Screen::bindSet(VkCommandBuffer cb, RecordState &state, VkDescriptorSet set) {
+    if (set == state.descriptorSet) {
+        ++state.stats.descriptorSkips;
+        return;
+    }
+
     vkCmdBindDescriptorSets(
-            *getCommandBuffer(),
+            cb,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+            pipelineLayout, 0, 1, &set, 0, nullptr);
+    state.descriptorSet = set;
+    ++state.stats.descriptorBinds;
+}
+
+void Screen::setViewport(VkCommandBuffer cb) {
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(swapChain.getExtent().width);
+    viewport.height = static_cast<float>(swapChain.getExtent().height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cb, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChain.getExtent();
+    vkCmdSetScissor(cb, 0, 1, &scissor);
 }
 
 float Screen::getWidth() const {
@@ -837,51 +1121,16 @@ float Screen::getHeight() const {
     return (float)swapChain.getExtent().height;
 }
 
-void Screen::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 3> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-//    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-//    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 4;
-    descriptorMax = poolInfo.maxSets;
-
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool");
-    }
-}
-
 std::vector<VkDescriptorSet> Screen::allocDescriptorSets(uint32_t num) {
-    assert(descriptorCount + num <= descriptorMax);
-
-    std::vector<VkDescriptorSet> sets;
-
-    std::vector<VkDescriptorSetLayout> layouts(num, descriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(num);
-    allocInfo.pSetLayouts = layouts.data();
-
-    sets.resize(num);
-    if (const auto result = vkAllocateDescriptorSets(device, &allocInfo, sets.data()); result != VK_SUCCESS) {
-        std::cout << string_VkResult(result) << std::endl;
-        throw std::runtime_error("failed to alloc desc sets");
+    std::vector<VkDescriptorSet> sets(num);
+    for (auto& set : sets) {
+        set = descriptorCache.allocate(descriptorSetLayout);
     }
+    return sets;
+}
 
-    descriptorCount += num;
-
-    return std::move(sets);
+VkDescriptorSet Screen::allocFrameDescriptorSet() {
+    return descriptorCache.allocateTransient(frameProcessor.getCurrentFrame(), descriptorSetLayout);
 }
 
 void Screen::createDescriptorSets() {
@@ -908,14 +1157,262 @@ void Screen::createDescriptorSets() {
     }
 }
 
-void Screen::drawMesh(const Mesh &mesh) {
-    assert(frameProcessor.commandBuffer());
+VkPipeline Screen::getDefaultPipeline(VertexFormat format, bool instanced) const {
+    return pipelineVariants.get(PipelineVariants::getVariant(PipelineVariants::DEFAULT_STATE, format, instanced));
+}
+
+void Screen::bindMesh(VkCommandBuffer cb, RecordState &state, const Mesh &mesh, uint32_t variant, bool instanced, uint32_t texture) {
+    // every pipeline shares one layout, so bound descriptor sets and push constants survive the switch
+    const bool compact = mesh.getVertexFormat() == VertexFormat::Compact;
+    const VkPipeline pipeline = pipelineVariants.get(variant);
+    if (pipeline != state.pipeline) {
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        state.pipeline = pipeline;
+        ++state.stats.pipelineBinds;
+    } else {
+        ++state.stats.pipelineSkips;
+    }
 
-    VkBuffer vertexBuffers[] = {mesh.getVertexBuffer()};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(*frameProcessor.commandBuffer(), 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(*frameProcessor.commandBuffer(), mesh.getIndexBuffer(), 0, VK_INDEX_TYPE_UINT16);
-    vkCmdDrawIndexed(*frameProcessor.commandBuffer(), mesh.getNumIndices(), 1, 0, 0, 0);
+    // instance records carry their own dequantization
+    if (compact && !instanced) {
+        const VertexDequantization dq = mesh.getDequantization();
+        vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(dq), &dq);
+    }
+    if (!instanced && state.texture != texture) {
+        vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, TextureTable::PUSH_OFFSET, sizeof(texture), &texture);
+        state.texture = texture;
+    }
+
+    // arena meshes share buffers and are addressed through firstIndex/vertexOffset instead
+    if (mesh.getVertexBuffer() != state.vertexBuffer) {
+        VkBuffer vertexBuffers[] = {mesh.getVertexBuffer()};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(cb, 0, 1, vertexBuffers, offsets);
+        state.vertexBuffer = mesh.getVertexBuffer();
+        ++state.stats.vertexBinds;
+    } else {
+        ++state.stats.vertexSkips;
+    }
+
+    if (mesh.getIndexBuffer() != state.indexBuffer || mesh.getIndexType() != state.indexType) {
+        vkCmdBindIndexBuffer(cb, mesh.getIndexBuffer(), 0, mesh.getIndexType());
+        state.indexBuffer = mesh.getIndexBuffer();
+        state.indexType = mesh.getIndexType();
+        ++state.stats.indexBinds;
+    } else {
+        ++state.stats.indexSkips;
+    }
+}
+
+void Screen::bindTextureTable(VkCommandBuffer cb) {
+    if (!bindlessTextures) {
+        return;
+    }
+    const VkDescriptorSet set = textureTable.getSet();
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, TextureTable::SET, 1, &set, 0, nullptr);
+}
+
+void Screen::bindInstanceSet(VkCommandBuffer cb, RecordState &state) {
+    const VkDescriptorSet set = instanceBuffer.getSet(frameProcessor.getCurrentFrame());
+    if (set != state.instanceSet) {
+        state.instanceSet = set;
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipelineLayout, 1, 1, &state.instanceSet, 0, nullptr);
+        ++state.stats.descriptorBinds;
+    } else {
+        ++state.stats.descriptorSkips;
+    }
+}
+
+void Screen::drawMesh(const Mesh &mesh, uint32_t lod, uint32_t texture) {
+    assert(recording);
+
+    bindMesh(recording, bound, mesh, PipelineVariants::getVariant(PipelineVariants::DEFAULT_STATE, mesh.getVertexFormat(), false), false, texture);
+    const MeshLod level = mesh.getLod(lod);
+    vkCmdDrawIndexed(recording, level.indexCount, 1, mesh.getFirstIndex() + level.firstIndex, mesh.getVertexOffset(), 0);
+    ++bound.stats.draws;
+}
+
+void Screen::drawMeshInstanced(const Mesh &mesh, std::span<const glm::mat4> models, uint32_t lod, uint32_t texture) {
+    assert(recording);
+    if (models.empty()) {
+        return;
+    }
+
+    const uint32_t frame = frameProcessor.getCurrentFrame();
+    const uint32_t firstInstance = instanceBuffer.push(frame, mesh, models, texture);
+
+    bindMesh(recording, bound, mesh, PipelineVariants::getVariant(PipelineVariants::DEFAULT_STATE, mesh.getVertexFormat(), true), true);
+    bindInstanceSet(recording, bound);
+
+    const MeshLod level = mesh.getLod(lod);
+    vkCmdDrawIndexed(recording, level.indexCount, static_cast<uint32_t>(models.size()), mesh.getFirstIndex() + level.firstIndex,
+                     mesh.getVertexOffset(), firstInstance);
+    ++bound.stats.draws;
+}
+
+uint32_t Screen::addRenderState(const RenderState &state) {
+    return pipelineVariants.addState(state);
+}
+
+void Screen::queueMesh(const Mesh &mesh, VkDescriptorSet set, float depth, uint32_t lod, RenderLayer layer, uint32_t renderState,
+                       uint32_t texture) {
+    RenderItem item{};
+    item.pipeline = pipelineVariants.resolve(renderState, mesh.getVertexFormat(), false);
+    item.key = RenderQueue::makeKey(layer, item.pipeline, renderQueue.getMaterialId(set), renderQueue.getGeometryId(mesh), depth);
+    item.mesh = &mesh;
+    item.set = set;
+    item.texture = texture;
+    item.lod = lod;
+    renderQueue.push(item);
+}
+
+void Screen::queueMeshInstanced(const Mesh &mesh, VkDescriptorSet set, std::span<const glm::mat4> models, float depth,
+                                uint32_t lod, RenderLayer layer, uint32_t renderState, uint32_t texture) {
+    if (models.empty()) {
+        return;
+    }
+
+    RenderItem item{};
+    item.pipeline = pipelineVariants.resolve(renderState, mesh.getVertexFormat(), true);
+    item.key = RenderQueue::makeKey(layer, item.pipeline, renderQueue.getMaterialId(set), renderQueue.getGeometryId(mesh), depth);
+    item.mesh = &mesh;
+    item.set = set;
+    item.lod = lod;
+    item.texture = texture;
+    item.firstInstance = instanceBuffer.push(frameProcessor.getCurrentFrame(), mesh, models, texture);
+    item.instanceCount = static_cast<uint32_t>(models.size());
+    item.instanced = true;
+    renderQueue.push(item);
+}
+
+void Screen::recordItems(VkCommandBuffer cb, RecordState &state, std::span<const RenderItem> items) {
+    for (const auto& item : items) {
+        bindSet(cb, state, item.set);
+        bindMesh(cb, state, *item.mesh, item.pipeline, item.instanced, item.texture);
+        if (item.instanced) {
+            bindInstanceSet(cb, state);
+        }
+
+        const MeshLod level = item.mesh->getLod(item.lod);
+        vkCmdDrawIndexed(cb, level.indexCount, item.instanceCount, item.mesh->getFirstIndex() + level.firstIndex,
+                         item.mesh->getVertexOffset(), item.firstInstance);
+        ++state.stats.draws;
+    }
+}
+
+void Screen::flushRenderQueue(VkCommandBuffer cb, VkFramebuffer framebuffer, std::vector<VkCommandBuffer> &secondaries) {
+    const auto items = renderQueue.sort();
+    const size_t chunks = std::min<size_t>(commandRecorder.getSlotCount() - 1,
+                                           (items.size() + MIN_ITEMS_PER_CHUNK - 1) / MIN_ITEMS_PER_CHUNK);
+    if (!parallelRecording || chunks <= 1) {
+        recordItems(cb, bound, items);
+        renderQueue.clear();
+        return;
+    }
+
+    // contiguous chunks keep the sort order, and with it most of the elided binds; every chunk
+    // starts from nothing bound and pays for its first binds again
+    const uint32_t frame = frameProcessor.getCurrentFrame();
+    std::vector<VkCommandBuffer> buffers(chunks);
+    std::vector<RecordState> states(chunks);
+    JobSystem::getInstance().parallelFor(chunks, [&](size_t chunk) {
+        const size_t first = items.size() * chunk / chunks;
+        const size_t last = items.size() * (chunk + 1) / chunks;
+        VkCommandBuffer secondary = commandRecorder.begin(frame, static_cast<uint32_t>(chunk) + 1, renderPass, framebuffer);
+        setViewport(secondary);
+        bindTextureTable(secondary);
+        recordItems(secondary, states[chunk], items.subspan(first, last - first));
+        commandRecorder.end(secondary);
+        buffers[chunk] = secondary;
+    });
+
+    secondaries.insert(secondaries.end(), buffers.begin(), buffers.end());
+    for (const auto& state : states) {
+        lastBindStats += state.stats;
+    }
+    renderQueue.clear();
+}
+
+const BindStats &Screen::getBindStats() const {
+    return lastBindStats;
+}
+
+void Screen::setParallelRecording(bool enabled) {
+    parallelRecording = enabled;
+}
+
+bool Screen::getParallelRecording() const {
+    return parallelRecording;
+}
+
+void Screen::drawCulled() {
+    assert(recording);
+    assert(gpuCulling);
+
+    gpuCuller.draw(recording, frameProcessor.getCurrentFrame(), indirectPipelineLayout, getDefaultPipeline(VertexFormat::Standard, true),
+                   getDefaultPipeline(VertexFormat::Compact, true));
+    culledDescriptorSet = bound.descriptorSet;
+
+    // the indirect path binds its own pipelines, buffers and set 1
+    bound.pipeline = VK_NULL_HANDLE;
+    bound.instanceSet = VK_NULL_HANDLE;
+    bound.vertexBuffer = VK_NULL_HANDLE;
+    bound.indexBuffer = VK_NULL_HANDLE;
+    bound.indexType = VK_INDEX_TYPE_MAX_ENUM;
+}
+
+uint32_t Screen::drawMeshlets(const Mesh &mesh, const glm::mat4 &model, const Frustum &frustum, const glm::vec3 &eye, uint32_t texture) {
+    assert(recording);
+
+    const auto meshlets = mesh.getMeshlets();
+    if (meshlets.empty()) {
+        drawMesh(mesh, 0, texture);
+        return 0;
+    }
+
+    VkCommandBuffer cb = recording;
+    bindMesh(cb, bound, mesh, PipelineVariants::getVariant(PipelineVariants::DEFAULT_STATE, mesh.getVertexFormat(), false), false, texture);
+    const uint32_t baseIndex = mesh.getFirstIndex();
+    const int32_t vertexOffset = mesh.getVertexOffset();
+
+    // cone tests run in object space, which assumes the model matrix has no shear or non-uniform scale
+    const glm::vec3 localEye = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+    const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    // neighbouring visible clusters are contiguous in the index buffer and merge into one draw
+    uint32_t visible = 0;
+    uint32_t runFirst = 0;
+    uint32_t runCount = 0;
+    for (const auto& meshlet : meshlets) {
+        const glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(meshlet.sphere), 1.0f));
+        if (!frustum.intersectsSphere(center, meshlet.sphere.w * scale)) {
+            continue;
+        }
+
+        const glm::vec3 apex = glm::vec3(meshlet.coneApex);
+        const glm::vec3 axis = glm::vec3(meshlet.cone);
+        if (glm::dot(glm::normalize(apex - localEye), axis) >= meshlet.cone.w) {
+            continue;
+        }
+
+        ++visible;
+        if (runCount > 0 && runFirst + runCount == meshlet.firstIndex) {
+            runCount += meshlet.indexCount;
+            continue;
+        }
+        if (runCount > 0) {
+            vkCmdDrawIndexed(cb, runCount, 1, baseIndex + runFirst, vertexOffset, 0);
+            ++bound.stats.draws;
+        }
+        runFirst = meshlet.firstIndex;
+        runCount = meshlet.indexCount;
+    }
+    if (runCount > 0) {
+        vkCmdDrawIndexed(cb, runCount, 1, baseIndex + runFirst, vertexOffset, 0);
+        ++bound.stats.draws;
+    }
+
+    return visible;
 }
 
 VkCommandBuffer Screen::beginSingleTimeCommandBuffer() {
@@ -1111,10 +1608,26 @@ VkSampler Screen::getSampler() {
     return sampler;
 }
 
+bool Screen::supportsUint8Indices() const {
+    return uint8Indices;
+}
+
+bool Screen::supportsGpuCulling() const {
+    return gpuCulling;
+}
+
+bool Screen::supportsBindlessTextures() const {
+    return bindlessTextures;
+}
+
 uint32_t Screen::getCurrentFrame() {
     return frameProcessor.getCurrentFrame();
 }
 
+uint64_t Screen::getFrameNumber() const {
+    return frameNumber;
+}
+
 void Screen::createDepthResources() {
     Texture depthImage;
     VkFormat depthFormat = findDepthFormat();
@@ -9,12 +9,29 @@
 #include "UniformBufferData.hpp"
 #include "Mesh.hpp"
 #include "Texture.hpp"
+#include "Frustum.hpp"
+#include "UploadEngine.hpp"
+#include "ResidencyManager.hpp"
+#include "DepthPyramid.hpp"
+#include "GpuCuller.hpp"
+#include "InstanceBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "CommandRecorder.hpp"
+#include "FrameGraph.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineVariants.hpp"
+#include "LayoutCache.hpp"
+#include "DescriptorCache.hpp"
+#include "TextureTable.hpp"
+#include "ShaderReflection.hpp"
 
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
+#include <deque>
 #include <functional>
 #include <optional>
+#include <span>
 #include <vector>
 
 struct SDL_Window;
@@ -97,11 +114,18 @@ public:
         return framebuffers[index];
     }
 
+    VkImage getImage(uint32_t index) {
+        return images[index];
+    }
+
     VkSwapchainKHR getChain() {
         return swapChain;
     }
 
     void setDepthImage(Texture& texture);
+    [[nodiscard]] const Texture& getDepthImage() const {
+        return depthImage;
+    }
 
 private:
     VkRenderPass pass{VK_NULL_HANDLE};
@@ -131,19 +155,72 @@ public:
 
     void recordCommandBuffer(VkCommandBuffer cb, uint32_t imageIndex);
     void endCommandBuffer(VkCommandBuffer cb);
+    // runs the frame graph: early culling, the main pass with draws, the depth pyramid, late
+    // culling and the late pass
     void doRenderPass(std::function<void(Screen&)> draws, VkCommandBuffer cb, uint32_t imageIndex);
     void drawFrame(std::function<void(Screen&)> draws);
-    void addVertexShader(const std::string& name, const std::vector<char>&);
-    void addFragmentShader(const std::string& name, const std::vector<char>&);
+    void addVertexShader(const std::string& name, std::span<const uint32_t>);
+    void addFragmentShader(const std::string& name, std::span<const uint32_t>);
 
     VmaAllocator getAllocator();
-
+    // runs release once every frame in flight and every upload submitted so far is done with the
+    // resources it frees, instead of waiting for the device
+    void deferRelease(std::function<void()> release);
+    UploadEngine& getUploadEngine();
+    GeometryArena& getGeometryArena();
+    ResidencyManager& getResidencyManager();
+    // fill it before drawFrame, the culling dispatch is recorded ahead of the render pass
+    GpuCuller& getGpuCuller();
+    // every pipeline goes through it so the next run can skip compiling
+    PipelineCache& getPipelineCache();
+    // compiles still pending and the like, see addRenderState
+    [[nodiscard]] const PipelineVariants& getPipelineVariants() const;
+    LayoutCache& getLayoutCache();
+    // material sets are acquired through it, see getMaterialTemplate
+    DescriptorCache& getDescriptorCache();
+    // writes set 0 from a MaterialDescriptors
+    [[nodiscard]] VkDescriptorUpdateTemplate getMaterialTemplate() const;
+    // bindless textures, its indices go to the draw and queue calls below
+    TextureTable& getTextureTable();
+    // set 0 binding of the named variable in the main shaders, as reflected from their SPIR-V
+    [[nodiscard]] uint32_t getMaterialBinding(const std::string& name) const;
+
+    // the buffer the draws callback records into: the frame's primary, or a secondary while
+    // recording in parallel
     VkCommandBuffer* getCommandBuffer();
 
     VkDevice getDevice();
 
     void setUniformData(UniformBufferData data);
-    void drawMesh(const Mesh& mesh);
+    void drawMesh(const Mesh& mesh, uint32_t lod = 0, uint32_t texture = TextureTable::NO_TEXTURE);
+    // draws level 0 cluster by cluster, skipping clusters outside the frustum or facing away from eye;
+    // returns the number of clusters drawn
+    uint32_t drawMeshlets(const Mesh& mesh, const glm::mat4& model, const Frustum& frustum, const glm::vec3& eye,
+                          uint32_t texture = TextureTable::NO_TEXTURE);
+    // draws whatever survived this frame's gpu culling pass with indirect commands, only with
+    // supportsGpuCulling
+    void drawCulled();
+    // one vkCmdDrawIndexed for every model, the transforms go through the frame's instance buffer
+    // instead of set 0's uniform data
+    void drawMeshInstanced(const Mesh& mesh, std::span<const glm::mat4> models, uint32_t lod = 0,
+                           uint32_t texture = TextureTable::NO_TEXTURE);
+    // sorted with everything else queued this frame and drawn once the draws callback returns;
+    // depth in [0, 1] orders otherwise identical draws front to back. with a texture table index,
+    // draws differing only in texture share set 0 and sort together
+    void queueMesh(const Mesh& mesh, VkDescriptorSet set, float depth, uint32_t lod = 0, RenderLayer layer = RenderLayer::Opaque,
+                   uint32_t renderState = PipelineVariants::DEFAULT_STATE, uint32_t texture = TextureTable::NO_TEXTURE);
+    void queueMeshInstanced(const Mesh& mesh, VkDescriptorSet set, std::span<const glm::mat4> models, float depth,
+                            uint32_t lod = 0, RenderLayer layer = RenderLayer::Opaque,
+                            uint32_t renderState = PipelineVariants::DEFAULT_STATE, uint32_t texture = TextureTable::NO_TEXTURE);
+    // id for queueMesh's renderState, the same state always gets the same id. its pipelines compile
+    // on the job system once a queued draw needs them, and draws use the default state until then
+    uint32_t addRenderState(const RenderState& state);
+    // binds issued and elided while recording the last frame
+    [[nodiscard]] const BindStats& getBindStats() const;
+    // records the main pass into secondary command buffers: the draws callback into one, the
+    // sorted render queue split into chunks recorded by the job system's workers
+    void setParallelRecording(bool enabled);
+    [[nodiscard]] bool getParallelRecording() const;
 
     float getWidth() const;
 
@@ -158,21 +235,69 @@ public:
 
     std::pair<VkBuffer, VmaAllocation> createBuffer(VkDeviceSize size, VkBufferUsageFlags useFlags);
     std::vector<VkDescriptorSet> allocDescriptorSets(uint32_t num);
+    // a set 0 valid for the current frame only
+    VkDescriptorSet allocFrameDescriptorSet();
 
     VkSampler getSampler();
 
     void bindDescriptorSet(VkDescriptorSet descriptorSet);
 
     uint32_t getCurrentFrame();
+    // frames submitted since create, never wraps in practice
+    uint64_t getFrameNumber() const;
+
+    // VK_EXT_index_type_uint8 was found and enabled
+    bool supportsUint8Indices() const;
+    // drawIndirectFirstInstance was found and enabled; without it nothing may go through the
+    // GpuCuller or drawCulled
+    bool supportsGpuCulling() const;
+    // descriptor indexing was found and the texture table is in use; without it the table hands out
+    // NO_TEXTURE and every draw samples set 0's texture
+    bool supportsBindlessTextures() const;
 
 private:
+    // queued draws below this per chunk are not worth another secondary command buffer
+    static constexpr size_t MIN_ITEMS_PER_CHUNK = 512;
+
+    // what a command buffer has bound so far, one per buffer being recorded
+    struct RecordState {
+        VkPipeline pipeline{VK_NULL_HANDLE};
+        VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+        VkDescriptorSet instanceSet{VK_NULL_HANDLE};
+        VkBuffer vertexBuffer{VK_NULL_HANDLE};
+        VkBuffer indexBuffer{VK_NULL_HANDLE};
+        VkIndexType indexType{VK_INDEX_TYPE_MAX_ENUM};
+        // texture table index at TextureTable::PUSH_OFFSET, empty until the first push
+        std::optional<uint32_t> texture;
+        BindStats stats;
+    };
+
     Screen() = default;
 
     void createUniformBuffers();
-    void createDescriptorPool();
     void createDescriptorSets();
     void createTextureSampler();
     void createDepthResources();
+    // declares the frame's passes and what they touch, again whenever the depth pyramid changes
+    void buildFrameGraph();
+    void recordMainPass(VkCommandBuffer cb);
+    void recordLatePass(VkCommandBuffer cb);
+    // picks the pipeline for the mesh's vertex format, the instanced variant reading the instance
+    // buffer if asked, and binds its buffers, skipping whatever is already bound from the previous mesh;
+    // direct draws push their texture table index
+    void bindMesh(VkCommandBuffer cb, RecordState& state, const Mesh& mesh, uint32_t variant, bool instanced = false,
+                  uint32_t texture = TextureTable::NO_TEXTURE);
+    // set 2, once per command buffer; every pipeline shares the layout, so it stays bound
+    void bindTextureTable(VkCommandBuffer cb);
+    [[nodiscard]] VkPipeline getDefaultPipeline(VertexFormat format, bool instanced) const;
+    void bindInstanceSet(VkCommandBuffer cb, RecordState& state);
+    void bindSet(VkCommandBuffer cb, RecordState& state, VkDescriptorSet set);
+    void setViewport(VkCommandBuffer cb);
+    // records items in order, eliding binds of state that is already bound; only touches state,
+    // so chunks of the same frame can be recorded on different threads
+    void recordItems(VkCommandBuffer cb, RecordState& state, std::span<const RenderItem> items);
+    // sorts the frame's queued draws and records them inline, or into secondaries appended to secondaries
+    void flushRenderQueue(VkCommandBuffer cb, VkFramebuffer framebuffer, std::vector<VkCommandBuffer>& secondaries);
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     SDL_Window *window{};
@@ -187,19 +312,63 @@ private:
     VkPipelineLayout pipelineLayout;
     VkDescriptorSetLayout descriptorSetLayout;
     VkRenderPass renderPass;
-    VkPipeline graphicsPipeline;
+    VkPipelineLayout indirectPipelineLayout;
+    // loads what the main pass drew and adds the late phase of the gpu culling on top
+    VkRenderPass lateRenderPass;
+    // the buffer the draws callback records into and what it has bound so far
+    VkCommandBuffer recording{VK_NULL_HANDLE};
+    RecordState bound;
+    // set 0 at drawCulled, bound again for the late pass
+    VkDescriptorSet culledDescriptorSet{VK_NULL_HANDLE};
     VkCommandPool commandPool;
     FrameProcessor frameProcessor;
+    CommandRecorder commandRecorder;
+    bool parallelRecording{false};
     VmaAllocator allocator;
+    PipelineCache pipelineCache;
+    PipelineVariants pipelineVariants;
+    LayoutCache layoutCache;
+    DescriptorCache descriptorCache;
+    TextureTable textureTable;
+    VkDescriptorUpdateTemplate materialTemplate{VK_NULL_HANDLE};
+    ShaderReflection materialReflection;
+    UploadEngine uploadEngine;
+    GeometryArena geometryArena;
+    ResidencyManager residencyManager;
+    GpuCuller gpuCuller;
+    DepthPyramid depthPyramid;
+    InstanceBuffer instanceBuffer;
+    RenderQueue renderQueue;
+    FrameGraph frameGraph;
+    FrameGraph::ResourceId colorTarget{0};
+    FrameGraph::ResourceId depthTarget{0};
+    FrameGraph::ResourceId pyramidTarget{0};
+    FrameGraph::ResourceId cullBuffers{0};
+    FrameGraph::PassId pyramidPass{0};
+    FrameGraph::PassId lateCullPass{0};
+    // what the graph's passes record this frame, set by doRenderPass
+    std::function<void(Screen&)>* frameDraws{nullptr};
+    VkFramebuffer frameFramebuffer{VK_NULL_HANDLE};
+    BindStats lastBindStats;
+    uint64_t frameNumber{0};
+    struct DeferredRelease {
+        std::function<void()> release;
+        uint64_t frame;
+    };
+    std::deque<DeferredRelease> deferredReleases;
+    // with the device idle, runs every deferred release including those queued while draining
+    void drainDeferredReleases();
     std::vector<VkBuffer> uniformBuffers;
     std::vector<VmaAllocation> uniformBuffersAlloc;
-    VkDescriptorPool descriptorPool;
-    uint32_t descriptorCount{0};
-    uint32_t descriptorMax{0};
     std::vector<VkDescriptorSet> descriptorSets;
     VkSampler sampler{VK_NULL_HANDLE};
     VkPhysicalDeviceProperties properties;
     VkPhysicalDeviceFeatures features;
+    bool uint8Indices{false};
+    bool memoryBudget{false};
+    bool indirectCount{false};
+    bool gpuCulling{false};
+    bool bindlessTextures{false};
     VkPhysicalDevice pDevice;
 
     VkFormat findDepthFormat();
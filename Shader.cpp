@@ -5,28 +5,33 @@
 #include "Shader.hpp"
 
 #include <fstream>
+#include <vector>
 
-static std::vector<char> readFile(const std::string& filename) {
+// whole words, so the buffer is aligned the way vkCreateShaderModule wants it
+static std::vector<uint32_t> readFile(const std::string& filename) {
     std::ifstream in(filename, std::ios::ate | std::ios::binary);
     if (!in) {
         throw std::runtime_error("cannot open shader file " + filename);
     }
 
     const auto size = static_cast<size_t>(in.tellg());
-    std::vector<char> buffer(size);
+    if (size % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("shader file " + filename + " is not SPIR-V");
+    }
+    std::vector<uint32_t> buffer(size / sizeof(uint32_t));
 
     in.seekg(0);
-    in.read(buffer.data(), size);
+    in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(size));
     in.close();
 
     return buffer;
 }
 
-VkShaderModule Shader::createShaderModule(VkDevice device, const std::vector<char>& code) {
+VkShaderModule Shader::createShaderModule(VkDevice device, std::span<const uint32_t> code) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.codeSize = code.size_bytes();
+    createInfo.pCode = code.data();
 
     VkShaderModule module;
     if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS) {
@@ -37,6 +42,6 @@ VkShaderModule Shader::createShaderModule(VkDevice device, const std::vector<cha
 }
 
 VkShaderModule Shader::openFile(VkDevice device, const std::string &fn) {
-    const std::vector<char> data = readFile(fn);
+    const std::vector<uint32_t> data = readFile(fn);
     return createShaderModule(device, data);
 }
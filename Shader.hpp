@@ -7,13 +7,15 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <cstdint>
+#include <span>
 #include <string>
-#include <vector>
 
 class Shader {
 public:
     static VkShaderModule openFile(VkDevice, const std::string&);
-    static VkShaderModule createShaderModule(VkDevice, const std::vector<char>&);
+    // code is read in place, embedded arrays are handed over without a copy
+    static VkShaderModule createShaderModule(VkDevice, std::span<const uint32_t> code);
 };
 
 
@@ -0,0 +1,453 @@
+#include "ShaderReflection.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+// the handful of opcodes and enums reflection needs, from the SPIR-V specification
+namespace spv {
+    constexpr uint32_t MAGIC = 0x07230203;
+
+    constexpr uint32_t OP_NAME = 5;
+    constexpr uint32_t OP_ENTRY_POINT = 15;
+    constexpr uint32_t OP_TYPE_INT = 21;
+    constexpr uint32_t OP_TYPE_FLOAT = 22;
+    constexpr uint32_t OP_TYPE_VECTOR = 23;
+    constexpr uint32_t OP_TYPE_MATRIX = 24;
+    constexpr uint32_t OP_TYPE_IMAGE = 25;
+    constexpr uint32_t OP_TYPE_SAMPLER = 26;
+    constexpr uint32_t OP_TYPE_SAMPLED_IMAGE = 27;
+    constexpr uint32_t OP_TYPE_ARRAY = 28;
+    constexpr uint32_t OP_TYPE_RUNTIME_ARRAY = 29;
+    constexpr uint32_t OP_TYPE_STRUCT = 30;
+    constexpr uint32_t OP_TYPE_POINTER = 32;
+    constexpr uint32_t OP_CONSTANT = 43;
+    constexpr uint32_t OP_VARIABLE = 59;
+    constexpr uint32_t OP_DECORATE = 71;
+    constexpr uint32_t OP_MEMBER_DECORATE = 72;
+
+    constexpr uint32_t DECORATION_BUFFER_BLOCK = 3;
+    constexpr uint32_t DECORATION_ARRAY_STRIDE = 6;
+    constexpr uint32_t DECORATION_MATRIX_STRIDE = 7;
+    constexpr uint32_t DECORATION_BUILT_IN = 11;
+    constexpr uint32_t DECORATION_LOCATION = 30;
+    constexpr uint32_t DECORATION_BINDING = 33;
+    constexpr uint32_t DECORATION_DESCRIPTOR_SET = 34;
+    constexpr uint32_t DECORATION_OFFSET = 35;
+
+    constexpr uint32_t STORAGE_UNIFORM_CONSTANT = 0;
+    constexpr uint32_t STORAGE_INPUT = 1;
+    constexpr uint32_t STORAGE_UNIFORM = 2;
+    constexpr uint32_t STORAGE_PUSH_CONSTANT = 9;
+    constexpr uint32_t STORAGE_STORAGE_BUFFER = 12;
+
+    constexpr uint32_t MODEL_VERTEX = 0;
+    constexpr uint32_t MODEL_FRAGMENT = 4;
+    constexpr uint32_t MODEL_GL_COMPUTE = 5;
+
+    constexpr uint32_t DIM_BUFFER = 5;
+    constexpr uint32_t DIM_SUBPASS_DATA = 6;
+}
+
+namespace {
+    struct Id {
+        uint32_t opcode{0};
+        // operands after the result id
+        std::vector<uint32_t> operands;
+        std::string name;
+        uint32_t set{0};
+        uint32_t binding{0};
+        uint32_t location{0};
+        uint32_t arrayStride{0};
+        bool hasBinding{false};
+        bool hasLocation{false};
+        bool builtIn{false};
+        bool bufferBlock{false};
+        std::vector<uint32_t> memberOffsets;
+        std::vector<uint32_t> memberMatrixStrides;
+    };
+
+    std::string readString(const uint32_t* words, size_t count) {
+        const char* chars = reinterpret_cast<const char*>(words);
+        return {chars, strnlen(chars, count * sizeof(uint32_t))};
+    }
+
+    class Module {
+    public:
+        explicit Module(std::span<const uint32_t> code) : words(code) {
+            if (words.size() < 5 || words[0] != spv::MAGIC) {
+                throw std::runtime_error("shader code is not SPIR-V");
+            }
+            ids.resize(words[3]);
+
+            for (size_t i = 5; i < words.size();) {
+                const uint32_t opcode = words[i] & 0xffff;
+                const uint32_t count = words[i] >> 16;
+                if (count == 0 || i + count > words.size()) {
+                    throw std::runtime_error("truncated SPIR-V instruction");
+                }
+                parse(opcode, &words[i + 1], count - 1);
+                i += count;
+            }
+        }
+
+        Id& at(uint32_t id) {
+            if (id >= ids.size()) {
+                throw std::runtime_error("SPIR-V id out of bounds");
+            }
+            return ids[id];
+        }
+
+        std::vector<Id> ids;
+        uint32_t model{~0u};
+
+    private:
+        void parse(uint32_t opcode, const uint32_t* ops, uint32_t count) {
+            switch (opcode) {
+                case spv::OP_NAME:
+                    if (count >= 2) {
+                        at(ops[0]).name = readString(ops + 1, count - 1);
+                    }
+                    break;
+                case spv::OP_ENTRY_POINT:
+                    // only the first entry point, the repo's shaders have one each
+                    if (model == ~0u && count >= 1) {
+                        model = ops[0];
+                    }
+                    break;
+                case spv::OP_DECORATE:
+                    if (count >= 2) {
+                        decorate(at(ops[0]), ops[1], count > 2 ? ops[2] : 0);
+                    }
+                    break;
+                case spv::OP_MEMBER_DECORATE:
+                    if (count >= 4) {
+                        Id& type = at(ops[0]);
+                        const uint32_t member = ops[1];
+                        if (ops[2] == spv::DECORATION_OFFSET) {
+                            grow(type.memberOffsets, member)[member] = ops[3];
+                        } else if (ops[2] == spv::DECORATION_MATRIX_STRIDE) {
+                            grow(type.memberMatrixStrides, member)[member] = ops[3];
+                        }
+                    }
+                    break;
+                case spv::OP_TYPE_INT:
+                case spv::OP_TYPE_FLOAT:
+                case spv::OP_TYPE_VECTOR:
+                case spv::OP_TYPE_MATRIX:
+                case spv::OP_TYPE_IMAGE:
+                case spv::OP_TYPE_SAMPLER:
+                case spv::OP_TYPE_SAMPLED_IMAGE:
+                case spv::OP_TYPE_ARRAY:
+                case spv::OP_TYPE_RUNTIME_ARRAY:
+                case spv::OP_TYPE_STRUCT:
+                case spv::OP_TYPE_POINTER:
+                    if (count >= 1) {
+                        Id& id = at(ops[0]);
+                        id.opcode = opcode;
+                        id.operands.assign(ops + 1, ops + count);
+                    }
+                    break;
+                case spv::OP_CONSTANT:
+                case spv::OP_VARIABLE:
+                    // result type comes first, kept as the first operand
+                    if (count >= 2) {
+                        Id& id = at(ops[1]);
+                        id.opcode = opcode;
+                        id.operands.assign(ops, ops + 1);
+                        id.operands.insert(id.operands.end(), ops + 2, ops + count);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        static void decorate(Id& id, uint32_t decoration, uint32_t value) {
+            switch (decoration) {
+                case spv::DECORATION_BUFFER_BLOCK:
+                    id.bufferBlock = true;
+                    break;
+                case spv::DECORATION_ARRAY_STRIDE:
+                    id.arrayStride = value;
+                    break;
+                case spv::DECORATION_BUILT_IN:
+                    id.builtIn = true;
+                    break;
+                case spv::DECORATION_LOCATION:
+                    id.location = value;
+                    id.hasLocation = true;
+                    break;
+                case spv::DECORATION_BINDING:
+                    id.binding = value;
+                    id.hasBinding = true;
+                    break;
+                case spv::DECORATION_DESCRIPTOR_SET:
+                    id.set = value;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        static std::vector<uint32_t>& grow(std::vector<uint32_t>& values, uint32_t index) {
+            if (values.size() <= index) {
+                values.resize(index + 1, 0);
+            }
+            return values;
+        }
+
+        std::span<const uint32_t> words;
+    };
+
+    VkShaderStageFlags stageOf(uint32_t model) {
+        switch (model) {
+            case spv::MODEL_VERTEX:
+                return VK_SHADER_STAGE_VERTEX_BIT;
+            case spv::MODEL_FRAGMENT:
+                return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case spv::MODEL_GL_COMPUTE:
+                return VK_SHADER_STAGE_COMPUTE_BIT;
+            default:
+                throw std::runtime_error("unsupported shader stage");
+        }
+    }
+
+    // bytes a value of the type takes in an explicitly laid out block
+    uint32_t sizeOf(Module& module, uint32_t typeId, uint32_t matrixStride = 0) {
+        const Id& type = module.at(typeId);
+        switch (type.opcode) {
+            case spv::OP_TYPE_INT:
+            case spv::OP_TYPE_FLOAT:
+                return type.operands[0] / 8;
+            case spv::OP_TYPE_VECTOR:
+                return sizeOf(module, type.operands[0]) * type.operands[1];
+            case spv::OP_TYPE_MATRIX:
+                return (matrixStride ? matrixStride : sizeOf(module, type.operands[0])) * type.operands[1];
+            case spv::OP_TYPE_ARRAY: {
+                const Id& length = module.at(type.operands[1]);
+                const uint32_t count = length.opcode == spv::OP_CONSTANT && length.operands.size() > 1 ? length.operands[1] : 1;
+                return (type.arrayStride ? type.arrayStride : sizeOf(module, type.operands[0])) * count;
+            }
+            case spv::OP_TYPE_STRUCT: {
+                uint32_t end = 0;
+                for (size_t m = 0; m < type.operands.size(); ++m) {
+                    const uint32_t offset = m < type.memberOffsets.size() ? type.memberOffsets[m] : 0;
+                    const uint32_t stride = m < type.memberMatrixStrides.size() ? type.memberMatrixStrides[m] : 0;
+                    end = std::max(end, offset + sizeOf(module, type.operands[m], stride));
+                }
+                return end;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    VkFormat inputFormat(Module& module, uint32_t typeId) {
+        const Id& type = module.at(typeId);
+        uint32_t components = 1;
+        const Id* scalar = &type;
+        if (type.opcode == spv::OP_TYPE_VECTOR) {
+            components = type.operands[1];
+            scalar = &module.at(type.operands[0]);
+        }
+        if (scalar->operands.empty() || scalar->operands[0] != 32) {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        static constexpr VkFormat floats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static constexpr VkFormat sints[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+        static constexpr VkFormat uints[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+        if (components < 1 || components > 4) {
+            return VK_FORMAT_UNDEFINED;
+        }
+        if (scalar->opcode == spv::OP_TYPE_FLOAT) {
+            return floats[components - 1];
+        }
+        return scalar->operands.size() > 1 && scalar->operands[1] ? sints[components - 1] : uints[components - 1];
+    }
+}
+
+ShaderReflection::ShaderReflection(std::span<const uint32_t> code) {
+    Module module(code);
+    stages = stageOf(module.model);
+
+    for (uint32_t id = 0; id < module.ids.size(); ++id) {
+        const Id& variable = module.ids[id];
+        if (variable.opcode != spv::OP_VARIABLE || variable.operands.size() < 2) {
+            continue;
+        }
+        const uint32_t storage = variable.operands[1];
+        const Id& pointer = module.at(variable.operands[0]);
+        if (pointer.opcode != spv::OP_TYPE_POINTER || pointer.operands.size() < 2) {
+            continue;
+        }
+        uint32_t typeId = pointer.operands[1];
+
+        if (storage == spv::STORAGE_INPUT) {
+            if (stages == VK_SHADER_STAGE_VERTEX_BIT && variable.hasLocation && !variable.builtIn) {
+                inputs.push_back({variable.location, inputFormat(module, typeId), variable.name});
+            }
+            continue;
+        }
+
+        if (storage == spv::STORAGE_PUSH_CONSTANT) {
+            const Id& block = module.at(typeId);
+            uint32_t offset = 0;
+            if (!block.memberOffsets.empty()) {
+                offset = *std::min_element(block.memberOffsets.begin(), block.memberOffsets.end());
+            }
+            pushConstantStages = stages;
+            pushConstantOffset = offset;
+            pushConstantEnd = sizeOf(module, typeId);
+            continue;
+        }
+
+        if (storage != spv::STORAGE_UNIFORM_CONSTANT && storage != spv::STORAGE_UNIFORM && storage != spv::STORAGE_STORAGE_BUFFER) {
+            continue;
+        }
+        if (!variable.hasBinding) {
+            continue;
+        }
+
+        ReflectedBinding binding{};
+        binding.set = variable.set;
+        binding.binding = variable.binding;
+        binding.stages = stages;
+
+        // arrays of descriptors
+        const Id* type = &module.at(typeId);
+        if (type->opcode == spv::OP_TYPE_ARRAY) {
+            const Id& length = module.at(type->operands[1]);
+            binding.count = length.operands.size() > 1 ? length.operands[1] : 1;
+            typeId = type->operands[0];
+        } else if (type->opcode == spv::OP_TYPE_RUNTIME_ARRAY) {
+            binding.count = 0;
+            typeId = type->operands[0];
+        }
+        type = &module.at(typeId);
+
+        switch (type->opcode) {
+            case spv::OP_TYPE_SAMPLER:
+                binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+                break;
+            case spv::OP_TYPE_SAMPLED_IMAGE:
+                binding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                break;
+            case spv::OP_TYPE_IMAGE: {
+                // operands: sampled type, dim, depth, arrayed, ms, sampled
+                const uint32_t dim = type->operands[1];
+                const uint32_t sampled = type->operands[5];
+                if (dim == spv::DIM_BUFFER) {
+                    binding.type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                } else if (dim == spv::DIM_SUBPASS_DATA) {
+                    binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                } else {
+                    binding.type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                }
+                break;
+            }
+            case spv::OP_TYPE_STRUCT:
+                // before SPIR-V 1.3 storage buffers are uniform blocks decorated BufferBlock
+                binding.type = storage == spv::STORAGE_STORAGE_BUFFER || type->bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                                                                          : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                break;
+            default:
+                throw std::runtime_error("unsupported descriptor type in shader");
+        }
+
+        binding.name = variable.name.empty() ? type->name : variable.name;
+        bindings.push_back(binding);
+    }
+
+    std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+    std::sort(inputs.begin(), inputs.end(), [](const ReflectedInput& a, const ReflectedInput& b) {
+        return a.location < b.location;
+    });
+}
+
+void ShaderReflection::merge(const ShaderReflection &other) {
+    stages |= other.stages;
+
+    for (const auto& binding : other.bindings) {
+        auto it = std::find_if(bindings.begin(), bindings.end(), [&](const ReflectedBinding& b) {
+            return b.set == binding.set && b.binding == binding.binding;
+        });
+        if (it == bindings.end()) {
+            bindings.push_back(binding);
+            continue;
+        }
+        if (it->type != binding.type || it->count != binding.count) {
+            throw std::runtime_error("shader stages disagree on set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding));
+        }
+        it->stages |= binding.stages;
+    }
+    std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+
+    if (other.pushConstantStages) {
+        if (pushConstantStages) {
+            pushConstantOffset = std::min(pushConstantOffset, other.pushConstantOffset);
+            pushConstantEnd = std::max(pushConstantEnd, other.pushConstantEnd);
+        } else {
+            pushConstantOffset = other.pushConstantOffset;
+            pushConstantEnd = other.pushConstantEnd;
+        }
+        pushConstantStages |= other.pushConstantStages;
+    }
+
+    // a merged reflection keeps the vertex stage's inputs
+    if (inputs.empty()) {
+        inputs = other.inputs;
+    }
+}
+
+VkShaderStageFlags ShaderReflection::getStages() const {
+    return stages;
+}
+
+const std::vector<ReflectedBinding> &ShaderReflection::getBindings() const {
+    return bindings;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::getSet(uint32_t set) const {
+    std::vector<VkDescriptorSetLayoutBinding> result;
+    for (const auto& binding : bindings) {
+        if (binding.set != set) {
+            continue;
+        }
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.binding = binding.binding;
+        layoutBinding.descriptorType = binding.type;
+        layoutBinding.descriptorCount = binding.count;
+        layoutBinding.stageFlags = binding.stages;
+        result.push_back(layoutBinding);
+    }
+    return result;
+}
+
+uint32_t ShaderReflection::getSetCount() const {
+    return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+std::vector<VkPushConstantRange> ShaderReflection::getPushConstantRanges() const {
+    if (!pushConstantStages) {
+        return {};
+    }
+    return {{pushConstantStages, pushConstantOffset, pushConstantEnd - pushConstantOffset}};
+}
+
+const std::vector<ReflectedInput> &ShaderReflection::getInputs() const {
+    return inputs;
+}
+
+const ReflectedBinding *ShaderReflection::findBinding(const std::string &name) const {
+    const auto it = std::find_if(bindings.begin(), bindings.end(), [&](const ReflectedBinding& b) {
+        return b.name == name;
+    });
+    return it == bindings.end() ? nullptr : &*it;
+}
@@ -0,0 +1,66 @@
+#ifndef STAR_SHADERREFLECTION_HPP
+#define STAR_SHADERREFLECTION_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ReflectedBinding {
+    uint32_t set{0};
+    uint32_t binding{0};
+    VkDescriptorType type{VK_DESCRIPTOR_TYPE_MAX_ENUM};
+    // 0 for runtime sized arrays
+    uint32_t count{1};
+    VkShaderStageFlags stages{0};
+    // the variable's name, or its block's when the variable has none
+    std::string name;
+};
+
+struct ReflectedInput {
+    uint32_t location{0};
+    // what the shader reads, the vertex buffer may hold it in a narrower format
+    VkFormat format{VK_FORMAT_UNDEFINED};
+    std::string name;
+};
+
+// descriptor bindings, push constants and vertex inputs read straight from SPIR-V, so layouts follow
+// the shaders instead of being written out next to them. several stages of one pipeline (or of
+// pipelines that have to share a layout) merge into one reflection
+class ShaderReflection {
+public:
+    ShaderReflection() = default;
+    // throws on anything that is not a SPIR-V module
+    explicit ShaderReflection(std::span<const uint32_t> code);
+
+    // stage flags of shared bindings and push constants add up; throws when the stages disagree on a
+    // binding's type or count
+    void merge(const ShaderReflection& other);
+
+    [[nodiscard]] VkShaderStageFlags getStages() const;
+    // sorted by set, then binding
+    [[nodiscard]] const std::vector<ReflectedBinding>& getBindings() const;
+    // ready for VkDescriptorSetLayoutCreateInfo, empty for sets nothing uses
+    [[nodiscard]] std::vector<VkDescriptorSetLayoutBinding> getSet(uint32_t set) const;
+    // one past the highest set used
+    [[nodiscard]] uint32_t getSetCount() const;
+    // at most one range, covering every stage's block
+    [[nodiscard]] std::vector<VkPushConstantRange> getPushConstantRanges() const;
+    // vertex stage only, sorted by location
+    [[nodiscard]] const std::vector<ReflectedInput>& getInputs() const;
+
+    [[nodiscard]] const ReflectedBinding* findBinding(const std::string& name) const;
+
+private:
+    VkShaderStageFlags stages{0};
+    std::vector<ReflectedBinding> bindings;
+    std::vector<ReflectedInput> inputs;
+    VkShaderStageFlags pushConstantStages{0};
+    uint32_t pushConstantOffset{0};
+    uint32_t pushConstantEnd{0};
+};
+
+
+#endif //STAR_SHADERREFLECTION_HPP
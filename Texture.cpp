@@ -6,43 +6,45 @@
 #include "Screen.hpp"
 
 #include <SDL_image.h>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 
-void Texture::load(const std::string &fn) {
+ImageData Texture::decode(const std::string &fn) {
     SDL_Surface* surf = IMG_Load(fn.c_str());
     if (!surf) {
         throw std::runtime_error("cannot open image");
     }
     SDL_Surface* conv = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(surf);
     if (!conv) {
         throw std::runtime_error("cannot convert colors");
     }
-    SDL_FreeSurface(surf);
 
-    VkDeviceSize imageSize = conv->w * conv->h * conv->format->BytesPerPixel;
-    VkBuffer staging;
-    VmaAllocation alloc;
+    ImageData image{};
+    image.width = conv->w;
+    image.height = conv->h;
+    image.pixels.resize(static_cast<size_t>(conv->w) * conv->h * 4);
 
-    VkBufferCreateInfo info{};
-    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    info.size = imageSize;
-    info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    // surfaces may pad their rows, the upload wants them tightly packed
+    const auto* src = static_cast<const std::byte*>(conv->pixels);
+    const size_t rowSize = static_cast<size_t>(conv->w) * 4;
+    for (int32_t y = 0; y < conv->h; ++y) {
+        std::memcpy(image.pixels.data() + rowSize * y, src + static_cast<size_t>(conv->pitch) * y, rowSize);
+    }
+    SDL_FreeSurface(conv);
 
-    VmaAllocationCreateInfo vmaInfo{};
-    vmaInfo.usage = VMA_MEMORY_USAGE_AUTO;
-    vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
-    vmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    return image;
+}
 
-    if (vmaCreateBuffer(Screen::getInstance().getAllocator(), &info, &vmaInfo, &staging, &alloc, nullptr) != VK_SUCCESS) {
-        throw std::runtime_error("cannot create vertex buffer");
-    }
-    vmaCopyMemoryToAllocation(Screen::getInstance().getAllocator(), (uint8_t*)conv->pixels, alloc, 0, imageSize);
+void Texture::load(const std::string &fn) {
+    create(decode(fn));
+}
 
-    width = conv->w;
-    height = conv->h;
-    SDL_FreeSurface(conv);
+void Texture::create(const ImageData &image) {
+    width = image.width;
+    height = image.height;
+    channels = 4;
 
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -71,12 +73,8 @@ void Texture::load(const std::string &fn) {
     };
     vmaBindImageMemory(Screen::getInstance().getAllocator(), textureImageAlloc, textureImage);
 
-    Screen::getInstance().transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    Screen::getInstance().copyBufferToImage(staging, textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-    Screen::getInstance().transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    vkDestroyBuffer(Screen::getInstance().getDevice(), staging, nullptr);
-    vmaFreeMemory(Screen::getInstance().getAllocator(), alloc);
+    // the copy and both layout transitions ride along with the next upload batch, no queue wait
+    Screen::getInstance().getUploadEngine().enqueueImage(textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height), 4, image.pixels);
 
     view = Screen::getInstance().createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
 }
@@ -85,8 +83,12 @@ void Texture::destroy() {
     assert(view);
     assert(textureImage);;
     assert(textureImageAlloc);
-    vkDestroyImageView(Screen::getInstance().getDevice(), view, nullptr);
-    vmaDestroyImage(Screen::getInstance().getAllocator(), textureImage, textureImageAlloc);
+    // frames in flight and the staged copy may still use the image, it is freed once those are done
+    Screen::getInstance().deferRelease([view = view, image = textureImage, alloc = textureImageAlloc] {
+        auto& screen = Screen::getInstance();
+        vkDestroyImageView(screen.getDevice(), view, nullptr);
+        vmaDestroyImage(screen.getAllocator(), image, alloc);
+    });
     view = VK_NULL_HANDLE;
     textureImage = VK_NULL_HANDLE;
     textureImageAlloc = VK_NULL_HANDLE;
@@ -96,6 +98,20 @@ VkImageView Texture::getImageView() const {
     return view;
 }
 
+VkImage Texture::getImage() const {
+    return textureImage;
+}
+
+VkDeviceSize Texture::getMemorySize() const {
+    if (!textureImageAlloc) {
+        return 0;
+    }
+
+    VmaAllocationInfo info{};
+    vmaGetAllocationInfo(Screen::getInstance().getAllocator(), textureImageAlloc, &info);
+    return info.size;
+}
+
 void Texture::createDepthBuffer(uint32_t w, uint32_t h, VkFormat format) {
     width = w;
     height = h;
@@ -111,7 +127,8 @@ void Texture::createDepthBuffer(uint32_t w, uint32_t h, VkFormat format) {
     imageInfo.format = format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+    // sampled by the depth pyramid reduction
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.flags = 0;
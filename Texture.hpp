@@ -8,8 +8,17 @@
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
+
+// decoded, tightly packed RGBA8 pixels
+struct ImageData {
+    int32_t width{0};
+    int32_t height{0};
+    std::vector<std::byte> pixels;
+};
 
 class Texture {
 public:
@@ -47,11 +56,18 @@ public:
         return *this;
     }
 
+    // decode only touches the cpu and is safe on worker threads
+    static ImageData decode(const std::string& fn);
+    // staged through the upload engine, usable by any frame recorded afterwards
+    void create(const ImageData& image);
     void load(const std::string& fn);
     void createDepthBuffer(uint32_t w, uint32_t h, VkFormat format);
     void destroy();
 
     VkImageView getImageView() const;
+    [[nodiscard]] VkImage getImage() const;
+    // bytes of device memory behind the image, 0 once destroyed
+    [[nodiscard]] VkDeviceSize getMemorySize() const;
 
 private:
     int32_t width;
@@ -0,0 +1,151 @@
+#include "TextureTable.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+void TextureTable::init(VkDevice dev, LayoutCache &layoutCache, uint32_t arrayBinding, uint32_t maxTextures, uint32_t framesInFlight) {
+    device = dev;
+    binding = arrayBinding;
+    capacity = std::min(maxTextures, MAX_TEXTURES);
+    frames = framesInFlight;
+
+    // slots never written stay unbound, and free slots are written while the set is in use
+    VkDescriptorSetLayoutBinding layoutBinding{};
+    layoutBinding.binding = binding;
+    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    layoutBinding.descriptorCount = capacity;
+    layoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                           VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    setLayout = layoutCache.getSetLayout(std::span(&layoutBinding, 1), std::span(&flags, 1));
+
+    const VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, capacity};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create texture table pool");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+        throw std::runtime_error("cannot allocate texture table");
+    }
+
+    views.clear();
+    freeSlots.clear();
+    retired.clear();
+    frameCount = 0;
+}
+
+void TextureTable::destroy() {
+    if (!device) {
+        return;
+    }
+
+    // the layout belongs to the layout cache
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    views.clear();
+    freeSlots.clear();
+    retired.clear();
+    device = VK_NULL_HANDLE;
+}
+
+uint32_t TextureTable::add(const Texture &texture) {
+    if (!device) {
+        return NO_TEXTURE;
+    }
+
+    const VkImageView view = texture.getImageView();
+    if (view == VK_NULL_HANDLE) {
+        throw std::runtime_error("null image view");
+    }
+
+    uint32_t index;
+    if (!freeSlots.empty()) {
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (views.size() < capacity) {
+        index = static_cast<uint32_t>(views.size());
+        views.push_back(VK_NULL_HANDLE);
+    } else {
+        throw std::runtime_error("texture table is full");
+    }
+
+    write(index, view);
+    return index;
+}
+
+uint32_t TextureTable::update(uint32_t index, const Texture &texture) {
+    if (!device) {
+        return NO_TEXTURE;
+    }
+
+    assert(index < views.size());
+    if (texture.getImageView() == views[index]) {
+        return index;
+    }
+
+    const uint32_t replacement = add(texture);
+    remove(index);
+    return replacement;
+}
+
+void TextureTable::remove(uint32_t index) {
+    if (!device) {
+        return;
+    }
+
+    assert(index < views.size());
+    retired.push_back({index, frameCount});
+}
+
+void TextureTable::beginFrame() {
+    ++frameCount;
+    while (!retired.empty() && retired.front().frame + frames <= frameCount) {
+        views[retired.front().index] = VK_NULL_HANDLE;
+        freeSlots.push_back(retired.front().index);
+        retired.pop_front();
+    }
+}
+
+VkDescriptorSetLayout TextureTable::getSetLayout() const {
+    return setLayout;
+}
+
+VkDescriptorSet TextureTable::getSet() const {
+    return set;
+}
+
+uint32_t TextureTable::getCapacity() const {
+    return capacity;
+}
+
+uint32_t TextureTable::getCount() const {
+    return static_cast<uint32_t>(views.size() - freeSlots.size());
+}
+
+void TextureTable::write(uint32_t index, VkImageView view) {
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    views[index] = view;
+}
@@ -0,0 +1,79 @@
+#ifndef STAR_TEXTURETABLE_HPP
+#define STAR_TEXTURETABLE_HPP
+
+#include "LayoutCache.hpp"
+#include "Texture.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// bindless textures: one large array of sampled images, bound once per command buffer at set 2 of
+// every graphics pipeline and written after bind. draws pick a slot by index, pushed for direct
+// draws and read from the instance record otherwise, so set 0 no longer changes with the texture
+class TextureTable {
+public:
+    static constexpr uint32_t SET = 2;
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    // draws without an index sample set 0's texture instead
+    static constexpr uint32_t NO_TEXTURE = ~0u;
+    // where direct draws push their index, after the vertex dequantization
+    static constexpr uint32_t PUSH_OFFSET = 32;
+
+    TextureTable() = default;
+
+    ~TextureTable() {
+        destroy();
+    }
+
+    TextureTable(TextureTable const&) = delete;
+    void operator=(TextureTable const&) = delete;
+
+    // binding is where the shaders declare the array in set 2, capacity is clamped to MAX_TEXTURES
+    void init(VkDevice dev, LayoutCache& layoutCache, uint32_t binding, uint32_t capacity, uint32_t framesInFlight);
+    void destroy();
+
+    // a table that was never initialised (no descriptor indexing on the device) hands out NO_TEXTURE,
+    // so callers draw the same way with or without it
+    // writes the texture's current view into a free slot and returns its index
+    uint32_t add(const Texture& texture);
+    // a changed view (e.g. a streamed texture became resident) goes into a new slot, since frames in
+    // flight may still read the old one; returns the index to draw with from now on
+    uint32_t update(uint32_t index, const Texture& texture);
+    // the slot is reused once every frame that could read it has finished
+    void remove(uint32_t index);
+
+    // once the frame's fence has passed
+    void beginFrame();
+
+    [[nodiscard]] VkDescriptorSetLayout getSetLayout() const;
+    [[nodiscard]] VkDescriptorSet getSet() const;
+    [[nodiscard]] uint32_t getCapacity() const;
+    // slots holding a texture, including ones waiting to be reused
+    [[nodiscard]] uint32_t getCount() const;
+
+private:
+    struct Retired {
+        uint32_t index;
+        uint64_t frame;
+    };
+
+    void write(uint32_t index, VkImageView view);
+
+    VkDevice device{VK_NULL_HANDLE};
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    VkDescriptorSetLayout setLayout{VK_NULL_HANDLE};
+    VkDescriptorSet set{VK_NULL_HANDLE};
+    uint32_t binding{0};
+    uint32_t capacity{0};
+    uint32_t frames{0};
+    std::vector<VkImageView> views;
+    std::vector<uint32_t> freeSlots;
+    std::deque<Retired> retired;
+    uint64_t frameCount{0};
+};
+
+
+#endif //STAR_TEXTURETABLE_HPP
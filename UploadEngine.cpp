@@ -0,0 +1,293 @@
+#include "UploadEngine.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+void UploadEngine::init(VkDevice dev, VmaAllocator alloc, VkQueue q, uint32_t queueFamily, VkDeviceSize segSize, uint32_t segmentCount) {
+    assert(device == VK_NULL_HANDLE);
+    assert(segmentCount > 0);
+
+    device = dev;
+    allocator = alloc;
+    queue = q;
+    segmentSize = alignUp(segSize, STAGING_ALIGNMENT);
+
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = segmentSize * segmentCount;
+    info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo vmaInfo{};
+    vmaInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    vmaInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    vmaInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VmaAllocationInfo allocInfo{};
+    if (vmaCreateBuffer(allocator, &info, &vmaInfo, &staging, &stagingAlloc, &allocInfo) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create staging ring");
+    }
+    mapped = static_cast<std::byte*>(allocInfo.pMappedData);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("cannot create upload command pool");
+    }
+
+    batches.resize(segmentCount);
+    std::vector<VkCommandBuffer> commandBuffers(segmentCount);
+
+    VkCommandBufferAllocateInfo cbInfo{};
+    cbInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbInfo.commandPool = commandPool;
+    cbInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cbInfo.commandBufferCount = segmentCount;
+    if (vkAllocateCommandBuffers(device, &cbInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("cannot alloc upload command buffers");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        batches[i].commandBuffer = commandBuffers[i];
+        batches[i].base = segmentSize * i;
+        if (vkCreateFence(device, &fenceInfo, nullptr, &batches[i].fence) != VK_SUCCESS) {
+            throw std::runtime_error("cannot create upload fence");
+        }
+    }
+    current = 0;
+}
+
+void UploadEngine::destroy() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    waitIdle();
+
+    for (const auto& batch : batches) {
+        vkDestroyFence(device, batch.fence, nullptr);
+    }
+    batches.clear();
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    vmaDestroyBuffer(allocator, staging, stagingAlloc);
+
+    mapped = nullptr;
+    device = VK_NULL_HANDLE;
+}
+
+void UploadEngine::enqueue(VkBuffer dst, VkDeviceSize dstOffset, std::span<const std::byte> data) {
+    std::lock_guard lock(mutex);
+    assert(device);
+
+    while (!data.empty()) {
+        if (batches[current].used == segmentSize) {
+            submitCurrent();
+            advance();
+        }
+
+        Batch& batch = batches[current];
+        const VkDeviceSize size = std::min<VkDeviceSize>(data.size(), segmentSize - batch.used);
+        std::memcpy(mapped + batch.base + batch.used, data.data(), size);
+
+        VkBufferCopy region{};
+        region.srcOffset = batch.base + batch.used;
+        region.dstOffset = dstOffset;
+        region.size = size;
+        batch.copies.emplace_back(dst, region);
+        batch.used = std::min(segmentSize, alignUp(batch.used + size, STAGING_ALIGNMENT));
+
+        bytesUploaded += size;
+        dstOffset += size;
+        data = data.subspan(size);
+    }
+}
+
+void UploadEngine::enqueueImage(VkImage image, uint32_t width, uint32_t height, uint32_t texelSize, std::span<const std::byte> texels) {
+    std::lock_guard lock(mutex);
+    assert(device);
+
+    const VkDeviceSize rowSize = static_cast<VkDeviceSize>(width) * texelSize;
+    assert(texels.size() >= rowSize * height);
+    if (rowSize > segmentSize) {
+        throw std::runtime_error("image row does not fit the staging ring");
+    }
+
+    uint32_t row = 0;
+    while (row < height) {
+        Batch* batch = &batches[current];
+        auto rows = static_cast<uint32_t>(std::min<VkDeviceSize>(height - row, (segmentSize - batch->used) / rowSize));
+        if (rows == 0) {
+            submitCurrent();
+            advance();
+            continue;
+        }
+
+        const VkDeviceSize size = rowSize * rows;
+        std::memcpy(mapped + batch->base + batch->used, texels.data() + rowSize * row, size);
+
+        ImageCopy copy{};
+        copy.image = image;
+        copy.region.bufferOffset = batch->base + batch->used;
+        copy.region.bufferRowLength = 0;
+        copy.region.bufferImageHeight = 0;
+        copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.region.imageSubresource.mipLevel = 0;
+        copy.region.imageSubresource.baseArrayLayer = 0;
+        copy.region.imageSubresource.layerCount = 1;
+        copy.region.imageOffset = {0, static_cast<int32_t>(row), 0};
+        copy.region.imageExtent = {width, rows, 1};
+        copy.first = row == 0;
+        copy.last = row + rows == height;
+        batch->imageCopies.push_back(copy);
+        batch->used = std::min(segmentSize, alignUp(batch->used + size, STAGING_ALIGNMENT));
+
+        bytesUploaded += size;
+        row += rows;
+    }
+}
+
+void UploadEngine::flush() {
+    std::lock_guard lock(mutex);
+    if (device == VK_NULL_HANDLE || (batches[current].copies.empty() && batches[current].imageCopies.empty())) {
+        return;
+    }
+
+    submitCurrent();
+    advance();
+}
+
+void UploadEngine::waitIdle() {
+    flush();
+
+    std::lock_guard lock(mutex);
+    for (auto& batch : batches) {
+        if (batch.submitted) {
+            vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(device, 1, &batch.fence);
+            batch.submitted = false;
+        }
+    }
+}
+
+void UploadEngine::submitCurrent() {
+    Batch& batch = batches[current];
+    assert(!batch.submitted);
+    if (batch.copies.empty() && batch.imageCopies.empty()) {
+        return;
+    }
+
+    VkCommandBufferBeginInfo begin{};
+    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+    vkBeginCommandBuffer(batch.commandBuffer, &begin);
+
+    const auto imageBarrier = [](VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags src, VkAccessFlags dst) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = src;
+        barrier.dstAccessMask = dst;
+        return barrier;
+    };
+
+    std::vector<VkImageMemoryBarrier> toTransfer;
+    std::vector<VkImageMemoryBarrier> toShader;
+    for (const auto& copy : batch.imageCopies) {
+        if (copy.first) {
+            toTransfer.push_back(imageBarrier(copy.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+        }
+        if (copy.last) {
+            toShader.push_back(imageBarrier(copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        }
+    }
+
+    if (!toTransfer.empty()) {
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+    }
+
+    // one copy command per destination buffer, carrying all of its regions
+    std::map<VkBuffer, std::vector<VkBufferCopy>> regions;
+    for (const auto& [dst, region] : batch.copies) {
+        regions[dst].push_back(region);
+    }
+    for (const auto& [dst, list] : regions) {
+        vkCmdCopyBuffer(batch.commandBuffer, staging, dst, static_cast<uint32_t>(list.size()), list.data());
+    }
+    for (const auto& copy : batch.imageCopies) {
+        vkCmdCopyBufferToImage(batch.commandBuffer, staging, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(batch.commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                         VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &barrier, 0, nullptr, static_cast<uint32_t>(toShader.size()), toShader.data());
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkSubmitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.commandBufferCount = 1;
+    info.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(queue, 1, &info, batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("cannot submit upload batch");
+    }
+
+    batch.submitted = true;
+    batch.copies.clear();
+    batch.imageCopies.clear();
+    ++batchesSubmitted;
+}
+
+void UploadEngine::advance() {
+    current = (current + 1) % static_cast<uint32_t>(batches.size());
+
+    // the next segment is reusable once the gpu is done reading it
+    Batch& batch = batches[current];
+    if (batch.submitted) {
+        vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &batch.fence);
+        batch.submitted = false;
+    }
+    batch.used = 0;
+}
+
+uint64_t UploadEngine::getBytesUploaded() const {
+    std::lock_guard lock(mutex);
+    return bytesUploaded;
+}
+
+uint64_t UploadEngine::getBatchesSubmitted() const {
+    std::lock_guard lock(mutex);
+    return batchesSubmitted;
+}
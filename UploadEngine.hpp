@@ -0,0 +1,86 @@
+#ifndef STAR_UPLOADENGINE_HPP
+#define STAR_UPLOADENGINE_HPP
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// copies host data into device-local buffers and images through a persistently mapped staging ring;
+// the ring is split into one segment per batch, and a batch is submitted as a single command
+// buffer once its segment fills up or flush() is called
+class UploadEngine {
+public:
+    static constexpr VkDeviceSize DEFAULT_SEGMENT_SIZE = 8ull << 20;
+    static constexpr uint32_t DEFAULT_SEGMENT_COUNT = 4;
+
+    UploadEngine() = default;
+
+    ~UploadEngine() {
+        destroy();
+    }
+
+    UploadEngine(UploadEngine const&) = delete;
+    void operator=(UploadEngine const&) = delete;
+
+    void init(VkDevice dev, VmaAllocator alloc, VkQueue q, uint32_t queueFamily,
+              VkDeviceSize segmentSize = DEFAULT_SEGMENT_SIZE, uint32_t segmentCount = DEFAULT_SEGMENT_COUNT);
+    void destroy();
+
+    // stage data for dst at dstOffset, dst needs VK_BUFFER_USAGE_TRANSFER_DST_BIT; larger than a
+    // segment is fine, it is split across batches
+    void enqueue(VkBuffer dst, VkDeviceSize dstOffset, std::span<const std::byte> data);
+    // stage tightly packed texels for mip level 0 of a color image; the image goes from undefined to
+    // shader read only, images larger than a segment are copied in bands of rows across batches
+    void enqueueImage(VkImage image, uint32_t width, uint32_t height, uint32_t texelSize, std::span<const std::byte> texels);
+    // submit the open batch; copies are visible to vertex input, shaders and transfers submitted afterwards
+    // on the same queue. Submission shares the graphics queue, so call from the thread that submits frames
+    void flush();
+    // flush and block until every submitted batch has finished
+    void waitIdle();
+
+    [[nodiscard]] uint64_t getBytesUploaded() const;
+    [[nodiscard]] uint64_t getBatchesSubmitted() const;
+
+private:
+    struct ImageCopy {
+        VkImage image{VK_NULL_HANDLE};
+        VkBufferImageCopy region{};
+        bool first{false};
+        bool last{false};
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer{VK_NULL_HANDLE};
+        VkFence fence{VK_NULL_HANDLE};
+        VkDeviceSize base{0};
+        VkDeviceSize used{0};
+        bool submitted{false};
+        std::vector<std::pair<VkBuffer, VkBufferCopy>> copies;
+        std::vector<ImageCopy> imageCopies;
+    };
+
+    void submitCurrent();
+    void advance();
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    VkQueue queue{VK_NULL_HANDLE};
+    VkCommandPool commandPool{VK_NULL_HANDLE};
+    VkBuffer staging{VK_NULL_HANDLE};
+    VmaAllocation stagingAlloc{VK_NULL_HANDLE};
+    std::byte* mapped{nullptr};
+    VkDeviceSize segmentSize{0};
+    std::vector<Batch> batches;
+    uint32_t current{0};
+    uint64_t bytesUploaded{0};
+    uint64_t batchesSubmitted{0};
+    mutable std::mutex mutex;
+};
+
+
+#endif //STAR_UPLOADENGINE_HPP
@@ -4,18 +4,50 @@
 
 #include "Vertex.hpp"
 
-VkVertexInputBindingDescription Vertex::getBindingDesc() {
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+uint32_t Vertex::getStride(VertexFormat format) {
+    return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+VkVertexInputBindingDescription Vertex::getBindingDesc(VertexFormat format) {
     VkVertexInputBindingDescription desc{};
 
     desc.binding = 0;
-    desc.stride = sizeof(Vertex);
+    desc.stride = getStride(format);
     desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
     return desc;
 }
 
-std::array<VkVertexInputAttributeDescription, 4> Vertex::getAttributeDescs() {
-    std::array<VkVertexInputAttributeDescription, 4> descs{};
+std::vector<VkVertexInputAttributeDescription> Vertex::getAttributeDescs(VertexFormat format) {
+    if (format == VertexFormat::Compact) {
+        std::vector<VkVertexInputAttributeDescription> descs(3);
+
+        // vertex, dequantized in the shader
+        descs[0].binding = 0;
+        descs[0].location = 0;
+        descs[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        descs[0].offset = offsetof(CompactVertex, pos);
+
+        descs[1].binding = 0;
+        descs[1].location = 1;
+        descs[1].format = VK_FORMAT_R16G16_SNORM;
+        descs[1].offset = offsetof(CompactVertex, norm);
+
+        // texture
+        descs[2].binding = 0;
+        descs[2].location = 3;
+        descs[2].format = VK_FORMAT_R16G16_SFLOAT;
+        descs[2].offset = offsetof(CompactVertex, texture);
+
+        return descs;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> descs(4);
 
     // vertex
     descs[0].binding = 0;
@@ -42,3 +74,61 @@ std::array<VkVertexInputAttributeDescription, 4> Vertex::getAttributeDescs() {
 
     return descs;
 }
+
+VertexDequantization Vertex::computeDequantization(std::span<const Vertex> verts) {
+    VertexDequantization dq{};
+    if (verts.empty()) {
+        return dq;
+    }
+
+    glm::vec3 minPos = verts[0].pos;
+    glm::vec3 maxPos = verts[0].pos;
+    for (const auto& v : verts) {
+        minPos = glm::min(minPos, v.pos);
+        maxPos = glm::max(maxPos, v.pos);
+    }
+
+    // flat axes keep a non-zero scale so quantizing never divides by zero
+    dq.offset = glm::vec4(minPos, 0.0f);
+    dq.scale = glm::vec4(glm::max(maxPos - minPos, glm::vec3(1e-6f)), 1.0f);
+    return dq;
+}
+
+// octahedral mapping of a unit vector onto [-1, 1]^2, the lower hemisphere folded over the diagonals
+static glm::vec2 encodeOctahedral(glm::vec3 n) {
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        const glm::vec2 signs(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * signs;
+    }
+    return e;
+}
+
+std::vector<CompactVertex> Vertex::compress(std::span<const Vertex> verts, const VertexDequantization &dequantization) {
+    const glm::vec3 offset(dequantization.offset);
+    const glm::vec3 scale(dequantization.scale);
+
+    std::vector<CompactVertex> out(verts.size());
+    for (size_t i = 0; i < verts.size(); ++i) {
+        const glm::vec3 unorm = glm::clamp((verts[i].pos - offset) / scale, 0.0f, 1.0f);
+        for (size_t k = 0; k < 3; ++k) {
+            out[i].pos[k] = glm::packUnorm1x16(unorm[static_cast<glm::length_t>(k)]);
+        }
+        out[i].pos[3] = 0;
+
+        const glm::vec2 oct = encodeOctahedral(verts[i].norm);
+        out[i].norm[0] = static_cast<int16_t>(glm::packSnorm1x16(oct.x));
+        out[i].norm[1] = static_cast<int16_t>(glm::packSnorm1x16(oct.y));
+
+        out[i].texture[0] = glm::packHalf1x16(verts[i].texture.x);
+        out[i].texture[1] = glm::packHalf1x16(verts[i].texture.y);
+    }
+
+    return out;
+}
@@ -8,7 +8,29 @@
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.hpp>
 
-#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+enum class VertexFormat : uint32_t {
+    Standard = 0,
+    Compact = 1,
+};
+
+// 16 byte vertex: position as unorm16 within the mesh bounds (w unused), octahedral snorm16 normal,
+// half float texture coordinates; color is dropped since the importer only ever mirrors position into it
+struct CompactVertex {
+    uint16_t pos[4];
+    int16_t norm[2];
+    uint16_t texture[2];
+};
+static_assert(sizeof(CompactVertex) == 16);
+
+// maps a compact position back to object space: pos = offset + unorm * scale, pushed to the compact vertex shader
+struct VertexDequantization {
+    glm::vec4 offset{0.0f};
+    glm::vec4 scale{1.0f};
+};
 
 class Vertex {
 public:
@@ -25,8 +47,13 @@ public:
     glm::vec3 color{};
     glm::vec2 texture{};
 
-    static VkVertexInputBindingDescription getBindingDesc();
-    static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescs();
+    static uint32_t getStride(VertexFormat format);
+    static VkVertexInputBindingDescription getBindingDesc(VertexFormat format = VertexFormat::Standard);
+    // locations match across formats, the compact layout just has no color at location 2
+    static std::vector<VkVertexInputAttributeDescription> getAttributeDescs(VertexFormat format = VertexFormat::Standard);
+
+    static VertexDequantization computeDequantization(std::span<const Vertex> verts);
+    static std::vector<CompactVertex> compress(std::span<const Vertex> verts, const VertexDequantization& dequantization);
 };
 
 
@@ -10,6 +10,11 @@
 #include <glm/gtx/quaternion.hpp>
 #include <flecs.h>
 
+#include <cstdint>
+#include <vector>
+
+class Mesh;
+
 namespace component {
     struct Position {
         glm::vec3 v;
@@ -24,6 +29,33 @@ namespace component {
         glm::mat4 m;
     };
 
+    struct MeshInstance {
+        const Mesh* mesh;
+        uint32_t lod;
+    };
+    // written by the frustum culling system every frame, draws skip entities that are not visible
+    struct Visibility {
+        bool visible;
+    };
+    // tag: drawn through the instance batches instead of one draw per entity
+    struct Instanced {};
+    // visible instanced entities sharing a mesh and lod, collapsed into one instanced draw
+    struct InstanceBatch {
+        const Mesh* mesh;
+        uint32_t lod;
+        std::vector<glm::mat4> models;
+    };
+    // singleton, rebuilt by the instance batching system every frame
+    struct InstanceBatches {
+        std::vector<InstanceBatch> batches;
+    };
+    // singleton, set once per frame before the render systems run
+    struct Camera {
+        glm::mat4 view;
+        glm::mat4 proj;
+        float viewportHeight;
+    };
+
     struct Object3D {
         explicit Object3D(flecs::world& world) {
             world.component<Position>();
@@ -33,6 +65,16 @@ namespace component {
         }
 
     };
+
+    struct Render {
+        explicit Render(flecs::world& world) {
+            world.component<MeshInstance>();
+            world.component<Visibility>();
+            world.component<Instanced>();
+            world.component<InstanceBatches>();
+            world.component<Camera>();
+        }
+    };
 }
 
 
@@ -15,10 +15,22 @@ namespace entity {
                 .set(component::Position{glm::vec3(0.0f)})
                 .set(component::Rotation{glm::angleAxis(0.0f, glm::vec3(0.0f, 1.0f, 0.0f))})
                 .set(component::Scale{glm::vec3(1.0f, 1.0f, 1.0f)})
-                .set(component::ModelMatrix{glm::mat4(1.0f)});
+                .set(component::ModelMatrix{glm::mat4(1.0f)})
+                .set(component::Visibility{false});
 
         return e;
     }
+
+    // one of many copies of a shared mesh, drawn together through the instance batches
+    inline flecs::entity Prop(flecs::world& world, const glm::vec3& position, const glm::quat& rotation, float scale) {
+        return world.entity()
+                .set(component::Position{position})
+                .set(component::Rotation{rotation})
+                .set(component::Scale{glm::vec3(scale)})
+                .set(component::ModelMatrix{glm::mat4(1.0f)})
+                .set(component::Visibility{false})
+                .add<component::Instanced>();
+    }
 }
 
 #endif //STAR_ENTITIES_HPP
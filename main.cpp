@@ -1,9 +1,11 @@
+#include "AssetRegistry.hpp"
 #include "DescriptorSet.hpp"
 #include "Mesh.hpp"
 #include "Screen.hpp"
 #include "ModelLoader.hpp"
 #include "components.hpp"
 #include "entities.hpp"
+#include "systems.hpp"
 
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
@@ -12,9 +14,13 @@
 #include <flecs.h>
 #include <SDL.h>
 
+#include <cmath>
+#include <vector>
+
 int main() {
     flecs::world world;
     world.import<component::Object3D>();
+    world.import<component::Render>();
 
     flecs::system buildModelMatrix = world.system<component::ModelMatrix, const component::Position, const component::Rotation, const component::Scale>(
             "buildModelMatrix").each(
@@ -25,38 +31,44 @@ int main() {
 
     auto &screen = Screen::getInstance();
     screen.create();
-
-    auto viking = ModelLoader::getInstance().load("../assets/models/viking_room.obj");
-    assert(viking.size() == 1);
-    viking[0].createBuffers();
-    viking[0].upload();
-
-    auto skybox = ModelLoader::getInstance().loadSkybox("../assets/models/skybox.obj");
+    // queued draws are recorded by the job system's workers once there are enough of them
+    screen.setParallelRecording(true);
+
+    // everything streams in while the loop runs, drawing placeholders until it is resident
+    auto& streamer = AssetStreamer::getInstance();
+    streamer.init();
+    auto& assets = AssetRegistry::getInstance();
+    const auto viking = assets.acquireModel("../assets/models/viking_room.obj", {.optimize = true, .lodLevels = 4, .meshlets = true, .compact = true});
+    const auto skybox = assets.acquireModel("../assets/models/skybox.obj", {.flipWinding = true});
+    const auto tex = assets.acquireTexture("../assets/textures/viking_room.png");
+    const auto sky = assets.acquireTexture("../assets/textures/skybox.png");
 
     auto vikingModel = entity::Player(world);
 
-    Texture tex;
-    Texture sky;
-    tex.load("../assets/textures/viking_room.png");
-    sky.load("../assets/textures/skybox.png");
+    flecs::system selectLod = systems::lodSelection(world);
+    flecs::system cull = systems::frustumCulling(world);
+    flecs::system batchInstances = systems::instanceBatching(world);
 
     DescriptorSet ds;
     DescriptorSet skyDs;
-
-    std::vector<const Texture *> textureList;
-    textureList.reserve(1);
-    textureList.push_back(&tex);
-
-    std::vector<const Texture*> skyTlist;
-    skyTlist.reserve(1);
-    skyTlist.push_back(&sky);
-
-    ds.create(2, textureList);
-    skyDs.create(2, skyTlist);
+    ds.create(2, {&assets.get(tex)});
+    skyDs.create(2, {&assets.get(sky)});
+    // texture table slots, the draws pick their texture by index instead of through set 0
+    auto& textureTable = screen.getTextureTable();
+    uint32_t texSlot = textureTable.add(assets.get(tex));
+    uint32_t skySlot = textureTable.add(assets.get(sky));
 
     vikingModel.get_mut<component::Rotation>()->q *= glm::angleAxis(M_PIf, glm::vec3(1.0f, 0.0f, 0.0f));
     vikingModel.get_mut<component::Rotation>()->q *= glm::angleAxis(-M_PIf / 2.0f, glm::vec3(0.0f, 0.0f, 1.0f));
 
+    // a ring of small copies around the room, all of them go out in one instanced draw per lod
+    std::vector<flecs::entity> props;
+    for (int i = 0; i < 16; ++i) {
+        const float angle = static_cast<float>(i) * 2.0f * M_PIf / 16.0f;
+        const glm::vec3 position(3.0f * std::cos(angle), 3.0f * std::sin(angle), 0.0f);
+        props.push_back(entity::Prop(world, position, vikingModel.get<component::Rotation>()->q, 0.25f));
+    }
+
     bool running = true;
     SDL_Event e;
     while (running) {
@@ -65,34 +77,102 @@ int main() {
                 running = false;
                 break;
             }
+            // o switches the gpu culling between two phase occlusion and frustum only
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_o && !e.key.repeat) {
+                auto& gpuCuller = screen.getGpuCuller();
+                gpuCuller.setOcclusion(!gpuCuller.getOcclusion());
+            }
+        }
+
+        assets.update();
+        // a streamed texture that became resident moves to a new slot
+        texSlot = textureTable.update(texSlot, assets.get(tex));
+        skySlot = textureTable.update(skySlot, assets.get(sky));
+        // the mesh list moves whenever the registry evicts and reloads it, so the pointer is refreshed every frame
+        const auto& vikingMeshes = assets.get(viking);
+        const auto attach = [&](flecs::entity entity) {
+            if (vikingMeshes.empty()) {
+                entity.remove<component::MeshInstance>();
+            } else if (entity.has<component::MeshInstance>()) {
+                entity.get_mut<component::MeshInstance>()->mesh = &vikingMeshes[0];
+            } else {
+                entity.set(component::MeshInstance{&vikingMeshes[0], 0});
+            }
+        };
+        attach(vikingModel);
+        for (auto prop : props) {
+            attach(prop);
+        }
+
+        component::Camera camera{};
+        camera.view = glm::lookAt(glm::vec3(2.0f, 2.0f, -2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        camera.proj = glm::perspective(glm::radians(45.0f), screen.getWidth() / screen.getHeight(), 0.1f, 100.0f);
+        camera.viewportHeight = screen.getHeight();
+        world.set(camera);
+
+        buildModelMatrix.run();
+        cull.run();
+        selectLod.run();
+        batchInstances.run();
+
+        // coarse lods go through the gpu frustum and occlusion culling, its dispatch is recorded before the
+        // render pass. without drawIndirectFirstInstance they are drawn directly, culled by the cpu
+        auto& gpuCuller = screen.getGpuCuller();
+        gpuCuller.begin(camera.proj * camera.view);
+        if (const auto* instance = vikingModel.get<component::MeshInstance>(); instance && instance->lod > 0 && screen.supportsGpuCulling()) {
+            gpuCuller.add(*instance->mesh, vikingModel.get<component::ModelMatrix>()->m, instance->lod, texSlot);
         }
 
         screen.drawFrame([&](Screen &sc) {
-            buildModelMatrix.run();
             UniformBufferData data{};
-            data.view = glm::lookAt(glm::vec3(2.0f, 2.0f, -2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-            data.proj = glm::perspective(glm::radians(45.0f), sc.getWidth() / sc.getHeight(), 0.1f, 100.0f);
+            data.view = camera.view;
+            data.proj = camera.proj;
+
+            // queued draws are sorted by pipeline, descriptor set, geometry and then front to back
+            const glm::vec3 eye = glm::vec3(glm::inverse(camera.view)[3]);
+            const auto depthOf = [&](const glm::mat4& model) {
+                return glm::distance(eye, glm::vec3(model[3])) / 100.0f;
+            };
 
             data.model = glm::scale(glm::rotate(glm::mat4(1.0f), M_PIf, glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(10.0f));
             skyDs.setUniformData(sc.getCurrentFrame(), data);
-            sc.bindDescriptorSet(skyDs[sc.getCurrentFrame()]);
-            sc.drawMesh(skybox);
+            skyDs.setTextures(sc.getCurrentFrame(), {&assets.get(sky)});
+            for (const auto& mesh : assets.get(skybox)) {
+                sc.queueMesh(mesh, skyDs[sc.getCurrentFrame()], 1.0f, 0, RenderLayer::Sky, PipelineVariants::DEFAULT_STATE, skySlot);
+            }
 
             data.model = vikingModel.get_mut<component::ModelMatrix>()->m;
             ds.setUniformData(sc.getCurrentFrame(), data);
-            sc.bindDescriptorSet(ds[sc.getCurrentFrame()]);
-            sc.drawMesh(viking[0]);
+            ds.setTextures(sc.getCurrentFrame(), {&assets.get(tex)});
+
+            // the props share the room's texture, only view and projection come from the uniform data
+            if (const auto* batches = world.get<component::InstanceBatches>()) {
+                for (const auto& batch : batches->batches) {
+                    sc.queueMeshInstanced(*batch.mesh, ds[sc.getCurrentFrame()], batch.models, depthOf(batch.models.front()), batch.lod,
+                                          RenderLayer::Opaque, PipelineVariants::DEFAULT_STATE, texSlot);
+                }
+            }
 
+            const auto* instance = vikingModel.get<component::MeshInstance>();
+            if (!instance || !vikingModel.get<component::Visibility>()->visible) {
+                return;
+            }
 
+            sc.bindDescriptorSet(ds[sc.getCurrentFrame()]);
+            if (instance->lod == 0) {
+                sc.drawMeshlets(*instance->mesh, data.model, Frustum(camera.proj * camera.view), eye, texSlot);
+            } else if (sc.supportsGpuCulling()) {
+                sc.drawCulled();
+            } else {
+                sc.drawMesh(*instance->mesh, instance->lod, texSlot);
+            }
         });
     }
 
-    viking[0].destroy();
-    skybox.destroy();
     ds.destroy();
     skyDs.destroy();
-    sky.destroy();
-    tex.destroy();
+    assets.destroy();
+    streamer.destroy();
     screen.destroy();
 
     return 0;
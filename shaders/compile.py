@@ -1,31 +1,55 @@
 #!/usr/bin/env python3
 
 import pathlib
+import shutil
 import subprocess
 
 
+# extra builds of a shader under another name, with the given defines
+VARIANTS = {
+    # devices without descriptor indexing sample set 0's texture only
+    'shader.frag': [('shader_set0.frag', ['-DNO_TEXTURE_TABLE'])],
+}
+
 def compile():
-    files = [p for p in pathlib.Path('.').iterdir() if p.is_file() and p.suffix in ['.glsl', '.vert', '.frag']]
+    files = [p for p in pathlib.Path('.').iterdir() if p.is_file() and p.suffix in ['.glsl', '.vert', '.frag', '.comp']]
     for file in files:
         print('compile', file)
-        subprocess.run(['glslc', str(file), '-o', f'build/{str(file)}.spv'])
+        subprocess.run(['glslc', str(file), '-o', f'build/{str(file)}.spv'], check=True)
+        for name, defines in VARIANTS.get(file.name, []):
+            print('compile', name)
+            subprocess.run(['glslc', *defines, str(file), '-o', f'build/{name}.spv'], check=True)
+
+def optimize():
+    if shutil.which('spirv-opt') is None:
+        print('spirv-opt not found, shaders stay unoptimized')
+        return
+
+    # performance passes, then size passes; debug names stay, reflection looks bindings up by them
+    files = [p for p in pathlib.Path('./build').iterdir() if p.is_file() and p.suffix in ['.spv']]
+    for file in files:
+        print('optimize', file)
+        subprocess.run(['spirv-opt', '-O', '-Os', str(file), '-o', str(file)], check=True)
 
 def inline():
-    files = [p for p in pathlib.Path('./build').iterdir() if p.is_file and p.suffix in ['.spv']]
+    files = [p for p in pathlib.Path('./build').iterdir() if p.is_file() and p.suffix in ['.spv']]
     for file in files:
         print('inline', file)
+        with open(file, 'rb') as data:
+            bytecode = data.read()
+        if len(bytecode) % 4 != 0:
+            raise RuntimeError(f'{file} is not a whole number of words')
+
+        # whole words, so the module can be handed to vulkan in place
+        words = [int.from_bytes(bytecode[i:i + 4], 'little') for i in range(0, len(bytecode), 4)]
+        varname = file.stem.replace('.', '_')
         with open(f'{str(file)}.inl', 'w') as fp:
-            with open(file, 'rb') as data:
-                bytecode = bytearray(data.read())
-
-            varname = file.stem.replace('.', '_')
-            size = len(bytecode)
-            fp.write(f"constexpr std::array<unsigned char, {size}> {varname}[] = {{ {','.join(str(x) for x in bytecode)} }};")
-
+            fp.write(f"alignas(4) constexpr uint32_t {varname}[{len(words)}] = {{ {','.join(hex(x) for x in words)} }};\n")
 
 
 def main():
     compile()
+    optimize()
     inline()
 
 if __name__ == '__main__':
@@ -1,15 +1,40 @@
 #version 450
+// built a second time with NO_TEXTURE_TABLE as shader_set0.frag, for devices without descriptor indexing
+#ifndef NO_TEXTURE_TABLE
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTexture;
 
 layout(location = 0) out vec4 outColor;
 
 layout(binding = 1) uniform sampler texSampler;
 layout(binding = 2) uniform texture2D tex;
+#ifndef NO_TEXTURE_TABLE
+// TextureTable, indexed per draw or per instance
+layout(set = 2, binding = 0) uniform texture2D textures[];
+#endif
+
+const uint NO_TEXTURE = 0xffffffffu;
+
+// set per material through RenderState::constants
+layout(constant_id = 0) const bool alphaTest = false;
+layout(constant_id = 1) const float alphaCutoff = 0.5;
 
 void main() {
     //outColor = vec4(fragColor, 1.0);
     //outColor = vec4(fragTexCoord, 0.0, 1.0);
-    outColor = texture(sampler2D(tex, texSampler), fragTexCoord);
+#ifndef NO_TEXTURE_TABLE
+    if (fragTexture != NO_TEXTURE) {
+        outColor = texture(sampler2D(textures[nonuniformEXT(fragTexture)], texSampler), fragTexCoord);
+    } else
+#endif
+    {
+        outColor = texture(sampler2D(tex, texSampler), fragTexCoord);
+    }
+    if (alphaTest && outColor.a < alphaCutoff) {
+        discard;
+    }
 }
\ No newline at end of file
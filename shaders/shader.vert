@@ -7,6 +7,7 @@ layout(location = 3) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexture;
 
 layout(binding = 0) uniform UniformBufferData {
     mat4 model;
@@ -14,8 +15,14 @@ layout(binding = 0) uniform UniformBufferData {
     mat4 proj;
 } ubo;
 
+// the dequantization block of the compact shader comes first
+layout(push_constant) uniform Material {
+    layout(offset = 32) uint texture;
+} material;
+
 void main() {
     gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragTexture = material.texture;
 }
@@ -0,0 +1,31 @@
+#version 450
+
+// CompactVertex: unorm16 position within the mesh bounds, octahedral normal, half float uv
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 3) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexture;
+
+layout(binding = 0) uniform UniformBufferData {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(push_constant) uniform VertexDequantization {
+    vec4 offset;
+    vec4 scale;
+    uint texture;
+} dq;
+
+void main() {
+    vec3 position = dq.offset.xyz + inPosition.xyz * dq.scale.xyz;
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(position, 1.0);
+    // the standard layout's color is a copy of the position
+    fragColor = position;
+    fragTexCoord = inTexCoord;
+    fragTexture = dq.texture;
+}
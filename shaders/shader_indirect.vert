@@ -0,0 +1,46 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inColor;
+layout(location = 3) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexture;
+
+layout(binding = 0) uniform UniformBufferData {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+struct Instance {
+    mat4 model;
+    vec4 sphere;
+    vec4 dqOffset;
+    vec4 dqScale;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint group;
+    uint commandBase;
+    // TextureTable slot, NO_TEXTURE samples set 0's texture
+    uint texture;
+    uint pad1;
+    uint pad2;
+};
+
+// the model matrix comes from the instance record instead of the uniform buffer, written by the
+// culling pass or by instanced draws
+layout(std430, set = 1, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+void main() {
+    mat4 model = instances[gl_InstanceIndex].model;
+    fragTexture = instances[gl_InstanceIndex].texture;
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+}
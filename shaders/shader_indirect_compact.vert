@@ -0,0 +1,47 @@
+#version 450
+
+// CompactVertex: unorm16 position within the mesh bounds, octahedral normal, half float uv
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 3) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexture;
+
+layout(binding = 0) uniform UniformBufferData {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+struct Instance {
+    mat4 model;
+    vec4 sphere;
+    vec4 dqOffset;
+    vec4 dqScale;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint group;
+    uint commandBase;
+    // TextureTable slot, NO_TEXTURE samples set 0's texture
+    uint texture;
+    uint pad1;
+    uint pad2;
+};
+
+// model matrix and dequantization both come from the instance record, indirect draws cannot push
+// constants and instanced ones may mix meshes across draws
+layout(std430, set = 1, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+void main() {
+    Instance inst = instances[gl_InstanceIndex];
+    vec3 position = inst.dqOffset.xyz + inPosition.xyz * inst.dqScale.xyz;
+    gl_Position = ubo.proj * ubo.view * inst.model * vec4(position, 1.0);
+    fragColor = position;
+    fragTexCoord = inTexCoord;
+    fragTexture = inst.texture;
+}
@@ -0,0 +1,168 @@
+#include "systems.hpp"
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace systems {
+    flecs::system lodSelection(flecs::world& world, float pixelError) {
+        return world.system<component::MeshInstance, const component::ModelMatrix>("lodSelection")
+                .run([pixelError](flecs::iter& it) {
+                    const auto* camera = it.world().get<component::Camera>();
+                    if (!camera) {
+                        while (it.next()) {}
+                        return;
+                    }
+
+                    const glm::vec3 eye = glm::vec3(glm::inverse(camera->view)[3]);
+                    const float projScale = camera->proj[1][1] * camera->viewportHeight * 0.5f;
+
+                    while (it.next()) {
+                        auto instance = it.field<component::MeshInstance>(0);
+                        auto model = it.field<const component::ModelMatrix>(1);
+
+                        for (auto i : it) {
+                            const Mesh* mesh = instance[i].mesh;
+                            if (!mesh || mesh->getNumLods() == 1) {
+                                instance[i].lod = 0;
+                                continue;
+                            }
+
+                            const glm::mat4& m = model[i].m;
+                            const glm::vec4 sphere = mesh->getBoundingSphere();
+                            const glm::vec3 center = glm::vec3(m * glm::vec4(glm::vec3(sphere), 1.0f));
+                            const float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+
+                            // screen pixels covered by one object space unit at the nearest point of the bounds
+                            const float distance = std::max(glm::distance(center, eye) - sphere.w * scale, 1e-3f);
+                            const float pixelsPerUnit = scale * projScale / distance;
+
+                            uint32_t lod = 0;
+                            for (uint32_t level = 1; level < mesh->getNumLods(); ++level) {
+                                if (mesh->getLod(level).error * pixelsPerUnit > pixelError) {
+                                    break;
+                                }
+                                lod = level;
+                            }
+                            instance[i].lod = lod;
+                        }
+                    }
+                });
+    }
+
+    flecs::system frustumCulling(flecs::world& world) {
+        return world.system<const component::MeshInstance, const component::ModelMatrix, component::Visibility>("frustumCulling")
+                .run([](flecs::iter& it) {
+                    const auto* camera = it.world().get<component::Camera>();
+                    if (!camera) {
+                        while (it.next()) {}
+                        return;
+                    }
+
+                    const Frustum frustum(camera->proj * camera->view);
+
+                    // reused across tables and frames
+                    static thread_local std::vector<float> x, y, z, radius;
+                    static thread_local std::vector<uint8_t> visible;
+
+                    while (it.next()) {
+                        auto instance = it.field<const component::MeshInstance>(0);
+                        auto model = it.field<const component::ModelMatrix>(1);
+                        auto visibility = it.field<component::Visibility>(2);
+
+                        const size_t count = it.count();
+                        x.resize(count);
+                        y.resize(count);
+                        z.resize(count);
+                        radius.resize(count);
+                        visible.resize(count);
+
+                        for (auto i : it) {
+                            const Mesh* mesh = instance[i].mesh;
+                            if (!mesh) {
+                                // nothing to draw, no plane distance reaches this radius
+                                x[i] = y[i] = z[i] = 0.0f;
+                                radius[i] = -std::numeric_limits<float>::max();
+                                continue;
+                            }
+
+                            const glm::mat4& m = model[i].m;
+                            const glm::vec4 sphere = mesh->getBoundingSphere();
+                            const glm::vec3 center = glm::vec3(m * glm::vec4(glm::vec3(sphere), 1.0f));
+                            const float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+                            x[i] = center.x;
+                            y[i] = center.y;
+                            z[i] = center.z;
+                            radius[i] = sphere.w * scale;
+                        }
+
+                        frustum.testSpheres(x.data(), y.data(), z.data(), radius.data(), count, visible.data());
+
+                        for (auto i : it) {
+                            if (!visible[i]) {
+                                visibility[i].visible = false;
+                                continue;
+                            }
+
+                            // the few survivors get the tighter box test, transformed to world space (Arvo)
+                            const glm::mat4& m = model[i].m;
+                            const BoundingBox box = instance[i].mesh->getBoundingBox();
+                            glm::vec3 min = glm::vec3(m[3]);
+                            glm::vec3 max = min;
+                            for (glm::length_t c = 0; c < 3; ++c) {
+                                const glm::vec3 a = glm::vec3(m[c]) * box.min[c];
+                                const glm::vec3 b = glm::vec3(m[c]) * box.max[c];
+                                min += glm::min(a, b);
+                                max += glm::max(a, b);
+                            }
+                            visibility[i].visible = frustum.intersectsBox(min, max);
+                        }
+                    }
+                });
+    }
+
+    flecs::system instanceBatching(flecs::world& world) {
+        return world.system<const component::MeshInstance, const component::ModelMatrix, const component::Visibility>("instanceBatching")
+                .with<component::Instanced>()
+                .run([](flecs::iter& it) {
+                    // batches and their vectors are reused from the last frame to keep their capacity
+                    auto& batches = it.world().ensure<component::InstanceBatches>().batches;
+                    for (auto& batch : batches) {
+                        batch.models.clear();
+                    }
+
+                    component::InstanceBatch* last = nullptr;
+                    while (it.next()) {
+                        auto instance = it.field<const component::MeshInstance>(0);
+                        auto model = it.field<const component::ModelMatrix>(1);
+                        auto visibility = it.field<const component::Visibility>(2);
+
+                        for (auto i : it) {
+                            if (!instance[i].mesh || !visibility[i].visible) {
+                                continue;
+                            }
+
+                            // entities of one table mostly share a mesh, check the previous batch first
+                            if (!last || last->mesh != instance[i].mesh || last->lod != instance[i].lod) {
+                                auto found = std::find_if(batches.begin(), batches.end(), [&](const component::InstanceBatch& b) {
+                                    return b.mesh == instance[i].mesh && b.lod == instance[i].lod;
+                                });
+                                if (found == batches.end()) {
+                                    batches.push_back({instance[i].mesh, instance[i].lod, {}});
+                                    found = batches.end() - 1;
+                                }
+                                last = &*found;
+                            }
+                            last->models.push_back(model[i].m);
+                        }
+                    }
+
+                    // a batch left empty may point at a mesh that is gone by now
+                    std::erase_if(batches, [](const component::InstanceBatch& b) {
+                        return b.models.empty();
+                    });
+                });
+    }
+}
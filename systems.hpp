@@ -0,0 +1,19 @@
+#ifndef STAR_SYSTEMS_HPP
+#define STAR_SYSTEMS_HPP
+
+#include "components.hpp"
+
+#include <flecs.h>
+
+namespace systems {
+    // picks the coarsest lod whose simplification error stays under pixelError pixels on screen
+    flecs::system lodSelection(flecs::world& world, float pixelError = 1.0f);
+    // tests the world space bounding sphere of every mesh instance against the camera frustum,
+    // a table at a time in structure of arrays batches
+    flecs::system frustumCulling(flecs::world& world);
+    // groups the model matrices of visible Instanced entities by mesh and lod into the
+    // InstanceBatches singleton, run after culling and lod selection
+    flecs::system instanceBatching(flecs::world& world);
+}
+
+#endif //STAR_SYSTEMS_HPP